@@ -0,0 +1,410 @@
+/**
+ * Micro-benchmarks of the hot kernels of the reshaping solver on synthetic meshes.
+ *
+ * Usage:
+ *      kernel_benchmarks.exe [--max-faces <num_faces>] [--shape <sphere|cylinder> ...] [--benchmark_* options]
+ *
+ *      Every kernel is run on subdivided spheres and capped cylinders of about 1k, 10k, 100k and 1M faces
+ *      (only the sizes up to --max-faces). Spheres are subdivided icosahedra (20 * 4^k faces, the closest
+ *      level to each size is used) and cylinders come from build_cylinder_mesh. Their per-face principal
+ *      curvatures are the analytic ones.
+ *
+ *      The solve kernels run on a state stretched along z (vertices and per-face transformations), so that
+ *      the evaluated terms are not the trivial ones of the input mesh. Kernels:
+ *          vertex_stencils/<terms>     stencils of one vertex-solve term group (edges: edge length, normal and
+ *                                      regularizer terms; sphericity)
+ *          transf_stencils/<terms>     stencils of one transformation-solve term group (edge_pairs: connect and
+ *                                      similarity terms; edge_faces: transform and normal terms; sphericity)
+ *          vertex_assembly             vertex-solve normal equations (pattern reused, as in iterations > 0)
+ *          transf_assembly             transformation-solve normal equations (pattern reused)
+ *          reshaping_energy            compute_reshaping_energy
+ *          update_target_edge_lengths  update_target_edge_lengths
+ *          get_edge_index              TriMesh::get_edge_index on the three edges of every face
+ *          trimesh_adjacency           TriMesh construction (edge map and edge-face adjacency)
+ *          sphericity_terms_info       compute_sphericity_terms_info
+ *
+ *      Any google-benchmark option (e.g. --benchmark_filter=vertex_stencils, --benchmark_format=json,
+ *      --benchmark_repetitions=5) is forwarded to the benchmark library.
+ */
+#include <mesh_reshaping/globals.h>
+#include <mesh_reshaping/reshaping_params.h>
+#include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/reshaping_tool.h>
+#include <mesh_reshaping/reshaping_energy.h>
+#include <mesh_reshaping/precompute_reshaping_data.h>
+#include <mesh_reshaping/sphericity_terms_info.h>
+#include <mesh_reshaping/transformation_solve.h>
+#include <mesh_reshaping/vertex_solve.h>
+
+#include <ca_essentials/meshes/build_cylinder_mesh.h>
+
+#include <benchmark/benchmark.h>
+
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CLIArgs {
+    int max_faces = 1000000;
+    std::vector<std::string> shapes = { "sphere", "cylinder" };
+};
+
+// Approximate face counts of the benchmarked meshes
+const std::vector<int> MESH_SIZES = { 1000, 10000, 100000, 1000000 };
+
+// Synthetic input mesh, with its pre-computed context and a stretched state
+struct KernelInput {
+    std::unique_ptr<reshaping::TriMesh> mesh;
+    Eigen::VectorXd PV1;
+    Eigen::VectorXd PV2;
+
+    reshaping::ReshapingParams params;
+    std::shared_ptr<const reshaping::ReshapingContext> context;
+    std::unique_ptr<reshaping::ReshapingState> state;
+};
+
+void setup_logger() {
+    LOGGER.set_level(spdlog::level::level_enum::warn);
+}
+
+int parse_command_args(int argc, char** argv, CLIArgs& args) {
+    CLI::App cli_app{ argv[0] };
+
+    cli_app.allow_extras(true);
+    cli_app.add_option("--max-faces", args.max_faces, "Largest benchmarked mesh size (number of faces)");
+    cli_app.add_option("--shape"    , args.shapes   , "Benchmarked synthetic meshes (sphere, cylinder)");
+
+    try {
+        cli_app.parse((argc), (argv));
+        return 0;
+    } catch(const CLI::ParseError &e) {
+        cli_app.exit(e);
+        return 1;
+    }
+}
+
+// Icosahedron subdivided num_levels times (each level splits every face into
+// four), with its vertices projected onto the sphere of the given radius
+void build_sphere_mesh(double radius, int num_levels,
+                       Eigen::MatrixXd& V,
+                       Eigen::MatrixXi& F) {
+    const double t = (1.0 + std::sqrt(5.0)) / 2.0;
+
+    std::vector<Eigen::Vector3d> verts = {
+        {-1,  t,  0}, { 1,  t,  0}, {-1, -t,  0}, { 1, -t,  0},
+        { 0, -1,  t}, { 0,  1,  t}, { 0, -1, -t}, { 0,  1, -t},
+        { t,  0, -1}, { t,  0,  1}, {-t,  0, -1}, {-t,  0,  1},
+    };
+
+    std::vector<Eigen::Vector3i> tris = {
+        {0, 11,  5}, {0,  5,  1}, { 0,  1,  7}, { 0,  7, 10}, {0, 10, 11},
+        {1,  5,  9}, {5, 11,  4}, {11, 10,  2}, {10,  7,  6}, {7,  1,  8},
+        {3,  9,  4}, {3,  4,  2}, { 3,  2,  6}, { 3,  6,  8}, {3,  8,  9},
+        {4,  9,  5}, {2,  4, 11}, { 6,  2, 10}, { 8,  6,  7}, {9,  8,  1},
+    };
+
+    for(int l = 0; l < num_levels; ++l) {
+        // Midpoint vertex of every edge, keyed by its (sorted) end points
+        std::map<std::pair<int, int>, int> midpoints;
+        auto midpoint = [&](int v0, int v1) {
+            const std::pair<int, int> key(std::min(v0, v1), std::max(v0, v1));
+
+            auto itr = midpoints.find(key);
+            if(itr != midpoints.end())
+                return itr->second;
+
+            verts.push_back((verts.at(v0) + verts.at(v1)) * 0.5);
+            const int vid = (int) verts.size() - 1;
+            midpoints.emplace(key, vid);
+            return vid;
+        };
+
+        std::vector<Eigen::Vector3i> sub_tris;
+        sub_tris.reserve(tris.size() * 4);
+        for(const Eigen::Vector3i& tri : tris) {
+            const int a = midpoint(tri(0), tri(1));
+            const int b = midpoint(tri(1), tri(2));
+            const int c = midpoint(tri(2), tri(0));
+
+            sub_tris.emplace_back(tri(0), a, c);
+            sub_tris.emplace_back(tri(1), b, a);
+            sub_tris.emplace_back(tri(2), c, b);
+            sub_tris.emplace_back(a, b, c);
+        }
+        tris = std::move(sub_tris);
+    }
+
+    V.resize(verts.size(), 3);
+    for(int v = 0; v < (int) verts.size(); ++v)
+        V.row(v) = verts.at(v).normalized() * radius;
+
+    F.resize(tris.size(), 3);
+    for(int f = 0; f < (int) tris.size(); ++f)
+        F.row(f) = tris.at(f);
+}
+
+// Builds the synthetic mesh of the given shape with about num_faces faces and its
+// analytic per-face principal curvatures. Meshes fit in the unit box, as the
+// normalized bundled models.
+void build_synthetic_mesh(const std::string& shape, int num_faces,
+                          Eigen::MatrixXd& V,
+                          Eigen::MatrixXi& F,
+                          Eigen::VectorXd& PV1,
+                          Eigen::VectorXd& PV2) {
+    if(shape == "sphere") {
+        const double radius = 0.5;
+
+        // Closest (in log scale) subdivision level to num_faces
+        const int num_levels = std::max(0, (int) std::lround(std::log(num_faces / 20.0) / std::log(4.0)));
+        build_sphere_mesh(radius, num_levels, V, F);
+
+        PV1.setConstant(F.rows(), 1.0 / radius);
+        PV2.setConstant(F.rows(), 1.0 / radius);
+    }
+    else {
+        const double radius = 0.25;
+        const double height = 1.0;
+
+        // num_faces = 2 * n_radial * n_height, with square-ish side faces
+        const int n_radial = std::max(3, (int) std::lround(std::sqrt(num_faces * M_PI / 4.0)));
+        const int n_height = std::max(2, (int) std::lround(num_faces / (2.0 * n_radial)));
+        ca_essentials::meshes::build_cylinder_mesh(radius, height, V, F, n_radial, n_height, true);
+
+        // Side faces come first (see build_cylinder_mesh); caps are flat
+        const int num_side_faces = (n_height - 1) * n_radial * 2;
+        PV1.setZero(F.rows());
+        PV2.setZero(F.rows());
+        PV1.head(num_side_faces).setConstant(1.0 / radius);
+    }
+}
+
+// Stretches the state along z: every vertex, and every transformation (with a
+// small per-face twist), as an intermediate iterate of a stretching edit would
+void stretch_state(reshaping::ReshapingState& data) {
+    const double stretch = 1.2;
+
+    data.curr_vertices.col(2) *= stretch;
+
+    const int num_faces = data.mesh.get_num_facets();
+    for(int f = 0; f < num_faces; ++f) {
+        const double angle = 0.05 * std::sin(f * 0.1);
+        const Eigen::Matrix3d R = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+
+        data.prev_tri_T.at(f) = data.curr_tri_T.at(f);
+        data.curr_tri_T.at(f) = R * Eigen::Vector3d(1.0, 1.0, stretch).asDiagonal();
+    }
+
+    reshaping::update_target_edge_lengths(data);
+}
+
+// Builds (once) and returns the input of the given shape and size. Inputs are
+// shared by all the benchmarks and kept until the process exits.
+KernelInput& get_kernel_input(const std::string& shape, int num_faces) {
+    static std::map<std::pair<std::string, int>, std::unique_ptr<KernelInput>> inputs;
+
+    auto& input = inputs[{ shape, num_faces }];
+    if(input)
+        return *input;
+
+    input = std::make_unique<KernelInput>();
+
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    build_synthetic_mesh(shape, num_faces, V, F, input->PV1, input->PV2);
+    input->mesh = std::make_unique<reshaping::TriMesh>(V, F);
+
+    // Pre-factorizing the transformation system is not benchmarked (and is too
+    // slow on the largest meshes): the assembly path is used instead
+    input->params.transf_sol.factor_once = false;
+    input->params.input_name = shape;
+
+    input->context = reshaping::precompute_reshaping_context(input->params,
+                                                             *input->mesh,
+                                                             input->PV1,
+                                                             input->PV2);
+
+    // A single handle on the top of the mesh
+    int handle_vid = 0;
+    V.col(2).maxCoeff(&handle_vid);
+    const Eigen::Vector3d handle_pos = V.row(handle_vid);
+    std::unordered_map<int, Eigen::Vector3d> bc = { { handle_vid, handle_pos * 1.2 } };
+
+    input->state = reshaping::make_reshaping_state(input->params, input->context, bc);
+    stretch_state(*input->state);
+
+    return *input;
+}
+
+void set_mesh_counters(benchmark::State& st, const KernelInput& input, int64_t num_items) {
+    st.SetItemsProcessed(st.iterations() * num_items);
+    st.counters["faces"] = input.mesh->get_num_facets();
+    st.counters["verts"] = input.mesh->get_num_vertices();
+}
+
+void register_benchmarks(const std::string& shape, int num_faces) {
+    using Kernel = std::function<void(benchmark::State&, KernelInput&)>;
+
+    auto add = [&](const std::string& name, Kernel kernel) {
+        const std::string full_name = name + "/" + shape + "/" + std::to_string(num_faces);
+        benchmark::RegisterBenchmark(full_name.c_str(), [shape, num_faces, kernel](benchmark::State& st) {
+            kernel(st, get_kernel_input(shape, num_faces));
+        })->Unit(benchmark::kMicrosecond);
+    };
+
+    const std::vector<std::pair<std::string, reshaping::VertexSolveTerms>> vertex_terms = {
+        { "edges"     , reshaping::VertexSolveTerms::Edges },
+        { "sphericity", reshaping::VertexSolveTerms::Sphericity },
+    };
+
+    for(const auto& [terms_name, terms] : vertex_terms) {
+        add("vertex_stencils/" + terms_name, [terms = terms](benchmark::State& st, KernelInput& input) {
+            for(auto _ : st) {
+                double sum = reshaping::evaluate_vertex_solve_stencils(input.params.vertex_sol,
+                                                                       *input.state,
+                                                                       terms);
+                benchmark::DoNotOptimize(sum);
+            }
+            set_mesh_counters(st, input, input.mesh->get_num_edges());
+        });
+    }
+
+    const std::vector<std::pair<std::string, reshaping::TransfSolveTerms>> transf_terms = {
+        { "edge_pairs", reshaping::TransfSolveTerms::EdgePairs },
+        { "edge_faces", reshaping::TransfSolveTerms::EdgeFaces },
+        { "sphericity", reshaping::TransfSolveTerms::Sphericity },
+    };
+
+    for(const auto& [terms_name, terms] : transf_terms) {
+        add("transf_stencils/" + terms_name, [terms = terms](benchmark::State& st, KernelInput& input) {
+            for(auto _ : st) {
+                double sum = reshaping::evaluate_transformation_solve_stencils(input.params.transf_sol,
+                                                                               *input.state,
+                                                                               terms);
+                benchmark::DoNotOptimize(sum);
+            }
+            set_mesh_counters(st, input, input.mesh->get_num_edges());
+        });
+    }
+
+    add("vertex_assembly", [](benchmark::State& st, KernelInput& input) {
+        Eigen::VectorXd AtWb;
+
+        // The first call builds the system pattern
+        reshaping::assemble_vertex_solve_normal_equations(input.params.vertex_sol, *input.state, AtWb);
+
+        for(auto _ : st) {
+            reshaping::assemble_vertex_solve_normal_equations(input.params.vertex_sol, *input.state, AtWb);
+            benchmark::ClobberMemory();
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_edges());
+        st.counters["nnz"] = (double) input.state->vertex_AtWA.nonZeros();
+    });
+
+    add("transf_assembly", [](benchmark::State& st, KernelInput& input) {
+        Eigen::VectorXd AtWb;
+
+        // The first call builds the system pattern
+        reshaping::assemble_transformation_solve_normal_equations(input.params.transf_sol, *input.state, AtWb);
+
+        for(auto _ : st) {
+            reshaping::assemble_transformation_solve_normal_equations(input.params.transf_sol, *input.state, AtWb);
+            benchmark::ClobberMemory();
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_edges());
+        st.counters["nnz"] = (double) input.state->transf_AtWA.nonZeros();
+    });
+
+    add("reshaping_energy", [](benchmark::State& st, KernelInput& input) {
+        for(auto _ : st) {
+            reshaping::ReshapingEnergy energy = reshaping::compute_reshaping_energy(input.params,
+                                                                                    *input.state,
+                                                                                    input.state->curr_vertices);
+            benchmark::DoNotOptimize(energy.total_cost);
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_edges());
+    });
+
+    add("update_target_edge_lengths", [](benchmark::State& st, KernelInput& input) {
+        for(auto _ : st) {
+            reshaping::update_target_edge_lengths(*input.state);
+            benchmark::ClobberMemory();
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_edges());
+    });
+
+    add("get_edge_index", [](benchmark::State& st, KernelInput& input) {
+        const auto& mesh = *input.mesh;
+        const auto& F = mesh.get_facets();
+        const int num_faces = mesh.get_num_facets();
+
+        for(auto _ : st) {
+            int64_t sum = 0;
+            for(int f = 0; f < num_faces; ++f)
+                sum += mesh.get_edge_index(F(f, 0), F(f, 1)) +
+                       mesh.get_edge_index(F(f, 1), F(f, 2)) +
+                       mesh.get_edge_index(F(f, 2), F(f, 0));
+            benchmark::DoNotOptimize(sum);
+        }
+        set_mesh_counters(st, input, num_faces * 3);
+    });
+
+    // TriMesh::initialize_edge_face_adjacency is private: the whole construction
+    // (which also builds the edge map) is measured
+    add("trimesh_adjacency", [](benchmark::State& st, KernelInput& input) {
+        const Eigen::MatrixXd V = input.mesh->get_vertices();
+        const Eigen::MatrixXi F = input.mesh->get_facets();
+
+        for(auto _ : st) {
+            reshaping::TriMesh mesh(V, F);
+            size_t num_adj = mesh.get_edge_face_adjacency().size();
+            benchmark::DoNotOptimize(num_adj);
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_facets());
+    });
+
+    add("sphericity_terms_info", [](benchmark::State& st, KernelInput& input) {
+        const reshaping::SphericityTermsParams sph_params;
+
+        for(auto _ : st) {
+            auto terms_info = reshaping::compute_sphericity_terms_info(*input.mesh,
+                                                                       input.PV1,
+                                                                       input.PV2,
+                                                                       sph_params);
+            benchmark::DoNotOptimize(terms_info);
+        }
+        set_mesh_counters(st, input, input.mesh->get_num_facets());
+        st.counters["terms"] = (double) input.context->sphericity_terms_info.size();
+    });
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    CLIArgs cli_args;
+    if(parse_command_args(argc, argv, cli_args) != 0)
+        return 1;
+
+    setup_logger();
+
+    for(const auto& shape : cli_args.shapes) {
+        if(shape != "sphere" && shape != "cylinder") {
+            LOGGER.error("Unknown synthetic mesh {}", shape);
+            return 1;
+        }
+
+        for(int num_faces : MESH_SIZES)
+            if(num_faces <= cli_args.max_faces)
+                register_benchmarks(shape, num_faces);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
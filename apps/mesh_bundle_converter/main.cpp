@@ -0,0 +1,130 @@
+/**
+ * Converts reshaping assets between their text files (.obj, .fk, .straight, .deform and .cam)
+ * and single-file mesh bundles (.rsb), which are memory mapped when loaded.
+ *
+ * Usage:
+ *      mesh_bundle_converter.exe -i <input_mesh.obj> -o <output_bundle.rsb>
+ *      mesh_bundle_converter.exe -i <input_bundle.rsb> -o <output_mesh.obj>
+ *      mesh_bundle_converter.exe -i <input_folder> -o <output_folder> [--to-text]
+ *
+ *      The conversion direction is given by the input extension. If the input is a folder, every
+ *      asset in it (.obj, or .rsb with --to-text) is converted into the output folder.
+ */
+#include <mesh_reshaping/globals.h>
+#include <mesh_reshaping/mesh_bundle.h>
+
+#include <ca_essentials/core/timer.h>
+
+#include <CLI/CLI.hpp>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct CLIArgs {
+    std::string input;
+    std::string output;
+    bool to_text = false;
+};
+
+void setup_logger() {
+    LOGGER.set_level(spdlog::level::level_enum::info);
+}
+
+int parse_command_args(int argc, char const* argv[], CLIArgs& args) {
+    CLI::App cli_app{ argv[0] };
+
+    cli_app.allow_extras(true);
+    cli_app.add_option("-i, --input" , args.input  , "Input mesh (.obj), mesh bundle (.rsb) or folder")->required();
+    cli_app.add_option("-o, --output", args.output , "Output mesh bundle (.rsb), mesh (.obj) or folder")->required();
+    cli_app.add_flag("--to-text"     , args.to_text, "Converts the bundles of the input folder to text files");
+
+    try {
+        cli_app.parse((argc), (argv));
+        return 0;
+    } catch(const CLI::ParseError &e) {
+        cli_app.exit(e);
+        return 1;
+    }
+}
+
+bool convert_to_bundle(const std::string& mesh_fn, const std::string& bundle_fn) {
+    reshaping::MeshAssetData asset;
+    if(!reshaping::load_mesh_asset_files(mesh_fn, asset)) {
+        LOGGER.error("Error while loading asset {}", mesh_fn);
+        return false;
+    }
+
+    return reshaping::save_mesh_bundle(bundle_fn, asset);
+}
+
+bool convert_to_text(const std::string& bundle_fn, const std::string& mesh_fn) {
+    auto bundle = reshaping::MeshBundle::open(bundle_fn);
+    if(!bundle)
+        return false;
+
+    reshaping::MeshAssetData asset;
+    bundle->to_asset_data(asset);
+
+    if(!reshaping::save_mesh_asset_files(mesh_fn, asset)) {
+        LOGGER.error("Error while saving asset {}", mesh_fn);
+        return false;
+    }
+
+    LOGGER.info("Asset saved to {}", mesh_fn);
+    return true;
+}
+
+int main(const int argc, const char** argv) {
+    namespace fs = std::filesystem;
+
+    setup_logger();
+
+    CLIArgs cli_args;
+    if(parse_command_args(argc, argv, cli_args) != 0)
+        return 1;
+
+    const fs::path input(cli_args.input);
+    const fs::path output(cli_args.output);
+
+    if(output.has_parent_path())
+        fs::create_directories(output.parent_path());
+
+    // Single asset
+    if(!fs::is_directory(input)) {
+        const bool to_text = input.extension() == reshaping::MESH_BUNDLE_EXT;
+        const bool succ    = to_text ? convert_to_text(input.string(), output.string())
+                                     : convert_to_bundle(input.string(), output.string());
+
+        return succ ? 0 : 1;
+    }
+
+    // Every asset of the input folder
+    fs::create_directories(output);
+
+    const std::string input_ext = cli_args.to_text ? reshaping::MESH_BUNDLE_EXT : ".obj";
+    const std::string output_ext = cli_args.to_text ? ".obj" : reshaping::MESH_BUNDLE_EXT;
+
+    ca_essentials::core::Timer timer;
+    timer.start("convert");
+
+    int num_assets = 0;
+    int num_converted = 0;
+    for(const auto& entry : fs::directory_iterator(input)) {
+        if(!entry.is_regular_file() || entry.path().extension() != input_ext)
+            continue;
+
+        fs::path out_fn = output / entry.path().filename();
+        out_fn.replace_extension(output_ext);
+
+        num_assets++;
+        const bool succ = cli_args.to_text ? convert_to_text(entry.path().string(), out_fn.string())
+                                           : convert_to_bundle(entry.path().string(), out_fn.string());
+        if(succ)
+            num_converted++;
+    }
+
+    LOGGER.info("{} of {} assets converted ({:.2f} s)",
+                num_converted, num_assets, timer.elapsed("convert") / 1000.0);
+
+    return num_converted == num_assets ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * Benchmarks the OBJ reader and writer of ca_essentials::io against libigl's on every mesh of a folder.
+ *
+ * Usage:
+ *      obj_io_benchmark.exe [-i <models_folder>] [-n <num_runs>] [-t <temp_folder>]
+ *
+ *      Every mesh is read and written num_runs times with each implementation. The median times are
+ *      reported, together with a check that both readers load the same vertices and faces.
+ */
+#include <ca_essentials/core/logger.h>
+#include <ca_essentials/io/obj_io.h>
+
+#include <igl/readOBJ.h>
+#include <igl/writeOBJ.h>
+
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct CLIArgs {
+    std::string models_dir = "models";
+    std::string temp_dir;
+    int num_runs = 5;
+};
+
+void setup_logger() {
+    LOGGER.set_level(spdlog::level::level_enum::info);
+}
+
+int parse_command_args(int argc, char const* argv[], CLIArgs& args) {
+    CLI::App cli_app{ argv[0] };
+
+    cli_app.allow_extras(true);
+    cli_app.add_option("-i, --input", args.models_dir, "Folder of the benchmarked meshes (.obj)");
+    cli_app.add_option("-n, --runs" , args.num_runs  , "Number of runs of every measurement");
+    cli_app.add_option("-t, --temp" , args.temp_dir  , "Folder of the written meshes (system temp folder by default)");
+
+    try {
+        cli_app.parse((argc), (argv));
+        return 0;
+    } catch(const CLI::ParseError &e) {
+        cli_app.exit(e);
+        return 1;
+    }
+}
+
+// Median time (ms) of num_runs calls of func
+template<typename Func>
+double median_time(int num_runs, const Func& func) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<double> times;
+    for(int r = 0; r < num_runs; ++r) {
+        const auto start = Clock::now();
+        func();
+        times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    return times.at(times.size() / 2);
+}
+
+int main(const int argc, const char** argv) {
+    namespace fs = std::filesystem;
+
+    setup_logger();
+
+    CLIArgs cli_args;
+    if(parse_command_args(argc, argv, cli_args) != 0)
+        return 1;
+
+    cli_args.num_runs = std::max(cli_args.num_runs, 1);
+
+    const fs::path temp_dir = cli_args.temp_dir.empty() ? fs::temp_directory_path() / "obj_io_benchmark"
+                                                        : fs::path(cli_args.temp_dir);
+    fs::create_directories(temp_dir);
+
+    std::vector<fs::path> mesh_fns;
+    for(const auto& entry : fs::directory_iterator(cli_args.models_dir))
+        if(entry.is_regular_file() && entry.path().extension() == ".obj")
+            mesh_fns.push_back(entry.path());
+    std::sort(mesh_fns.begin(), mesh_fns.end());
+
+    if(mesh_fns.empty()) {
+        LOGGER.error("No mesh found in {}", cli_args.models_dir);
+        return 1;
+    }
+
+    printf("%-28s %9s | %10s %10s %7s | %10s %10s %7s | %s\n",
+           "mesh", "faces", "igl read", "io read", "speedup", "igl write", "io write", "speedup", "same");
+
+    bool all_same = true;
+    double total_times[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for(const auto& mesh_fn : mesh_fns) {
+        Eigen::MatrixXd igl_V, io_V;
+        Eigen::MatrixXi igl_F, io_F;
+
+        const double igl_read = median_time(cli_args.num_runs, [&]() { igl::readOBJ(mesh_fn.string(), igl_V, igl_F); });
+        const double io_read  = median_time(cli_args.num_runs, [&]() { ca_essentials::io::load_obj(mesh_fn.string(), io_V, io_F); });
+
+        const std::string out_fn = (temp_dir / mesh_fn.filename()).string();
+        const double igl_write = median_time(cli_args.num_runs, [&]() { igl::writeOBJ(out_fn, igl_V, igl_F); });
+        const double io_write  = median_time(cli_args.num_runs, [&]() { ca_essentials::io::save_obj(out_fn, io_V, io_F); });
+
+        // The written file must read back the same mesh
+        Eigen::MatrixXd back_V;
+        Eigen::MatrixXi back_F;
+        igl::readOBJ(out_fn, back_V, back_F);
+        fs::remove(out_fn);
+
+        const bool same = igl_V == io_V && igl_F == io_F && back_V == io_V && back_F == io_F;
+        all_same = all_same && same;
+
+        printf("%-28s %9d | %8.2f ms %8.2f ms %6.2fx | %8.2f ms %8.2f ms %6.2fx | %s\n",
+               mesh_fn.stem().string().c_str(), (int) igl_F.rows(),
+               igl_read, io_read, igl_read / io_read,
+               igl_write, io_write, igl_write / io_write,
+               same ? "yes" : "NO");
+
+        total_times[0] += igl_read;
+        total_times[1] += io_read;
+        total_times[2] += igl_write;
+        total_times[3] += io_write;
+    }
+
+    printf("%-28s %9s | %8.2f ms %8.2f ms %6.2fx | %8.2f ms %8.2f ms %6.2fx |\n",
+           "total", "",
+           total_times[0], total_times[1], total_times[0] / total_times[1],
+           total_times[2], total_times[3], total_times[2] / total_times[3]);
+
+    return all_same ? 0 : 1;
+}
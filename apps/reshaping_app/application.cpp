@@ -793,7 +793,10 @@ void Application::perform_reshaping()
     params.handle_error_distrib_enabled = m_handle_error_distrib_on;
 
     if (globals::io::export_detailed_opt_info)
+    {
+        params.iter_history = reshaping::IterationHistory::FULL;
         params.export_objs_every_n_iter = 1;
+    }
     else
         params.export_objs_every_n_iter = 20;
 
@@ -860,7 +863,7 @@ void Application::enable_straight_render(bool val)
     m_viewer->enable_straight_render(val);
 }
 
-void Application::save_optimization_inputs(const reshaping::ReshapingData &opt_data,
+void Application::save_optimization_inputs(const reshaping::ReshapingState &opt_data,
                                            const reshaping::ReshapingParams &params)
 {
     namespace meshes = ca_essentials::meshes;
@@ -892,7 +895,7 @@ void Application::save_optimization_inputs(const reshaping::ReshapingData &opt_d
         LOGGER.error("Error while exporting edit operation (handles and fixed points) at {}", m_output_dir);
 }
 
-void Application::save_optimization_outputs(const reshaping::ReshapingData &opt_data,
+void Application::save_optimization_outputs(const reshaping::ReshapingState &opt_data,
                                             const reshaping::ReshapingParams &params)
 {
     namespace meshes = ca_essentials::meshes;
@@ -122,11 +122,11 @@ private:
     void save_screenshot();
 
     // Saving input (normalized) mesh and active edit operation to objs
-    void save_optimization_inputs(const reshaping::ReshapingData& opt_data,
+    void save_optimization_inputs(const reshaping::ReshapingState& opt_data,
                                   const reshaping::ReshapingParams& params);
 
     // Saving output reshaping solution to obj and optimization info to json.
-    void save_optimization_outputs(const reshaping::ReshapingData& opt_data,
+    void save_optimization_outputs(const reshaping::ReshapingState& opt_data,
                                    const reshaping::ReshapingParams& params);
 
     // Returns the input name as a combination of the [model-name]_[edit-label]
@@ -0,0 +1,363 @@
+/**
+ * Batch version of reshaping_demo: applies many edit operations to the same mesh in a single process.
+ *
+ * The mesh, straightness and curvature files are loaded once, and the edit-independent reshaping
+ * context is pre-computed once. The edit operations are then solved concurrently on a pool of threads,
+ * each one with its own per-edit state.
+ *
+ * Usage:
+ *      reshaping_batch.exe -i <input_mesh.obj|input_bundle.rsb> -o <output_folder> [-e <edit_label> ...] [-j <num_threads>] [--continuation]
+ *                          [--cache-dir <cache_folder>] [--archive] [--archive-bits <num_bits>] [--trace <trace.json>]
+ *                          [--energy-every <num_iters>]
+ *
+ *      If no -e <edit_label> is provided, all the edit operations available for the mesh are solved.
+ *      With --continuation, edits constraining the same vertices are solved in sweep order, each one
+ *      starting from the solution of the previous one.
+ *      If --cache-dir is provided, the mesh pre-computation is stored in (and re-loaded from) that folder.
+ *      With --archive, the output meshes are stored as variants of a single archive (<mesh_name>.rsva,
+ *      see variant_archive.h) instead of one .obj file each.
+ *      If --trace is provided, the profiled scopes of all the threads are saved as a Chrome trace
+ *      (chrome://tracing, Perfetto) and summarized in the log.
+ *      --energy-every evaluates the energy (and its termination criteria) only every num_iters iterations.
+ */
+#include <mesh_reshaping/globals.h>
+#include <mesh_reshaping/reshaping_params.h>
+#include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/reshaping_batch.h>
+#include <mesh_reshaping/reshaping_tool_io.h>
+#include <mesh_reshaping/precompute_reshaping_data.h>
+#include <mesh_reshaping/data_filenames.h>
+#include <mesh_reshaping/edit_operation.h>
+#include <mesh_reshaping/mesh_bundle.h>
+#include <mesh_reshaping/variant_archive.h>
+#include <mesh_reshaping/face_principal_curvatures_io.h>
+
+#include <ca_essentials/core/timer.h>
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/meshes/load_trimesh.h>
+
+#include <CLI/CLI.hpp>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct CLIArgs {
+    std::string input_fn;
+    std::vector<std::string> edit_labels;
+    std::string output_dir;
+    std::string cache_dir;
+    std::string trace_fn;
+
+    int max_iters  = 100;
+    int num_threads = 0;
+    bool continuation = false;
+    bool archive = false;
+    int archive_bits = reshaping::VariantArchiveParams().quantization_bits;
+    int energy_every_n_iters = 1;
+    bool handle_error_distrib_on = true;
+};
+
+void setup_logger() {
+    LOGGER.set_level(spdlog::level::level_enum::info);
+}
+
+int parse_command_args(int argc, char const* argv[], CLIArgs& args) {
+    CLI::App cli_app{ argv[0] };
+
+    cli_app.allow_extras(true);
+    cli_app.add_option("-i, --input"  , args.input_fn   , "Input mesh filename (.obj) or mesh bundle (.rsb)")->required();
+    cli_app.add_option("-o, --output" , args.output_dir , "Output folder")->required();
+    cli_app.add_option("-e, --edit"   , args.edit_labels, "Edit labels to be solved. If no value is provided, "
+                                                          "all the available edit operations are solved.");
+    cli_app.add_option("-j, --threads", args.num_threads, "Number of worker threads (0 uses all hardware threads)");
+    cli_app.add_flag("--continuation"  , args.continuation, "Warm-starts every edit of a parametric sweep from "
+                                                            "the solution of the previous one");
+    cli_app.add_option("--cache-dir"   , args.cache_dir   , "Folder of the persistent pre-computation cache");
+    cli_app.add_flag("--archive"       , args.archive     , "Stores the output meshes in a single variant archive");
+    cli_app.add_option("--archive-bits", args.archive_bits, "Quantization bits of the archived vertex displacements");
+    cli_app.add_option("--trace"       , args.trace_fn    , "Chrome trace file (.json) of the profiled scopes");
+    cli_app.add_option("--energy-every", args.energy_every_n_iters, "Evaluates the energy every n iterations only");
+
+    try {
+        cli_app.parse((argc), (argv));
+        return 0;
+    } catch(const CLI::ParseError &e) {
+        cli_app.exit(e);
+        return 1;
+    }
+}
+
+// Selects the edit operations to be solved (all the available ones if no label is given)
+std::vector<reshaping::EditOperation>
+select_edit_operations(std::vector<reshaping::EditOperation> edit_ops,
+                       const std::vector<std::string>& labels,
+                       const std::string& op_fn) {
+    if(labels.empty())
+        return edit_ops;
+
+    std::vector<reshaping::EditOperation> sel_edit_ops;
+    for(const auto& label : labels) {
+        auto itr = std::find_if(edit_ops.begin(), edit_ops.end(),
+                                [&label](const auto& op) { return op.label == label; });
+
+        if(itr == edit_ops.end())
+            LOGGER.warn("Could not find edit operation \"{}\" in \"{}\"", label, op_fn);
+        else
+            sel_edit_ops.push_back(*itr);
+    }
+
+    return sel_edit_ops;
+}
+
+// Loads the edit operations to be solved (all the available ones if no label is given)
+std::vector<reshaping::EditOperation>
+load_edit_operations(const std::string& mesh_fn,
+                     const std::vector<std::string>& labels) {
+    const std::string op_fn = reshaping::get_edit_operation_fn(mesh_fn);
+
+    std::vector<reshaping::EditOperation> edit_ops;
+    if(!reshaping::load_edit_operations_from_json(op_fn, edit_ops)) {
+        LOGGER.error("Error while loading edit operations from \"{}\"", op_fn);
+        return {};
+    }
+
+    return select_edit_operations(std::move(edit_ops), labels, op_fn);
+}
+
+std::unique_ptr<reshaping::StraightChains>
+load_straightness_info(const std::string& mesh_fn) {
+    namespace fs = std::filesystem;
+
+    std::string fn = reshaping::get_straightness_fn(mesh_fn);
+    if(!fs::exists(fn)) {
+        LOGGER.warn("Could not find straightness file {}", fn);
+        return nullptr;
+    }
+
+    auto straight_info = std::make_unique<reshaping::StraightChains>();
+    if(!straight_info->load_from_file(fn)) {
+        LOGGER.warn("Error while loading straightness information from {}", fn);
+        return nullptr;
+    }
+    else
+        return straight_info;
+}
+
+void load_principal_curvature_values(const std::string& mesh_fn,
+                                     Eigen::VectorXd& face_k1,
+                                     Eigen::VectorXd& face_k2) {
+    namespace fs = std::filesystem;
+
+    std::string fn = reshaping::get_curvature_fn(mesh_fn);
+    if(!fs::exists(fn)) {
+        LOGGER.error("Could not find curvature file at {}", fn);
+        return;
+    }
+
+    bool succ = reshaping::load_face_principal_curvature_values(fn,
+                                                                face_k1,
+                                                                face_k2);
+    if(!succ)
+        LOGGER.error("Error while loading face curvature information from {}", fn);
+}
+
+// Converts the handle displacements of an edit operation into target positions
+reshaping::EditConstraints
+edit_operation_to_constraints(const reshaping::TriMesh& mesh,
+                              const reshaping::EditOperation& edit_op) {
+    const double diag_len = mesh.get_bbox().diagonal().norm();
+
+    reshaping::EditConstraints bc;
+    for(const auto& [vid, disp] : edit_op.displacements) {
+        const Eigen::Vector3d& orig_pos = mesh.get_vertices().row(vid);
+        bc.insert({ vid, reshaping::displacement_to_abs_position(orig_pos, disp, diag_len) });
+    }
+
+    return bc;
+}
+
+void save_edit_outputs(const reshaping::ReshapingParams& params,
+                       const reshaping::TriMesh& mesh,
+                       const reshaping::EditOperation& edit_op,
+                       const reshaping::ReshapingState& opt_data,
+                       const std::string& output_dir,
+                       const std::string& run_name,
+                       reshaping::VariantArchiveWriter* archive) {
+    // Exporting handles and fixed points
+    if(!reshaping::save_edit_operation_to_obj(edit_op,
+                                              mesh.get_vertices(),
+                                              mesh.get_facets(),
+                                              output_dir,
+                                              run_name)) {
+        LOGGER.error("Error while exporting edit operation (handles and fixed points) at {}", output_dir);
+    }
+
+    // Saving output mesh
+    if(archive) {
+        if(!archive->add_variant(edit_op.label, opt_data.curr_vertices))
+            LOGGER.error("Error while archiving reshaping output mesh {}", run_name);
+    }
+    else if(!reshaping::save_mesh(opt_data.curr_vertices,
+                                  mesh.get_facets(),
+                                  output_dir,
+                                  run_name,
+                                  "output")) {
+        LOGGER.error("Error while exporting reshaping output mesh at {}", output_dir);
+    }
+
+    // Saving optimization info to json
+    if(!reshaping::save_optimization_info_to_json(mesh,
+                                                  opt_data,
+                                                  params,
+                                                  output_dir,
+                                                  run_name)) {
+        LOGGER.error("Error while exporting optimization info at {}", output_dir);
+    }
+}
+
+int main(const int argc, const char** argv) {
+    namespace fs = std::filesystem;
+    namespace meshes = ca_essentials::meshes;
+
+    setup_logger();
+
+    CLIArgs cli_args;
+    if(parse_command_args(argc, argv, cli_args) != 0)
+        return 1;
+
+    const std::string& mesh_fn = cli_args.input_fn;
+    const std::string mesh_name = fs::path(mesh_fn).stem().string();
+
+    if(!fs::is_directory(cli_args.output_dir))
+        fs::create_directories(cli_args.output_dir);
+
+    LOGGER.info("Slippage-Preserving Reshaping (batch)");
+
+    if(!cli_args.trace_fn.empty())
+        ca_essentials::core::Profiler::set_enabled(true);
+
+    ca_essentials::core::Timer timer;
+    timer.start("batch");
+
+    // Loading mesh, edit operations, straightness, and curvature values once,
+    // either from a mesh bundle or from the asset text files
+    bool normalize_mesh = true;
+    std::unique_ptr<reshaping::TriMesh> mesh;
+    std::vector<reshaping::EditOperation> edit_ops;
+    std::unique_ptr<reshaping::StraightChains> straight_info;
+    Eigen::VectorXd PV1, PV2;
+
+    if(fs::path(mesh_fn).extension() == reshaping::MESH_BUNDLE_EXT) {
+        auto bundle = reshaping::MeshBundle::open(mesh_fn);
+        if(!bundle)
+            return 1;
+
+        mesh = reshaping::load_trimesh_from_bundle(*bundle, normalize_mesh);
+
+        std::vector<reshaping::EditOperation> all_edit_ops;
+        for(int i = 0; i < bundle->num_edit_operations(); ++i)
+            all_edit_ops.push_back(bundle->edit_operation(i));
+        edit_ops = select_edit_operations(std::move(all_edit_ops), cli_args.edit_labels, mesh_fn);
+
+        if(bundle->num_chains() > 0)
+            straight_info = std::make_unique<reshaping::StraightChains>(bundle->straight_chains());
+
+        PV1 = bundle->face_k1();
+        PV2 = bundle->face_k2();
+    }
+    else {
+        mesh = meshes::load_trimesh(mesh_fn, normalize_mesh);
+        if(!mesh) {
+            LOGGER.error("Could not load model {}", mesh_fn);
+            return 1;
+        }
+
+        edit_ops = load_edit_operations(mesh_fn, cli_args.edit_labels);
+        straight_info = load_straightness_info(mesh_fn);
+        load_principal_curvature_values(mesh_fn, PV1, PV2);
+    }
+
+    if(edit_ops.empty()) {
+        LOGGER.error("No edit operation to be solved");
+        return 1;
+    }
+
+    if(!reshaping::save_mesh(mesh->get_vertices(), mesh->get_facets(),
+                             cli_args.output_dir, mesh_name, "input")) {
+        LOGGER.error("Error while saving normalized input mesh to {}", cli_args.output_dir);
+    }
+
+    // Setting up reshaping parameters
+    reshaping::ReshapingParams params;
+    params.max_iters    = cli_args.max_iters;
+    params.handle_error_distrib_enabled = cli_args.handle_error_distrib_on;
+    params.compute_energy_every_n_iters = cli_args.energy_every_n_iters;
+
+    // Edits are solved concurrently, so each one assembles its systems (and sums
+    // its energy) serially
+    params.vertex_sol.parallel_assembly = false;
+    params.transf_sol.parallel_assembly = false;
+    params.parallel_energy = false;
+
+    // Pre-computing the edit-independent reshaping data once
+    std::unique_ptr<reshaping::PrecomputeDiskCache> disk_cache;
+    if(!cli_args.cache_dir.empty())
+        disk_cache = std::make_unique<reshaping::PrecomputeDiskCache>(cli_args.cache_dir);
+
+    auto context = reshaping::precompute_reshaping_context(params,
+                                                           *mesh,
+                                                           PV1,
+                                                           PV2,
+                                                           straight_info.get(),
+                                                           nullptr,
+                                                           disk_cache.get());
+
+    // Output meshes are displacements of the normalized input mesh
+    std::unique_ptr<reshaping::VariantArchiveWriter> archive;
+    if(cli_args.archive) {
+        reshaping::VariantArchiveParams archive_params;
+        archive_params.quantization_bits = cli_args.archive_bits;
+
+        const fs::path archive_fn = fs::path(cli_args.output_dir) / (mesh_name + reshaping::VARIANT_ARCHIVE_EXT);
+        archive = reshaping::VariantArchiveWriter::create(archive_fn.string(),
+                                                          mesh->get_vertices(),
+                                                          mesh->get_facets(),
+                                                          archive_params);
+        if(!archive)
+            return 1;
+    }
+
+    std::vector<reshaping::EditConstraints> edits;
+    for(const auto& edit_op : edit_ops)
+        edits.push_back(edit_operation_to_constraints(*mesh, edit_op));
+
+    reshaping::BatchParams batch_params;
+    batch_params.num_threads  = cli_args.num_threads;
+    batch_params.continuation = cli_args.continuation;
+
+    int num_solved = reshaping::reshaping_solve_batch(
+        params,
+        context,
+        edits,
+        batch_params,
+        [&](int i, reshaping::ReshapingState& data) {
+            const std::string run_name = mesh_name + "_" + edit_ops.at(i).label;
+            save_edit_outputs(params, *mesh, edit_ops.at(i), data, cli_args.output_dir, run_name, archive.get());
+        });
+
+    if(archive && !archive->close())
+        return 1;
+
+    LOGGER.info("{} of {} edit operations solved ({:.2f} s)",
+                num_solved, edits.size(), timer.elapsed("batch") / 1000.0);
+
+    if(!cli_args.trace_fn.empty()) {
+        ca_essentials::core::Profiler::log_summary();
+        if(!ca_essentials::core::Profiler::save_chrome_trace(cli_args.trace_fn)) {
+            LOGGER.error("Error while saving the trace to {}", cli_args.trace_fn);
+            return 1;
+        }
+    }
+
+    return num_solved == (int) edits.size() ? 0 : 1;
+}
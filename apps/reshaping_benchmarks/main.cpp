@@ -0,0 +1,510 @@
+/**
+ * Benchmark suite of the reshaping solver over the bundled models and their edit operations.
+ *
+ * Usage:
+ *      reshaping_benchmarks.exe [-d <models_folder> ...] [-m <mesh_name> ...] [-e <edit_label> ...] [-n <num_runs>]
+ *                               [-p <percentile>] [--max-iters <num_iters>] [-o <report.json>] [-v]
+ *      reshaping_benchmarks.exe --compare <base_report.json> <new_report.json> [--threshold <rel_change>]
+ *                               [--min-change <ms>]
+ *
+ *      Every mesh (.obj) found in the models folders (models/ and processed_models/ by default, searched
+ *      recursively) is solved once for every edit operation of its .deform file, num_runs times. Meshes
+ *      without edit operations are skipped. -m and -e restrict the benchmark to the given meshes and labels.
+ *
+ *      The median, minimum, maximum and given percentile of the solve wall time (state creation and solve,
+ *      without pre-computation and outputs) are reported per edit, together with the number of iterations
+ *      and the termination type. Per mesh, the pre-computation time and the peak resident memory of the
+ *      process after its edits are reported (a running maximum, as meshes are solved in the same process).
+ *      Results are printed as a table and saved as a JSON report.
+ *
+ *      With --compare, two reports are diffed edit by edit and the edits whose median time increased by more
+ *      than the threshold (relative) and --min-change (absolute) are flagged as regressions. The exit code is
+ *      1 if any regression is found.
+ */
+#include <mesh_reshaping/globals.h>
+#include <mesh_reshaping/reshaping_params.h>
+#include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/reshaping_tool.h>
+#include <mesh_reshaping/precompute_reshaping_data.h>
+#include <mesh_reshaping/data_filenames.h>
+#include <mesh_reshaping/edit_operation.h>
+#include <mesh_reshaping/face_principal_curvatures_io.h>
+
+#include <ca_essentials/core/timer.h>
+#include <ca_essentials/core/memory_usage.h>
+#include <ca_essentials/meshes/load_trimesh.h>
+
+#include <nlohmann/json.hpp>
+
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+
+struct CLIArgs {
+    std::vector<std::string> models_dirs = { "models", "processed_models" };
+    std::vector<std::string> mesh_names;
+    std::vector<std::string> edit_labels;
+    std::string output_fn = "reshaping_benchmarks.json";
+
+    int num_runs  = 3;
+    int max_iters = 100;
+    double percentile = 90.0;
+    bool verbose = false;
+
+    // Compare mode
+    std::vector<std::string> compare_fns;
+    double threshold  = 0.10;
+    double min_change = 5.0;
+};
+
+// Benchmark of one edit operation
+struct EditResult {
+    std::string mesh_name;
+    std::string label;
+
+    int num_verts = 0;
+    int num_tris  = 0;
+
+    // Wall time (ms) of every run
+    std::vector<double> times;
+
+    int num_iters = 0;
+    std::string termination;
+    double energy = 0.0;
+};
+
+// Benchmark of one mesh (all its edit operations)
+struct MeshResult {
+    std::string mesh_name;
+    std::string mesh_fn;
+
+    int num_edits = 0;
+    double precompute_time = 0.0;
+
+    // Peak resident memory while benchmarking this mesh, or of the whole process
+    // so far if it cannot be reset between meshes (see reset_peak_resident_memory)
+    double peak_rss_mb = 0.0;
+    bool peak_rss_per_mesh = false;
+};
+
+void setup_logger(bool verbose) {
+    LOGGER.set_level(verbose ? spdlog::level::level_enum::info : spdlog::level::level_enum::warn);
+}
+
+int parse_command_args(int argc, char const* argv[], CLIArgs& args) {
+    CLI::App cli_app{ argv[0] };
+
+    cli_app.allow_extras(true);
+    cli_app.add_option("-d, --models-dir", args.models_dirs, "Folders searched (recursively) for meshes (.obj)");
+    cli_app.add_option("-m, --mesh"      , args.mesh_names , "Names of the benchmarked meshes (all by default)");
+    cli_app.add_option("-e, --edit"      , args.edit_labels, "Labels of the benchmarked edit operations (all by default)");
+    cli_app.add_option("-n, --runs"      , args.num_runs   , "Number of runs of every edit operation");
+    cli_app.add_option("-p, --percentile", args.percentile , "Reported percentile of the run times");
+    cli_app.add_option("--max-iters"     , args.max_iters  , "Maximum number of solver iterations");
+    cli_app.add_option("-o, --output"    , args.output_fn  , "JSON report");
+    cli_app.add_flag("-v, --verbose"     , args.verbose    , "Keeps the solver log");
+    cli_app.add_option("--compare"       , args.compare_fns, "Compares two JSON reports (base, new)")->expected(2);
+    cli_app.add_option("--threshold"     , args.threshold  , "Relative increase of the median time flagged as regression");
+    cli_app.add_option("--min-change"    , args.min_change , "Minimum increase (ms) of the median time flagged as regression");
+
+    try {
+        cli_app.parse((argc), (argv));
+        return 0;
+    } catch(const CLI::ParseError &e) {
+        cli_app.exit(e);
+        return 1;
+    }
+}
+
+// Percentile q (in [0, 100]) of times, interpolating between the closest ranks
+double percentile(std::vector<double> times, double q) {
+    if(times.empty())
+        return 0.0;
+
+    std::sort(times.begin(), times.end());
+
+    const double rank = std::clamp(q, 0.0, 100.0) / 100.0 * (times.size() - 1);
+    const size_t lo = (size_t) rank;
+    const size_t hi = std::min(lo + 1, times.size() - 1);
+
+    return times.at(lo) + (rank - lo) * (times.at(hi) - times.at(lo));
+}
+
+// Meshes (.obj) of the given folders, sorted by path
+std::vector<std::filesystem::path> find_meshes(const std::vector<std::string>& models_dirs,
+                                               const std::vector<std::string>& mesh_names) {
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> mesh_fns;
+    for(const auto& dir : models_dirs) {
+        if(!fs::is_directory(dir)) {
+            LOGGER.warn("Could not find models folder {}", dir);
+            continue;
+        }
+
+        for(const auto& entry : fs::recursive_directory_iterator(dir)) {
+            if(!entry.is_regular_file() || entry.path().extension() != ".obj")
+                continue;
+
+            const std::string name = entry.path().stem().string();
+            if(mesh_names.empty() ||
+               std::find(mesh_names.begin(), mesh_names.end(), name) != mesh_names.end())
+                mesh_fns.push_back(entry.path());
+        }
+    }
+
+    std::sort(mesh_fns.begin(), mesh_fns.end());
+    return mesh_fns;
+}
+
+// Loads the edit operations with the given labels (all the available ones if none
+// is given). Returns an empty vector if the mesh has no edit operation file.
+std::vector<reshaping::EditOperation>
+load_edit_operations(const std::string& mesh_fn,
+                     const std::vector<std::string>& labels) {
+    namespace fs = std::filesystem;
+
+    const std::string op_fn = reshaping::get_edit_operation_fn(mesh_fn);
+    if(!fs::exists(op_fn))
+        return {};
+
+    std::vector<reshaping::EditOperation> edit_ops;
+    if(!reshaping::load_edit_operations_from_json(op_fn, edit_ops)) {
+        LOGGER.error("Error while loading edit operations from \"{}\"", op_fn);
+        return {};
+    }
+
+    if(!labels.empty()) {
+        auto not_selected = [&labels](const auto& op) {
+            return std::find(labels.begin(), labels.end(), op.label) == labels.end();
+        };
+        edit_ops.erase(std::remove_if(edit_ops.begin(), edit_ops.end(), not_selected), edit_ops.end());
+    }
+
+    return edit_ops;
+}
+
+std::unique_ptr<reshaping::StraightChains>
+load_straightness_info(const std::string& mesh_fn) {
+    namespace fs = std::filesystem;
+
+    std::string fn = reshaping::get_straightness_fn(mesh_fn);
+    if(!fs::exists(fn))
+        return nullptr;
+
+    auto straight_info = std::make_unique<reshaping::StraightChains>();
+    if(!straight_info->load_from_file(fn)) {
+        LOGGER.warn("Error while loading straightness information from {}", fn);
+        return nullptr;
+    }
+    else
+        return straight_info;
+}
+
+void load_principal_curvature_values(const std::string& mesh_fn,
+                                     Eigen::VectorXd& face_k1,
+                                     Eigen::VectorXd& face_k2) {
+    namespace fs = std::filesystem;
+
+    std::string fn = reshaping::get_curvature_fn(mesh_fn);
+    if(!fs::exists(fn)) {
+        LOGGER.error("Could not find curvature file at {}", fn);
+        return;
+    }
+
+    if(!reshaping::load_face_principal_curvature_values(fn, face_k1, face_k2))
+        LOGGER.error("Error while loading face curvature information from {}", fn);
+}
+
+// Solves an edit operation num_runs times from the same pre-computed context
+EditResult benchmark_edit(const reshaping::ReshapingParams& params,
+                          const std::shared_ptr<const reshaping::ReshapingContext>& context,
+                          const reshaping::TriMesh& mesh,
+                          const reshaping::EditOperation& edit_op,
+                          int num_runs) {
+    EditResult res;
+    res.label     = edit_op.label;
+    res.num_verts = mesh.get_num_vertices();
+    res.num_tris  = mesh.get_num_facets();
+
+    const double diag_len = mesh.get_bbox().diagonal().norm();
+
+    for(int r = 0; r < num_runs; ++r) {
+        ca_essentials::core::Timer timer;
+        timer.start("solve");
+
+        auto data = reshaping::make_reshaping_state(params, context, {});
+        for(const auto& [vid, disp] : edit_op.displacements) {
+            const Eigen::Vector3d& orig_pos = mesh.get_vertices().row(vid);
+            data->bc.insert({ vid, reshaping::displacement_to_abs_position(orig_pos, disp, diag_len) });
+        }
+
+        reshaping::reshaping_solve(params, *data);
+        res.times.push_back(timer.elapsed("solve"));
+
+        res.num_iters   = (int) data->iter_energy_costs.size();
+        res.termination = data->termination_type.to_string();
+        res.energy      = data->iter_energy_costs.back().total_cost;
+    }
+
+    return res;
+}
+
+void print_table_header(double q) {
+    printf("%-28s %-16s %8s | %10s %10s %10s %10s | %5s | %s\n",
+           "mesh", "edit", "faces", "median", ("p" + std::to_string((int) q)).c_str(), "min", "max",
+           "iters", "termination");
+}
+
+void print_table_row(const EditResult& res, double q) {
+    printf("%-28s %-16s %8d | %7.1f ms %7.1f ms %7.1f ms %7.1f ms | %5d | %s\n",
+           res.mesh_name.c_str(), res.label.c_str(), res.num_tris,
+           percentile(res.times, 50.0), percentile(res.times, q),
+           *std::min_element(res.times.begin(), res.times.end()),
+           *std::max_element(res.times.begin(), res.times.end()),
+           res.num_iters, res.termination.c_str());
+}
+
+bool save_report(const std::string& fn,
+                 const CLIArgs& args,
+                 const std::vector<MeshResult>& meshes,
+                 const std::vector<EditResult>& edits) {
+    using json = nlohmann::json;
+
+    json report;
+    report["num_runs"]   = args.num_runs;
+    report["max_iters"]  = args.max_iters;
+    report["percentile"] = args.percentile;
+
+    report["meshes"] = json::array();
+    for(const auto& m : meshes) {
+        report["meshes"].push_back({
+            {"mesh"           , m.mesh_name},
+            {"filename"       , m.mesh_fn},
+            {"num_edits"      , m.num_edits},
+            {"precompute_time", m.precompute_time},
+            {m.peak_rss_per_mesh ? "peak_rss_mb" : "process_peak_rss_mb", m.peak_rss_mb},
+        });
+    }
+
+    report["edits"] = json::array();
+    for(const auto& e : edits) {
+        report["edits"].push_back({
+            {"mesh"           , e.mesh_name},
+            {"edit"           , e.label},
+            {"num_verts"      , e.num_verts},
+            {"num_tris"       , e.num_tris},
+            {"times"          , e.times},
+            {"median_time"    , percentile(e.times, 50.0)},
+            {"percentile_time", percentile(e.times, args.percentile)},
+            {"min_time"       , *std::min_element(e.times.begin(), e.times.end())},
+            {"max_time"       , *std::max_element(e.times.begin(), e.times.end())},
+            {"num_iters"      , e.num_iters},
+            {"termination"    , e.termination},
+            {"total_energy"   , e.energy},
+        });
+    }
+
+    std::ofstream out_f(fn);
+    if(!out_f)
+        return false;
+
+    out_f << std::setw(4) << report << std::endl;
+    return (bool) out_f;
+}
+
+bool load_report(const std::string& fn, nlohmann::json& report) {
+    std::ifstream in_f(fn);
+    if(!in_f) {
+        LOGGER.error("Could not open report {}", fn);
+        return false;
+    }
+
+    try {
+        in_f >> report;
+    } catch(const nlohmann::json::exception& e) {
+        LOGGER.error("Error while parsing report {}: {}", fn, e.what());
+        return false;
+    }
+
+    if(!report.contains("edits")) {
+        LOGGER.error("Invalid report {}", fn);
+        return false;
+    }
+
+    return true;
+}
+
+// Diffs the median times of two reports. Returns the number of regressions, or -1
+// if a report cannot be loaded.
+int compare_reports(const std::string& base_fn,
+                    const std::string& new_fn,
+                    double threshold,
+                    double min_change) {
+    nlohmann::json base_report, new_report;
+    if(!load_report(base_fn, base_report) || !load_report(new_fn, new_report))
+        return -1;
+
+    std::map<std::pair<std::string, std::string>, const nlohmann::json*> base_edits;
+    for(const auto& e : base_report["edits"])
+        base_edits[{ e["mesh"].get<std::string>(), e["edit"].get<std::string>() }] = &e;
+
+    printf("%-28s %-16s | %10s %10s %8s | %11s | %s\n",
+           "mesh", "edit", "base", "new", "change", "iters", "status");
+
+    int num_regressions = 0;
+    for(const auto& e : new_report["edits"]) {
+        const std::string mesh_name = e["mesh"];
+        const std::string label     = e["edit"];
+
+        auto itr = base_edits.find({ mesh_name, label });
+        if(itr == base_edits.end()) {
+            printf("%-28s %-16s | %10s %7.1f ms %8s | %11s | new\n",
+                   mesh_name.c_str(), label.c_str(), "", e["median_time"].get<double>(), "", "");
+            continue;
+        }
+
+        const nlohmann::json& b = *itr->second;
+        base_edits.erase(itr);
+
+        const double base_time = b["median_time"];
+        const double new_time  = e["median_time"];
+        const double change    = base_time > 0.0 ? new_time / base_time - 1.0 : 0.0;
+
+        const bool regression = change > threshold && new_time - base_time > min_change;
+        const bool improvement = -change > threshold && base_time - new_time > min_change;
+        num_regressions += regression ? 1 : 0;
+
+        const int base_iters = b["num_iters"];
+        const int new_iters  = e["num_iters"];
+
+        std::string status = regression ? "REGRESSION" : (improvement ? "improved" : "ok");
+        if(base_iters != new_iters || b["termination"] != e["termination"])
+            status += " (convergence changed)";
+
+        printf("%-28s %-16s | %7.1f ms %7.1f ms %+7.1f%% | %4d -> %4d | %s\n",
+               mesh_name.c_str(), label.c_str(), base_time, new_time, change * 100.0,
+               base_iters, new_iters, status.c_str());
+    }
+
+    for(const auto& [key, b] : base_edits)
+        printf("%-28s %-16s | %7.1f ms %10s %8s | %11s | missing\n",
+               key.first.c_str(), key.second.c_str(), (*b)["median_time"].get<double>(), "", "", "");
+
+    printf("%d regressions (threshold %.1f%%, min. change %.1f ms)\n",
+           num_regressions, threshold * 100.0, min_change);
+
+    return num_regressions;
+}
+
+int main(const int argc, const char** argv) {
+    namespace fs = std::filesystem;
+    namespace meshes = ca_essentials::meshes;
+
+    CLIArgs cli_args;
+    if(parse_command_args(argc, argv, cli_args) != 0)
+        return 1;
+
+    setup_logger(cli_args.verbose);
+
+    if(!cli_args.compare_fns.empty()) {
+        const int num_regressions = compare_reports(cli_args.compare_fns.at(0),
+                                                    cli_args.compare_fns.at(1),
+                                                    cli_args.threshold,
+                                                    cli_args.min_change);
+        return num_regressions == 0 ? 0 : 1;
+    }
+
+    cli_args.num_runs = std::max(cli_args.num_runs, 1);
+
+    const std::vector<fs::path> mesh_fns = find_meshes(cli_args.models_dirs, cli_args.mesh_names);
+    if(mesh_fns.empty()) {
+        LOGGER.error("No mesh found");
+        return 1;
+    }
+
+    reshaping::ReshapingParams params;
+    params.max_iters = cli_args.max_iters;
+
+    std::vector<MeshResult> mesh_results;
+    std::vector<EditResult> edit_results;
+
+    print_table_header(cli_args.percentile);
+
+    bool peak_rss_per_mesh = true;
+    for(const auto& mesh_fn : mesh_fns) {
+        const std::string mesh_name = mesh_fn.stem().string();
+
+        // Memory retained by the allocator after the previous meshes still counts
+        peak_rss_per_mesh = peak_rss_per_mesh && ca_essentials::core::reset_peak_resident_memory();
+
+        std::vector<reshaping::EditOperation> edit_ops = load_edit_operations(mesh_fn.string(),
+                                                                              cli_args.edit_labels);
+        if(edit_ops.empty()) {
+            printf("%-28s (no edit operations, skipped)\n", mesh_name.c_str());
+            continue;
+        }
+
+        bool normalize_mesh = true;
+        auto mesh = meshes::load_trimesh(mesh_fn.string(), normalize_mesh);
+        if(!mesh) {
+            LOGGER.error("Could not load model {}", mesh_fn.string());
+            continue;
+        }
+
+        auto straight_info = load_straightness_info(mesh_fn.string());
+        Eigen::VectorXd PV1, PV2;
+        load_principal_curvature_values(mesh_fn.string(), PV1, PV2);
+
+        params.input_name = mesh_name;
+        auto context = reshaping::precompute_reshaping_context(params,
+                                                               *mesh,
+                                                               PV1,
+                                                               PV2,
+                                                               straight_info.get());
+
+        for(const auto& edit_op : edit_ops) {
+            EditResult res = benchmark_edit(params, context, *mesh, edit_op, cli_args.num_runs);
+            res.mesh_name = mesh_name;
+
+            print_table_row(res, cli_args.percentile);
+            fflush(stdout);
+
+            edit_results.push_back(std::move(res));
+        }
+
+        MeshResult mesh_res;
+        mesh_res.mesh_name       = mesh_name;
+        mesh_res.mesh_fn         = mesh_fn.generic_string();
+        mesh_res.num_edits       = (int) edit_ops.size();
+        mesh_res.precompute_time = context->precompute_time;
+        mesh_res.peak_rss_mb     = ca_essentials::core::get_peak_resident_memory() / (1024.0 * 1024.0);
+        mesh_res.peak_rss_per_mesh = peak_rss_per_mesh;
+        mesh_results.push_back(mesh_res);
+    }
+
+    if(!peak_rss_per_mesh)
+        LOGGER.warn("Peak memory cannot be measured per mesh on this platform. "
+                    "The process-wide peak is reported instead");
+
+    printf("\n%-28s %8s %14s %12s\n", "mesh", "edits", "precompute",
+           peak_rss_per_mesh ? "peak RSS" : "process RSS");
+    for(const auto& m : mesh_results)
+        printf("%-28s %8d %11.1f ms %9.1f MB\n",
+               m.mesh_name.c_str(), m.num_edits, m.precompute_time, m.peak_rss_mb);
+
+    if(!save_report(cli_args.output_fn, cli_args, mesh_results, edit_results)) {
+        LOGGER.error("Error while saving the report to {}", cli_args.output_fn);
+        return 1;
+    }
+
+    printf("Report saved to %s\n", cli_args.output_fn.c_str());
+
+    return 0;
+}
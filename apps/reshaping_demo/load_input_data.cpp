@@ -2,6 +2,7 @@
 
 #include <mesh_reshaping/data_filenames.h>
 #include <mesh_reshaping/face_principal_curvatures_io.h>
+#include <mesh_reshaping/mesh_bundle.h>
 
 #include <ca_essentials/meshes/load_trimesh.h>
 
@@ -80,13 +81,62 @@ void load_principal_curvature_values(const std::string& mesh_fn,
         LOGGER.error("Error while loading face curvature information from {}", fn);
 }
 
+// Loads all the inputs from a single mesh bundle file
+InputData load_input_data_from_bundle(const std::string& bundle_fn,
+                                      const std::vector<std::string>& edit_op_labels) {
+    InputData data;
+
+    auto bundle = reshaping::MeshBundle::open(bundle_fn);
+    if(!bundle)
+        return data;
+
+    bool normalize_mesh = true;
+    data.mesh = reshaping::load_trimesh_from_bundle(*bundle, normalize_mesh);
+
+    for(const auto& edit_op_label : edit_op_labels) {
+        int op_i = 0;
+        while(op_i < bundle->num_edit_operations() && bundle->edit_label(op_i) != edit_op_label)
+            op_i++;
+
+        if(op_i == bundle->num_edit_operations()) {
+            LOGGER.error("Could not find edit operation \"{}\" in \"{}\"", edit_op_label, bundle_fn);
+            return InputData();
+        }
+
+        data.edit_ops.push_back(bundle->edit_operation(op_i));
+    }
+
+    if(bundle->num_chains() > 0)
+        data.straight_info = std::make_unique<reshaping::StraightChains>(bundle->straight_chains());
+
+    data.PV1 = bundle->face_k1();
+    data.PV2 = bundle->face_k2();
+
+    return data;
+}
+
 }
 
 InputData load_input_data(const std::string& mesh_fn,
-                          const std::string& edit_op_label) {
+                          const std::vector<std::string>& edit_op_labels) {
+    namespace fs = std::filesystem;
+
+    if(fs::path(mesh_fn).extension() == reshaping::MESH_BUNDLE_EXT)
+        return load_input_data_from_bundle(mesh_fn, edit_op_labels);
+
     InputData data;
     data.mesh = load_mesh(mesh_fn);
-    data.edit_op = load_edit_operation(mesh_fn, edit_op_label);
+    if(!data.mesh)
+        return InputData();
+
+    for(const auto& edit_op_label : edit_op_labels) {
+        auto edit_op = load_edit_operation(mesh_fn, edit_op_label);
+        if(!edit_op)
+            return InputData();
+
+        data.edit_ops.push_back(std::move(*edit_op));
+    }
+
     data.straight_info = load_straightness_info(mesh_fn);
     load_principal_curvature_values(mesh_fn, data.PV1, data.PV2);
 
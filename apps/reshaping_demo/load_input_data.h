@@ -7,15 +7,20 @@
 #include <Eigen/Core>
 
 #include <string>
+#include <vector>
 
 struct InputData {
     std::unique_ptr<reshaping::TriMesh> mesh;
     std::unique_ptr<reshaping::StraightChains> straight_info;
-    std::unique_ptr<reshaping::EditOperation> edit_op;
+
+    // Edit operations, in the order of the requested labels
+    std::vector<reshaping::EditOperation> edit_ops;
 
     // Principal curvature values
     Eigen::VectorXd PV1;
     Eigen::VectorXd PV2;
 };
+// Loads the input mesh and its data, and the edit operations with the given labels.
+// Returns an empty InputData if the mesh or any edit operation cannot be loaded.
 InputData load_input_data(const std::string& mesh_fn,
-                          const std::string& edit_op_label);
+                          const std::vector<std::string>& edit_op_labels);
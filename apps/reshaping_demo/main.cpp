@@ -5,9 +5,15 @@
  *
  *
  * Usage:
- *      reshaping_demo.exe -i <input_mesh.obj> -o <output_folder> -e <edit_label>
+ *      reshaping_demo.exe -i <input_mesh.obj|input_bundle.rsb> -o <output_folder> -e <edit_label> [-e <edit_label> ...]
+ *                         [--cache-dir <cache_folder>] [--output-queue <num_jobs>] [--trace <trace.json>]
  *
  *      If -e <edit_label> is not provided, the available edit operations will be listed.
+ *      Several edit operations are solved one after the other, and the outputs of each one are written
+ *      in the background while the next one is solved (at most --output-queue pending writes).
+ *      If --cache-dir is provided, the mesh pre-computation is stored in (and re-loaded from) that folder.
+ *      If --trace is provided, the profiled scopes are saved as a Chrome trace (chrome://tracing, Perfetto)
+ *      and summarized in the log.
  *
  * For more information, please refer to the paper and extra information available in the project website below:
  *      https://www.cs.ubc.ca/labs/imager/tr/2023/3DReshaping/
@@ -21,18 +27,26 @@
 #include <mesh_reshaping/reshaping_tool_io.h>
 #include <mesh_reshaping/precompute_reshaping_data.h>
 #include <mesh_reshaping/data_filenames.h>
+#include <mesh_reshaping/mesh_bundle.h>
+#include <mesh_reshaping/async_output_writer.h>
+
+#include <ca_essentials/core/profiler.h>
 
 #include <CLI/CLI.hpp>
 #include <filesystem>
 #include <string>
+#include <vector>
 
 struct CLIArgs {
     std::string input_fn;
-    std::string edit_label;
+    std::vector<std::string> edit_labels;
     std::string output_dir;
     std::string temp_dir;
+    std::string cache_dir;
+    std::string trace_fn;
 
     int max_iters  = 100;
+    int output_queue_size = 2;
     bool handle_error_distrib_on = true;
 };
 
@@ -60,10 +74,13 @@ int parse_command_args(int argc, char const* argv[], CLIArgs& args) {
     CLI::App cli_app{ argv[0] };
 
     cli_app.allow_extras(true);
-    cli_app.add_option("-i, --input" , args.input_fn     , "Input mesh filename (.obj)")->required();
+    cli_app.add_option("-i, --input" , args.input_fn     , "Input mesh filename (.obj) or mesh bundle (.rsb)")->required();
     cli_app.add_option("-o, --output", args.output_dir   , "Output folder")->required();
-    cli_app.add_option("-e, --edit"  , args.edit_label   , "Edit label to be loaded. If no value is provided, "
+    cli_app.add_option("-e, --edit"  , args.edit_labels  , "Edit labels to be solved. If no value is provided, "
                                                            "all the available edit operations will be listed.");
+    cli_app.add_option("--cache-dir" , args.cache_dir    , "Folder of the persistent pre-computation cache");
+    cli_app.add_option("--output-queue", args.output_queue_size, "Maximum number of pending background output writes");
+    cli_app.add_option("--trace"     , args.trace_fn     , "Chrome trace file (.json) of the profiled scopes");
 
     try {
         cli_app.parse((argc), (argv));
@@ -78,18 +95,18 @@ void print_input_args(const CLIArgs& cli_args) {
     LOGGER.info("    Input         : {}"     , cli_args.input_fn);
     LOGGER.info("    Out Dir       : {}"     , cli_args.output_dir);
     LOGGER.info("    Temp Dir      : {}"     , cli_args.temp_dir);
-    LOGGER.info("    Edit Label    : {}"     , cli_args.edit_label);
+    for(const auto& edit_label : cli_args.edit_labels)
+        LOGGER.info("    Edit Label    : {}" , edit_label);
     LOGGER.info("    Max Iters     : {}"     , cli_args.max_iters);
 
     LOGGER.info("");
 }
 
-void save_optimization_inputs(const reshaping::TriMesh& mesh,
+bool save_optimization_inputs(const reshaping::TriMesh& mesh,
                               const reshaping::EditOperation& edit_op,
                               const std::string& output_dir,
                               const std::string& run_name) {
-    namespace meshes = ca_essentials::meshes;
-    namespace fs = std::filesystem;
+    bool succ = true;
 
     // Exporting normalized input  mesh
     if(!reshaping::save_mesh(mesh.get_vertices(),
@@ -98,6 +115,7 @@ void save_optimization_inputs(const reshaping::TriMesh& mesh,
                              run_name,
                              "input")) {
         LOGGER.error("Error while saving normalized input mesh to {}", output_dir);
+        succ = false;
     }
 
     // Exporting handles and fixed points
@@ -107,22 +125,27 @@ void save_optimization_inputs(const reshaping::TriMesh& mesh,
                                               output_dir,
                                               run_name)) {
         LOGGER.error("Error while exporting edit operation (handles and fixed points) at {}", output_dir);
+        succ = false;
     }
+
+    return succ;
 }
 
-void save_optimization_outputs(const reshaping::ReshapingParams& params,
-                               const reshaping::ReshapingData& opt_data,
+bool save_optimization_outputs(const reshaping::ReshapingParams& params,
+                               const Eigen::MatrixXd& V,
+                               const reshaping::ReshapingState& opt_data,
                                const std::string& output_dir,
                                const std::string& run_name) {
-    namespace meshes = ca_essentials::meshes;
-    namespace fs = std::filesystem;
+    bool succ = true;
 
     // Saving output mesh
-    if(!reshaping::save_mesh(opt_data.mesh,
+    if(!reshaping::save_mesh(V,
+                             opt_data.mesh.get_facets(),
                              output_dir,
                              run_name,
                              "output")) {
         LOGGER.error("Error while exporting reshaping output mesh at {}", output_dir);
+        succ = false;
     }
 
     // Saving optimization info to json
@@ -131,25 +154,53 @@ void save_optimization_outputs(const reshaping::ReshapingParams& params,
                                                   params,
                                                   output_dir,
                                                   run_name)) {
-        LOGGER.info("Optimization info exported at {}", output_dir);
+        LOGGER.error("Error while exporting optimization info at {}", output_dir);
+        succ = false;
     }
+
+    return succ;
 }
 
 void list_edit_operations(const std::string& mesh_fn) {
     namespace fs = std::filesystem;
 
-    std::string op_fn = reshaping::get_edit_operation_fn(mesh_fn);
+    std::vector<std::string> labels;
+    if(fs::path(mesh_fn).extension() == reshaping::MESH_BUNDLE_EXT) {
+        auto bundle = reshaping::MeshBundle::open(mesh_fn);
+        for(int i = 0; bundle && i < bundle->num_edit_operations(); ++i)
+            labels.emplace_back(bundle->edit_label(i));
+    }
+    else {
+        std::string op_fn = reshaping::get_edit_operation_fn(mesh_fn);
+
+        std::vector<reshaping::EditOperation> edit_ops;
+        reshaping::load_edit_operations_from_json(op_fn, edit_ops);
 
-    std::vector<reshaping::EditOperation> edit_ops;
-    reshaping::load_edit_operations_from_json(op_fn, edit_ops);
+        for(const auto& op : edit_ops )
+            labels.push_back(op.label);
+    }
 
     LOGGER.info("Available edit operations for {}", fs::path(mesh_fn).stem().string());
-    for(const auto& op : edit_ops )
-        printf("    %s\n", op.label.c_str());
+    for(const auto& label : labels)
+        printf("    %s\n", label.c_str());
 
     LOGGER.info("Select one of the above edit operations and rerun reshaping_demo.exe using -e <edit_op>");
 }
 
+bool save_trace(const std::string& trace_fn) {
+    namespace core = ca_essentials::core;
+
+    core::Profiler::log_summary();
+
+    if(!core::Profiler::save_chrome_trace(trace_fn)) {
+        LOGGER.error("Error while saving the trace to {}", trace_fn);
+        return false;
+    }
+
+    LOGGER.info("Trace saved to {}", trace_fn);
+    return true;
+}
+
 int main(const int argc, const char** argv) {
     namespace fs = std::filesystem;
 
@@ -160,11 +211,10 @@ int main(const int argc, const char** argv) {
         return 1;
 
     const std::string& mesh_fn = cli_args.input_fn;
-    const std::string& edit_label = cli_args.edit_label;
-    const std::string run_name = fs::path(mesh_fn).stem().string() + "_" + edit_label;
+    const std::string mesh_name = fs::path(mesh_fn).stem().string();
 
     LOGGER.info("Slippage-Preserving Reshaping");
-    if(cli_args.edit_label.empty()) {
+    if(cli_args.edit_labels.empty()) {
         list_edit_operations(mesh_fn);
         return 0;
     }
@@ -172,56 +222,81 @@ int main(const int argc, const char** argv) {
     setup_directories(cli_args);
     print_input_args(cli_args);
 
-    // Loading mesh, edit operation, straightness, and curvature values
-    InputData in_data = load_input_data(mesh_fn, edit_label);
+    if(!cli_args.trace_fn.empty())
+        ca_essentials::core::Profiler::set_enabled(true);
+
+    // Loading mesh, edit operations, straightness, and curvature values
+    InputData in_data = load_input_data(mesh_fn, cli_args.edit_labels);
     if(!in_data.mesh)
         return 1;
 
-    // Saving input mesh and edit operation
-    save_optimization_inputs(*in_data.mesh.get(),
-                             *in_data.edit_op.get(),
-                             cli_args.output_dir,
-                             run_name);
+    const reshaping::TriMesh& mesh = *in_data.mesh;
+
+    // Outputs are written in the background. Jobs reference in_data, which outlives
+    // the writer.
+    reshaping::AsyncOutputWriter output_writer(cli_args.output_queue_size);
 
     // Setting up reshaping parameters
     reshaping::ReshapingParams params;
     params.debug_folder = cli_args.temp_dir;
-    params.input_name   = run_name;
+    params.input_name   = mesh_name + "_" + in_data.edit_ops.front().label;
     params.max_iters    = cli_args.max_iters;
     params.handle_error_distrib_enabled = cli_args.handle_error_distrib_on;
 
-    // Precomputing reshaping data
-    auto reshaping_data = reshaping::precompute_reshaping_data(
+    // Precomputing reshaping data once for all the edit operations
+    std::unique_ptr<reshaping::PrecomputeDiskCache> disk_cache;
+    if(!cli_args.cache_dir.empty())
+        disk_cache = std::make_unique<reshaping::PrecomputeDiskCache>(cli_args.cache_dir);
+
+    std::shared_ptr<const reshaping::ReshapingContext> context = reshaping::precompute_reshaping_context(
         params,
-        *in_data.mesh.get(),
+        mesh,
         in_data.PV1,
         in_data.PV2,
-        in_data.straight_info.get()
+        in_data.straight_info.get(),
+        nullptr,
+        disk_cache.get()
     );
 
-    // Defining hard constraints
-    const double diag_len = in_data.mesh->get_bbox().diagonal().norm();
+    const double diag_len = mesh.get_bbox().diagonal().norm();
 
-    for(const auto& [vid, disp] : in_data.edit_op->displacements) {
-        const Eigen::Vector3d& orig_pos  = in_data.mesh->get_vertices().row(vid);
-        const Eigen::Vector3d target_pos = reshaping::displacement_to_abs_position(orig_pos,
-                                                                                   disp,
-                                                                                   diag_len);
-        reshaping_data->bc.insert({ vid, target_pos });
-    }
+    for(const auto& edit_op : in_data.edit_ops) {
+        const std::string run_name = mesh_name + "_" + edit_op.label;
+        params.input_name = run_name;
 
-    LOGGER.debug("Starting Reshaping Tool");
-    Eigen::MatrixXd newV = reshaping::reshaping_solve(params, *reshaping_data);
+        // Saving input mesh and edit operation
+        output_writer.submit(run_name + " inputs", [&mesh, &edit_op, &cli_args, run_name]() {
+            return save_optimization_inputs(mesh, edit_op, cli_args.output_dir, run_name);
+        });
 
-    Eigen::MatrixXd V;
-    in_data.mesh->export_vertices(V);
-    V = newV;
-    in_data.mesh->import_vertices(V);
+        auto reshaping_data = reshaping::make_reshaping_state(params, context, {});
 
-    save_optimization_outputs(params,
-                              *reshaping_data,
-                              cli_args.output_dir,
-                              run_name);
+        // Defining hard constraints
+        for(const auto& [vid, disp] : edit_op.displacements) {
+            const Eigen::Vector3d& orig_pos  = mesh.get_vertices().row(vid);
+            const Eigen::Vector3d target_pos = reshaping::displacement_to_abs_position(orig_pos,
+                                                                                       disp,
+                                                                                       diag_len);
+            reshaping_data->bc.insert({ vid, target_pos });
+        }
+
+        LOGGER.debug("Starting Reshaping Tool");
+        Eigen::MatrixXd newV = reshaping::reshaping_solve(params, *reshaping_data);
+
+        // The writer takes ownership of the solution and the solve state
+        output_writer.submit(run_name + " outputs",
+            [params, &cli_args, run_name, V = std::move(newV), data = std::move(reshaping_data)]() {
+                return save_optimization_outputs(params, V, *data, cli_args.output_dir, run_name);
+            });
+    }
+
+    if(!output_writer.flush()) {
+        LOGGER.error("Some outputs could not be written to {}", cli_args.output_dir);
+        return 1;
+    }
+
+    if(!cli_args.trace_fn.empty() && !save_trace(cli_args.trace_fn))
+        return 1;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,18 @@
+if(TARGET benchmark::benchmark)
+    return()
+endif()
+
+message(STATUS "Third-party (external): creating target 'benchmark::benchmark'")
+
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+
+include(FetchContent)
+FetchContent_Declare(
+    google_benchmark
+    GIT_REPOSITORY https://github.com/google/benchmark.git
+    GIT_TAG v1.8.3
+    GIT_SHALLOW TRUE
+)
+FetchContent_MakeAvailable(google_benchmark)
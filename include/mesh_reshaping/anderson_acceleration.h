@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Eigen/Core>
+
+namespace reshaping {
+
+// Anderson acceleration of a fixed-point iteration x_{k+1} = G(x_k).
+//
+// Given g_k = G(x_k), the next iterate mixes the last (up to) history_size
+// iterates so that the linearized residual f = G(x) - x is minimized:
+//   gamma   = argmin || f_k - dF gamma ||
+//   x_{k+1} = g_k - dG gamma
+// where dF and dG store the differences of consecutive residuals and G values.
+class AndersonAcceleration {
+public:
+    // Starts a new iteration from x0
+    void init(int history_size, const Eigen::VectorXd& x0);
+
+    // Drops the history, restarting the iteration from x
+    void reset(const Eigen::VectorXd& x);
+
+    // Returns the next iterate given g = G(x_k), where x_k is the last iterate
+    // returned (or the initial one)
+    const Eigen::VectorXd& compute(const Eigen::VectorXd& g);
+
+    // Number of columns currently stored in the history
+    int history_length() const { return m_num_cols; }
+
+private:
+    int m_history_size = 0;
+    int m_num_cols = 0;
+    int m_next_col = 0;
+    bool m_has_prev = false;
+
+    Eigen::VectorXd m_x;
+    Eigen::VectorXd m_prev_f;
+    Eigen::VectorXd m_prev_g;
+
+    Eigen::MatrixXd m_dF;
+    Eigen::MatrixXd m_dG;
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace reshaping {
+
+// Runs output jobs (file writes) on a background thread, in submission order, so
+// that the outputs of a solve are written while the next one runs.
+//
+// Jobs own their data: results are moved into them (vertex buffers, finished
+// ReshapingState, ...) instead of being copied. The queue is bounded: submit()
+// blocks while max_pending_jobs are waiting (back-pressure), which also bounds the
+// memory held by pending outputs.
+class AsyncOutputWriter {
+public:
+    explicit AsyncOutputWriter(int max_pending_jobs = 2);
+
+    // Flushes the pending jobs
+    ~AsyncOutputWriter();
+
+    AsyncOutputWriter(const AsyncOutputWriter&) = delete;
+    AsyncOutputWriter& operator=(const AsyncOutputWriter&) = delete;
+
+    // Queues job, a (possibly move-only) callable returning false on failure.
+    // name identifies the job in the error report.
+    template<typename Job>
+    void submit(std::string name, Job&& job) {
+        push(std::make_unique<JobImpl<std::decay_t<Job>>>(std::move(name), std::forward<Job>(job)));
+    }
+
+    // Waits until every queued job has run. Returns false (and logs the names of
+    // the failed jobs) if any job failed since the previous flush.
+    bool flush();
+
+    int num_pending_jobs() const;
+
+private:
+    struct JobBase {
+        JobBase(std::string n) : name(std::move(n)) {}
+        virtual ~JobBase() = default;
+        virtual bool run() = 0;
+
+        std::string name;
+    };
+
+    template<typename Job>
+    struct JobImpl : JobBase {
+        JobImpl(std::string n, Job&& j) : JobBase(std::move(n)), job(std::move(j)) {}
+        JobImpl(std::string n, const Job& j) : JobBase(std::move(n)), job(j) {}
+        bool run() override { return job(); }
+
+        Job job;
+    };
+
+    void push(std::unique_ptr<JobBase> job);
+    void worker_loop();
+
+    const int m_max_pending_jobs;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_job_added;
+    std::condition_variable m_job_done;
+
+    std::deque<std::unique_ptr<JobBase>> m_jobs;
+    bool m_running_job = false;
+    bool m_stop = false;
+    std::vector<std::string> m_failed_jobs;
+
+    std::thread m_worker;
+};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace reshaping {
+
+// Sums N values over the elements [0, n), where func(i, sum) adds the values of
+// element i to sum. Elements are summed in fixed-size blocks whose partial sums
+// are then added in order, so the result does not depend on the number of
+// threads and the parallel sum is bit-identical to the serial one.
+template<int N, typename Func>
+Eigen::Matrix<double, N, 1> blocked_sum(int n, const Func& func, bool parallel) {
+    using VectorNd = Eigen::Matrix<double, N, 1>;
+
+    constexpr int BLOCK_SIZE = 1024;
+    const int num_blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    std::vector<VectorNd> block_sums(num_blocks, VectorNd::Zero());
+    auto sum_block = [&](int b) {
+        const int end = std::min(n, (b + 1) * BLOCK_SIZE);
+        for(int i = b * BLOCK_SIZE; i < end; ++i)
+            func(i, block_sums[b]);
+    };
+
+    if(parallel)
+        igl::parallel_for(num_blocks, sum_block, 2);
+    else {
+        for(int b = 0; b < num_blocks; ++b)
+            sum_block(b);
+    }
+
+    VectorNd sum = VectorNd::Zero();
+    for(const VectorNd& block_sum : block_sums)
+        sum += block_sum;
+
+    return sum;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace reshaping {
+
+// Initial value of the content hashes below
+inline constexpr uint64_t CONTENT_HASH_SEED = 14695981039346656037ull;
+
+// FNV-1a hash over a raw memory block
+inline uint64_t hash_bytes(const void* data, size_t num_bytes, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    uint64_t h = seed;
+    for(size_t i = 0; i < num_bytes; ++i) {
+        h ^= (uint64_t) bytes[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+template<typename T>
+uint64_t hash_value(const T& value, uint64_t seed) {
+    return hash_bytes(&value, sizeof(T), seed);
+}
+
+template<typename Derived>
+uint64_t hash_matrix(const Eigen::DenseBase<Derived>& M, uint64_t seed) {
+    const Eigen::Index dims[2] = { M.rows(), M.cols() };
+    seed = hash_bytes(dims, sizeof(dims), seed);
+
+    // Column-major copies keep the hash independent of the storage order
+    const Eigen::Matrix<typename Derived::Scalar, Eigen::Dynamic, Eigen::Dynamic> C = M;
+    return hash_bytes(C.data(), sizeof(typename Derived::Scalar) * C.size(), seed);
+}
+
+}
@@ -2,9 +2,6 @@
 
 #include <mesh_reshaping/types.h>
 
-// When enabled, this disables the generation and export of all debug information
-#define OPTIMIZED_VERSION_ON 1
-
 // Enables the sphericity term
 #define SPHERICITY_ON 1
 
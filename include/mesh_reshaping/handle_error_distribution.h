@@ -7,13 +7,13 @@
 #include <unordered_map>
 
 namespace reshaping {
-    struct ReshapingData;
+    struct ReshapingState;
 }
 
 namespace reshaping {
 
 void perform_handle_error_distribution(const ReshapingParams& params,
-                                       ReshapingData& data,
+                                       ReshapingState& data,
                                        Eigen::MatrixXd& V);
 
 }
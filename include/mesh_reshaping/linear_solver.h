@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Eigen/Sparse>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace reshaping {
+
+enum class LinearSolverType {
+    // Eigen::SimplicialLDLT
+    SIMPLICIAL_LDLT,
+
+    // Eigen::SimplicialLLT
+    SIMPLICIAL_LLT,
+
+    // CHOLMOD supernodal Cholesky (requires CHOLMOD at configure time;
+    // falls back to SIMPLICIAL_LDLT otherwise)
+    SUPERNODAL_CHOLESKY,
+
+    // Conjugate gradient preconditioned with an incomplete Cholesky factorization.
+    // Starts from the initial guess passed to LinearSolverBackend::solve.
+    CONJUGATE_GRADIENT
+};
+
+enum class FillReducingOrdering {
+    AMD,
+    COLAMD,
+
+    // Requires METIS at configure time (falls back to AMD otherwise)
+    NESTED_DISSECTION
+};
+
+struct LinearSolverParams {
+    LinearSolverType type = LinearSolverType::SIMPLICIAL_LDLT;
+    FillReducingOrdering ordering = FillReducingOrdering::AMD;
+
+    // Conjugate gradient only: relative residual tolerance and maximum number
+    // of iterations (0 uses twice the system size). A solve that hits the
+    // iteration limit fails.
+    double cg_tolerance = 1e-10;
+    int cg_max_iters = 0;
+};
+
+// Sparse symmetric positive-definite linear solver used by the vertex and
+// transformation solves
+class LinearSolverBackend {
+public:
+    virtual ~LinearSolverBackend() = default;
+
+    virtual std::string name() const = 0;
+
+    // True if solve() uses the initial guess it receives
+    virtual bool is_iterative() const { return false; }
+
+    // Symbolic analysis. Must be performed again whenever the sparsity pattern changes.
+    virtual bool analyze_pattern(const Eigen::SparseMatrix<double>& A) = 0;
+
+    // Numeric factorization (preconditioner setup for iterative backends)
+    virtual bool factorize(const Eigen::SparseMatrix<double>& A) = 0;
+
+    // Solves A x = b. On input, x holds the initial guess of iterative backends.
+    // Concurrent calls on the same (factorized) backend are safe (they may be
+    // serialized).
+    virtual bool solve(const Eigen::VectorXd& b, Eigen::VectorXd& x) const = 0;
+
+    // Solves A X = B for all the columns of B at once. Direct backends share every
+    // pass over the factor among the columns; the default implementation solves
+    // one column at a time (starting from a zero guess).
+    virtual bool solve_multiple(const Eigen::MatrixXd& B, Eigen::MatrixXd& X) const;
+
+    // Non-zeros of the last factor (L, diagonal included), or of the preconditioner
+    // factor of iterative backends. -1 if not available.
+    virtual int64_t factor_nonzeros() const { return -1; }
+};
+
+// Creates the backend described by params. Unavailable options fall back to
+// SIMPLICIAL_LDLT and AMD ordering (with a warning).
+std::unique_ptr<LinearSolverBackend> make_linear_solver(const LinearSolverParams& params);
+
+}
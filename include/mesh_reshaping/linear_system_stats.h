@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+namespace reshaping {
+
+// Sizes and timings (ms) of one assembled and solved normal-equations system
+// (vertex or transformation solve)
+struct LinearSystemStats {
+    // Assembly of AtWA and AtWb, including the evaluation of the term stencils
+    double assembly_time = 0.0;
+
+    // Part of assembly_time building the pattern of AtWA and summing the stencils
+    // into it (see assemble_normal_equations)
+    double normal_matrix_time = 0.0;
+
+    // Symbolic analysis and numeric factorization (zero if a factor is reused)
+    double factorize_time = 0.0;
+
+    double solve_time = 0.0;
+
+    // Number of rows of A (least-squares term rows) and of unknowns (rows of AtWA)
+    int rows = 0;
+    int unknowns = 0;
+
+    // Non-zeros of A, counting the rows of every term stencil as a single one
+    // (A is never formed, see StencilPattern)
+    int64_t nnz_stencils = 0;
+
+    int64_t nnz_AtWA = 0;
+
+    // Non-zeros of the factor (L, diagonal included) or -1 if not available
+    int64_t nnz_factor = -1;
+
+    // Non-zeros of the factor not in the lower triangle of AtWA (-1 if not available)
+    int64_t fill_in() const {
+        return nnz_factor < 0 ? -1 : nnz_factor - (nnz_AtWA + unknowns) / 2;
+    }
+};
+
+}
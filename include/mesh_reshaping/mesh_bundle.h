@@ -0,0 +1,112 @@
+#pragma once
+
+#include <mesh_reshaping/types.h>
+#include <mesh_reshaping/straight_chains.h>
+#include <mesh_reshaping/edit_operation.h>
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace reshaping {
+
+// Extension of mesh bundle files
+inline constexpr const char* MESH_BUNDLE_EXT = ".rsb";
+
+// Every input of a reshaping asset. Stored on disk either as separate text files
+// (.obj, .fk, .straight, .deform and .cam; see data_filenames.h) or as one mesh
+// bundle (see MeshBundle).
+struct MeshAssetData {
+    // Input (non-normalized) mesh
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+
+    // Per-face principal curvature values (empty if not available)
+    Eigen::VectorXd PV1;
+    Eigen::VectorXd PV2;
+
+    StraightChains straight_chains;
+    std::vector<EditOperation> edit_ops;
+
+    // Camera file content (JSON), only used by the GUI application
+    std::string cameras_json;
+};
+
+// Loads the text files of the asset whose mesh is mesh_fn. Only the mesh is
+// required; the other files are loaded if available.
+bool load_mesh_asset_files(const std::string& mesh_fn, MeshAssetData& asset);
+
+// Saves asset as text files next to mesh_fn (.obj)
+bool save_mesh_asset_files(const std::string& mesh_fn, const MeshAssetData& asset);
+
+// Saves asset as a single mesh bundle file
+bool save_mesh_bundle(const std::string& fn, const MeshAssetData& asset);
+
+class MappedFile;
+
+// Read-only view of a mesh bundle: a versioned binary file with one 64-byte aligned
+// section per input array. The file is memory mapped, and the accessors return
+// zero-copy views into it (valid while the bundle is alive).
+//
+// Layout: header, section table, then the section payloads. Matrices are stored
+// column-major, chains and edit operations as offset arrays (CSR) over their
+// vertices, and cameras as their JSON text.
+class MeshBundle {
+public:
+    ~MeshBundle();
+
+    // Maps and validates the given bundle (section sizes, offsets and vertex
+    // indices). Returns nullptr on failure.
+    static std::unique_ptr<MeshBundle> open(const std::string& fn);
+
+    Eigen::Map<const Eigen::MatrixXd> vertices() const;
+    Eigen::Map<const Eigen::MatrixXi> facets() const;
+
+    // Per-face principal curvature values (empty if not available)
+    Eigen::Map<const Eigen::VectorXd> face_k1() const;
+    Eigen::Map<const Eigen::VectorXd> face_k2() const;
+
+    int num_chains() const;
+    Eigen::Map<const Eigen::VectorXi> chain(int i) const;
+
+    int num_edit_operations() const;
+    std::string_view edit_label(int i) const;
+    Eigen::Map<const Eigen::VectorXi> edit_vertices(int i) const;
+
+    // Per-vertex displacements (one row per edit_vertices(i) entry)
+    Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>> edit_displacements(int i) const;
+
+    std::string_view cameras_json() const;
+
+    // Copies of the bundle content
+    StraightChains straight_chains() const;
+    EditOperation edit_operation(int i) const;
+    void to_asset_data(MeshAssetData& asset) const;
+
+private:
+    struct Section {
+        const char* data = nullptr;
+        int64_t size  = 0;
+        int64_t count = 0;
+    };
+
+    MeshBundle() = default;
+
+    template<typename T>
+    const T* section_data(int type) const {
+        return reinterpret_cast<const T*>(m_sections.at(type).data);
+    }
+
+    std::unique_ptr<MappedFile> m_file;
+    std::vector<Section> m_sections;
+};
+
+// Loads the mesh of a bundle, normalized as ca_essentials::meshes::load_trimesh does
+std::unique_ptr<TriMesh> load_trimesh_from_bundle(const MeshBundle& bundle,
+                                                  bool normalize = true);
+
+}
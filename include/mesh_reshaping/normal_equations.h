@@ -0,0 +1,317 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <igl/default_num_threads.h>
+#include <igl/parallel_for.h>
+
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/timer.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace reshaping {
+
+// Local normal-equations block of the least-squares rows touching only the N
+// unknowns in cols:
+//   K = sum_r w_r a_r a_r^T
+//   f = sum_r w_r b_r a_r
+//
+// Repeated column indices are allowed; their entries are summed when scattered.
+// Negative column indices mark eliminated unknowns, whose entries are ignored.
+template<int N>
+struct LocalStencil {
+    std::array<int, N> cols;
+    Eigen::Matrix<double, N, N> K = Eigen::Matrix<double, N, N>::Zero();
+    Eigen::Matrix<double, N, 1> f = Eigen::Matrix<double, N, 1>::Zero();
+
+    // Adds the row w * (a^T x - b)^2
+    void add_row(const Eigen::Matrix<double, N, 1>& a, double b, double w) {
+        K.noalias() += (w * a) * a.transpose();
+        f += (w * b) * a;
+    }
+};
+
+// Maps the entries of per-element stencils to the non-zeros of a normal-equations
+// matrix (At W A). The matrix is built directly from the stencils, without forming
+// A, and its values can be re-assembled in place as long as the stencils are
+// visited in the same order.
+//
+// AtWA is symmetric, so only the local entries (i, j) with i <= j of each stencil
+// are mapped, to the upper triangle of AtWA. The strictly lower triangle is then
+// copied from it (see copy_upper_to_lower()).
+class StencilPattern {
+public:
+    StencilPattern() { clear(); }
+
+    // Removes all registered stencils
+    void clear();
+
+    // True if the pattern is not built (stencils must be registered and built)
+    bool empty() const { return m_slot_offsets.size() == 1; }
+
+    int num_stencils() const { return (int) m_slot_offsets.size() - 1; }
+
+    // Number of stencil entries of non-eliminated unknowns, i.e. the non-zeros of
+    // A with the rows of every stencil merged (set by build())
+    int64_t num_entries() const { return m_num_entries; }
+
+    // Symbolic phase: registers the unknowns of the next stencil
+    template<int N>
+    void add(const LocalStencil<N>& stencil) {
+        m_cols.insert(m_cols.end(), stencil.cols.begin(), stencil.cols.end());
+        m_col_offsets.push_back((int64_t) m_cols.size());
+    }
+
+    // Builds the sparsity pattern of AtWA (num_unknowns x num_unknowns, zero values)
+    // from the registered stencils and maps every stencil entry to its non-zero index.
+    // The registered unknowns are released afterwards. Fails (leaving the pattern
+    // empty) if AtWA has too many non-zeros.
+    bool build(int num_unknowns, Eigen::SparseMatrix<double>& AtWA);
+
+    // Numeric phase: adds the idx-th registered stencil into the upper triangle of
+    // AtWA's values and into AtWb
+    template<int N>
+    void scatter(int idx,
+                 const LocalStencil<N>& stencil,
+                 Eigen::SparseMatrix<double>& AtWA,
+                 Eigen::VectorXd& AtWb) const {
+        double* values   = AtWA.valuePtr();
+        const int* slots = m_slots.data() + m_slot_offsets[idx];
+
+        for(int i = 0; i < N; ++i) {
+            for(int j = i; j < N; ++j, ++slots)
+                if(*slots >= 0)
+                    values[*slots] += upper_entry(stencil, i, j);
+
+            if(stencil.cols[i] >= 0)
+                AtWb(stencil.cols[i]) += stencil.f(i);
+        }
+    }
+
+    // Same as scatter(), taking the stencil packed by pack_upper()
+    void scatter_packed(int idx,
+                        int n,
+                        const int* cols,
+                        const double* K_upper,
+                        const double* f,
+                        double* values,
+                        double* rhs) const {
+        const int* slots = m_slots.data() + m_slot_offsets[idx];
+
+        for(int i = 0; i < n; ++i) {
+            for(int j = i; j < n; ++j, ++slots, ++K_upper)
+                if(*slots >= 0)
+                    values[*slots] += *K_upper;
+
+            if(cols[i] >= 0)
+                rhs[cols[i]] += f[i];
+        }
+    }
+
+    // Local entry (i, j), i <= j, summed into the upper triangle of AtWA. The entries
+    // (i, j) and (j, i) of a repeated unknown both go to the diagonal of AtWA.
+    template<int N>
+    static double upper_entry(const LocalStencil<N>& stencil, int i, int j) {
+        return i != j && stencil.cols[i] == stencil.cols[j] ? 2.0 * stencil.K(i, j)
+                                                            : stencil.K(i, j);
+    }
+
+    // Packs the entries upper_entry(stencil, i, j), i <= j, in row-major order
+    template<int N>
+    static void pack_upper(const LocalStencil<N>& stencil, double* K_upper) {
+        for(int i = 0; i < N; ++i)
+            for(int j = i; j < N; ++j)
+                *K_upper++ = upper_entry(stencil, i, j);
+    }
+
+    // Completes AtWA after the scatters, copying its upper triangle to the lower one
+    static void copy_upper_to_lower(Eigen::SparseMatrix<double>& AtWA, bool parallel);
+
+private:
+    int64_t m_num_entries = 0;
+
+    // Registered stencil idx owns m_cols[m_col_offsets[idx], m_col_offsets[idx + 1])
+    // (only kept until build())
+    std::vector<int64_t> m_col_offsets;
+    std::vector<int> m_cols;
+
+    // Stencil idx owns m_slots[m_slot_offsets[idx], m_slot_offsets[idx + 1]), storing
+    // the non-zero index of its local entries (i, j), i <= j, packed as in
+    // pack_upper() (-1 for entries of eliminated unknowns)
+    std::vector<int64_t> m_slot_offsets;
+    std::vector<int> m_slots;
+};
+
+// Element loops used by the stencil visitors. A visitor calls for_each(n, func)
+// for its per-element loop; every element writes stencils with known indices.
+struct SerialForEach {
+    template<typename Func>
+    void operator()(int n, const Func& func) const {
+        for(int i = 0; i < n; ++i)
+            func(i);
+    }
+};
+
+// Stencils visited by the current thread while evaluating a block of elements of
+// OrderedParallelForEach, packed as in StencilPattern::pack_upper()
+struct StencilScratch {
+    struct Entry {
+        int idx;
+        int n;
+        int64_t cols_offset;
+        int64_t values_offset;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> cols;
+    std::vector<double> values;
+
+    template<int N>
+    void add(int idx, const LocalStencil<N>& stencil) {
+        constexpr int num_packed = N * (N + 1) / 2;
+
+        entries.push_back({ idx, N, (int64_t) cols.size(), (int64_t) values.size() });
+        cols.insert(cols.end(), stencil.cols.begin(), stencil.cols.end());
+
+        values.resize(values.size() + num_packed + N);
+        double* K_upper = values.data() + entries.back().values_offset;
+        StencilPattern::pack_upper(stencil, K_upper);
+        std::copy(stencil.f.data(), stencil.f.data() + N, K_upper + num_packed);
+    }
+
+    void scatter(const StencilPattern& pattern, double* values, double* rhs) const {
+        for(const Entry& e : entries) {
+            const double* K_upper = this->values.data() + e.values_offset;
+            pattern.scatter_packed(e.idx, e.n, cols.data() + e.cols_offset, K_upper,
+                                   K_upper + e.n * (e.n + 1) / 2, values, rhs);
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        cols.clear();
+        values.clear();
+    }
+
+    // Scratch of the calling thread while it evaluates a block, or null
+    static StencilScratch*& current() {
+        static thread_local StencilScratch* scratch = nullptr;
+        return scratch;
+    }
+};
+
+// Parallel element loop of the numeric phase. Blocks of elements are evaluated
+// concurrently, each into the scratch of its worker, and then scattered one after
+// the other in block order, i.e. in the order of the serial loop. The values are
+// thus bit-identical to the serial ones.
+struct OrderedParallelForEach {
+    static constexpr int BLOCK_SIZE = 1024;
+
+    const StencilPattern& pattern;
+    double* values;
+    double* rhs;
+
+    template<typename Func>
+    void operator()(int n, const Func& func) const {
+        const int num_blocks  = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        const int num_workers = std::min(num_blocks, (int) igl::default_num_threads());
+        if(num_workers <= 1) {
+            SerialForEach()(n, func);
+            return;
+        }
+
+        std::atomic<int> next_block(0);
+        std::atomic<int> num_scattered(0);
+        igl::parallel_for(num_workers, [&](int) {
+            StencilScratch scratch;
+
+            for(int b = next_block++; b < num_blocks; b = next_block++) {
+                scratch.clear();
+                StencilScratch::current() = &scratch;
+                for(int i = b * BLOCK_SIZE; i < std::min((b + 1) * BLOCK_SIZE, n); ++i)
+                    func(i);
+                StencilScratch::current() = nullptr;
+
+                // Blocks are only taken by running workers, so the previous ones are
+                // always scattered eventually
+                while(num_scattered.load(std::memory_order_acquire) != b)
+                    std::this_thread::yield();
+
+                scratch.scatter(pattern, values, rhs);
+                num_scattered.store(b + 1, std::memory_order_release);
+            }
+        }, 1);
+    }
+};
+
+// Assembles the normal equations (AtWA, AtWb) of the stencils enumerated by
+// visit_stencils(for_each, visitor), where visitor(idx, stencil) receives every
+// stencil with its index. The pattern is built on the first call (when empty)
+// and the values are written in place afterwards.
+//
+// The parallel path computes the stencils concurrently and is bit-identical to
+// the serial one.
+//
+// Returns the time (ms) spent building the pattern and summing the stencils into
+// AtWA and AtWb. The stencils are summed as soon as they are computed, so that
+// time also includes their evaluation. The same steps are profiled under
+// profile_name (a string literal, e.g. "vertex_solve/normal_matrix").
+template<typename StencilsVisitor>
+double assemble_normal_equations(int num_unknowns,
+                               StencilsVisitor&& visit_stencils,
+                               StencilPattern& pattern,
+                               Eigen::SparseMatrix<double>& AtWA,
+                               Eigen::VectorXd& AtWb,
+                               bool parallel,
+                               [[maybe_unused]] const char* profile_name) {
+    ca_essentials::core::Timer timer;
+    double normal_matrix_time = 0.0;
+
+    // Sparse pattern of AtWA (in place of setFromTriplets), only built once
+    if(pattern.empty()) {
+        CA_PROFILE_SCOPE(profile_name);
+        timer.start("pattern");
+
+        visit_stencils(SerialForEach(), [&](int, const auto& stencil) { pattern.add(stencil); });
+        const bool built = pattern.build(num_unknowns, AtWA);
+
+        normal_matrix_time += timer.elapsed("pattern");
+        if(!built) {
+            // Empty system, failing to factorize
+            AtWA.resize(num_unknowns, num_unknowns);
+            AtWb.setZero(num_unknowns);
+            return normal_matrix_time;
+        }
+    }
+
+    CA_PROFILE_SCOPE(profile_name);
+    timer.start("scatter");
+    std::fill(AtWA.valuePtr(), AtWA.valuePtr() + AtWA.nonZeros(), 0.0);
+    AtWb.setZero(num_unknowns);
+
+    // Stencils visited outside of the element loops (no scratch) are summed directly
+    auto scatter = [&](int idx, const auto& stencil) {
+        if(StencilScratch* scratch = StencilScratch::current())
+            scratch->add(idx, stencil);
+        else
+            pattern.scatter(idx, stencil, AtWA, AtWb);
+    };
+
+    if(parallel)
+        visit_stencils(OrderedParallelForEach{ pattern, AtWA.valuePtr(), AtWb.data() }, scatter);
+    else
+        visit_stencils(SerialForEach(), scatter);
+
+    StencilPattern::copy_upper_to_lower(AtWA, parallel);
+    normal_matrix_time += timer.elapsed("scatter");
+
+    return normal_matrix_time;
+}
+
+}
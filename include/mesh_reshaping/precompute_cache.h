@@ -0,0 +1,58 @@
+#pragma once
+
+#include <mesh_reshaping/types.h>
+#include <mesh_reshaping/reshaping_params.h>
+#include <mesh_reshaping/straight_chains.h>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+namespace reshaping {
+    struct ReshapingContext;
+}
+
+namespace reshaping {
+
+// Persistent (on-disk) cache of the geometric pre-computation of a ReshapingContext:
+// average edge length, triangle normals, sphericity terms and similarity weights.
+//
+// Entries are stored as one binary file per key (see compute_precompute_cache_key)
+// in the cache folder, so repeated runs on the same asset skip this pre-computation.
+// Lookups are thread-safe, and entries are written atomically (temporary file
+// renamed into place), so several processes can share the same folder.
+class PrecomputeDiskCache {
+public:
+    explicit PrecomputeDiskCache(std::filesystem::path folder);
+
+    const std::filesystem::path& folder() const { return m_folder; }
+
+    // Fills the cached fields of ctx from the entry of key.
+    // Returns false (cache miss) if there is no valid entry for ctx's mesh.
+    bool load(uint64_t key, ReshapingContext& ctx);
+
+    // Stores the cached fields of ctx as the entry of key
+    bool save(uint64_t key, const ReshapingContext& ctx) const;
+
+    int num_hits() const { return m_num_hits; }
+    int num_misses() const { return m_num_misses; }
+
+private:
+    std::filesystem::path entry_fn(uint64_t key) const;
+
+private:
+    std::filesystem::path m_folder;
+
+    std::atomic<int> m_num_hits{ 0 };
+    std::atomic<int> m_num_misses{ 0 };
+};
+
+// Hashes the content the cached pre-computation depends on: vertices, faces, face
+// curvature values (.fk), straight chains (.straight) and the relevant parameters
+uint64_t compute_precompute_cache_key(const ReshapingParams& params,
+                                      const TriMesh& mesh,
+                                      const Eigen::VectorXd& PV1,
+                                      const Eigen::VectorXd& PV2,
+                                      const StraightChains* straight_chains);
+
+}
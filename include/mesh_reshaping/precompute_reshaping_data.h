@@ -4,22 +4,53 @@
 #include <mesh_reshaping/reshaping_data.h>
 #include <mesh_reshaping/reshaping_params.h>
 #include <mesh_reshaping/straight_chains.h>
+#include <mesh_reshaping/transformation_factor_cache.h>
+#include <mesh_reshaping/precompute_cache.h>
 
 namespace reshaping {
 
-std::unique_ptr<ReshapingData>
+// Pre-computes the edit-independent reshaping data of mesh.
+//
+// If transf_factor_cache is provided, the transformation-solve factorization is
+// looked up in (or added to) the cache instead of being recomputed, so that
+// every context created for the same mesh shares it.
+//
+// If disk_cache is provided, the geometric pre-computation is loaded from it when
+// the same mesh (and parameters) has been pre-computed before, and stored otherwise.
+//
+// mesh (and straight_chains) must outlive the returned context.
+std::shared_ptr<const ReshapingContext>
+precompute_reshaping_context(const ReshapingParams& params,
+                             const TriMesh& mesh,
+                             const Eigen::VectorXd& PV1,
+                             const Eigen::VectorXd& PV2,
+                             const StraightChains* straight_chains = nullptr,
+                             TransfSolveFactorCache* transf_factor_cache = nullptr,
+                             PrecomputeDiskCache* disk_cache = nullptr);
+
+// Creates the initial per-solve state of an edit operation (bc) on a pre-computed
+// context. Any number of states can share the same context.
+std::unique_ptr<ReshapingState>
+make_reshaping_state(const ReshapingParams& params,
+                     std::shared_ptr<const ReshapingContext> context,
+                     const std::unordered_map<int, Eigen::Vector3d>& bc);
+
+// Pre-computes a context for mesh and creates the state of a single edit operation
+std::unique_ptr<ReshapingState>
 precompute_reshaping_data(const ReshapingParams& params,
                           const TriMesh& mesh,
                           const Eigen::VectorXd& PV1,
                           const Eigen::VectorXd& PV2,
-                          const StraightChains* straight_chains = nullptr);
+                          const StraightChains* straight_chains = nullptr,
+                          TransfSolveFactorCache* transf_factor_cache = nullptr);
 
-std::unique_ptr<ReshapingData>
+std::unique_ptr<ReshapingState>
 precompute_reshaping_data(const ReshapingParams& params,
                           const TriMesh& mesh,
                           const Eigen::VectorXd& PV1,
                           const Eigen::VectorXd& PV2,
                           const std::unordered_map<int, Eigen::Vector3d>& bc,
-                          const StraightChains* straight_chains = nullptr);
+                          const StraightChains* straight_chains = nullptr,
+                          TransfSolveFactorCache* transf_factor_cache = nullptr);
 
 }
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/reshaping_params.h>
+
+#include <Eigen/Geometry>
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace reshaping {
+
+// Boundary conditions of one edit operation
+// <key: vertex index, value: target position>
+using EditConstraints = std::unordered_map<int, Eigen::Vector3d>;
+
+struct BatchParams {
+    // Number of worker threads (0 uses all hardware threads)
+    int num_threads = 0;
+
+    // Continuation across parametric sweeps: edits constraining the same vertices
+    // are ordered along their sweep, and each one starts from the converged vertices
+    // and transformations of the previous one (instead of the input mesh and
+    // identity transformations). Disables the sharing of the first vertex solve.
+    // Sweep groups run in parallel with each other; a group is only split into a
+    // few long chains when there are fewer groups than threads.
+    bool continuation = false;
+};
+
+// Called once edit operation i has been solved, from the worker thread that solved
+// it. data holds the per-edit state and data.curr_vertices the reshaped vertices.
+using BatchEditCallback = std::function<void(int i, ReshapingState& data)>;
+
+// Solves several edit operations on the same mesh concurrently.
+//
+// context holds the edit-independent pre-computation (see
+// precompute_reshaping_context), which is done once and shared read-only: every
+// edit only gets its own ReshapingState. Edits are distributed to
+// batch_params.num_threads workers.
+//
+// Edits constraining the same vertices (e.g. a sweep of displacements applied to
+// the same handles) share the factorization of their first vertex solve, which is
+// solved for all of them as one multi-column right-hand side, unless they are
+// warm-started from each other (see BatchParams::continuation).
+//
+// Returns the number of edits solved successfully.
+int reshaping_solve_batch(const ReshapingParams& params,
+                          const std::shared_ptr<const ReshapingContext>& context,
+                          const std::vector<EditConstraints>& edits,
+                          const BatchParams& batch_params,
+                          const BatchEditCallback& on_edit_solved);
+
+}
@@ -4,6 +4,9 @@
 #include <mesh_reshaping/termination_criterion.h>
 #include <mesh_reshaping/straight_chains.h>
 #include <mesh_reshaping/sphericity_terms_info.h>
+#include <mesh_reshaping/normal_equations.h>
+#include <mesh_reshaping/linear_solver.h>
+#include <mesh_reshaping/linear_system_stats.h>
 #include <ca_essentials/meshes/trimesh.h>
 
 #include <Eigen/Geometry>
@@ -11,13 +14,24 @@
 
 #include <vector>
 #include <array>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
+
+namespace reshaping {
+    struct TransfSolveFactor;
+}
 
 namespace reshaping {
 
-struct ReshapingData {
+// Edit-independent data pre-computed once per input mesh (see
+// precompute_reshaping_context).
+//
+// It is never modified after pre-computation, so a single context can be shared
+// (read-only) by any number of concurrent solves on the same mesh.
+struct ReshapingContext {
     // Enforcing a valid triangle mesh always
-    ReshapingData(const ca_essentials::meshes::TriMesh& m)
+    ReshapingContext(const ca_essentials::meshes::TriMesh& m)
     : mesh(m) {
 
     }
@@ -32,13 +46,12 @@ struct ReshapingData {
     Eigen::VectorXd PV1;
     Eigen::VectorXd PV2;
 
-    // Boundary conditions
-    // <key: vertex index, value: target position>
-    std::unordered_map<int, Eigen::Vector3d> bc;
-
-    // Pre-computed sphericity terms info
+    // Pre-computed sphericity terms info (non-zero weight terms only)
     std::vector<SphericityTermInfo> sphericity_terms_info;
 
+    // Edges (v_i, v_j) and (v_i, v_k) of every sphericity term
+    std::vector<std::array<int, 2>> sphericity_term_edges;
+
     // Number of straight pairs
     // TODO: document it
     int num_straight_pairs = 0;
@@ -46,36 +59,114 @@ struct ReshapingData {
     // Initial average edge length 
     double avg_edge_len = 0.0;
 
-    // Input and current vertices
+    // Time (ms) spent pre-computing (or loading from the disk cache) this context
+    double precompute_time = 0.0;
+
+    // Input vertices
     Eigen::MatrixXd orig_vertices;
-    Eigen::MatrixXd curr_vertices;
 
-    // Input edge vectors
+    // Input edge vectors and lengths
     Eigen::MatrixXd orig_edges;
+    Eigen::VectorXd orig_edge_lens;
 
-    // Initial and current per-triangle normals
+    // Input per-triangle normals
     Eigen::MatrixXd orig_tri_N;
-    Eigen::MatrixXd curr_tri_N;
 
     // For each edge, it stores the input normal of the two adjacent faces
     // Note: supporting manifold meshes only for now
     std::vector<std::array<Eigen::Vector3d, 2>> orig_edge_adj_N;
 
+    // Per-edge similarity term weight - based on dihedral angles.
+    Eigen::VectorXd similarity_term_edge_w;
+
+    // Edges with a non-zero similarity term weight
+    std::vector<int> similarity_edges;
+
+    // Transformation-solve factorization (see TransfSolveParams::factor_once).
+    // It may be shared with other contexts created for the same mesh.
+    std::shared_ptr<const TransfSolveFactor> transf_factor;
+};
+
+// Per-solve state of one edit operation (see make_reshaping_state). It references
+// a shared ReshapingContext and only stores what the solve modifies.
+struct ReshapingState {
+    ReshapingState(std::shared_ptr<const ReshapingContext> ctx)
+    : context(std::move(ctx)),
+      mesh(context->mesh) {
+
+    }
+
+    // Edit-independent data
+    std::shared_ptr<const ReshapingContext> context;
+
+    // Input surface mesh (same as context->mesh)
+    const ca_essentials::meshes::TriMesh& mesh;
+
+    // Boundary conditions
+    // <key: vertex index, value: target position>
+    std::unordered_map<int, Eigen::Vector3d> bc;
+
+    // Current vertices
+    Eigen::MatrixXd curr_vertices;
+
+    // Vertex-solve solution of iteration 0 when it has been computed ahead, together
+    // with other edits sharing the same constraints (see reshaping_solve_batch).
+    // Empty otherwise, or once used.
+    Eigen::MatrixXd initial_vertex_sol;
+
+    // Current per-triangle normals
+    Eigen::MatrixXd curr_tri_N;
+
     // Per-triangle current and previous transformations (T_i)
     std::vector<Eigen::Matrix3d> curr_tri_T;
     std::vector<Eigen::Matrix3d> prev_tri_T;
 
-    // Per-edge initial and target lengths
-    Eigen::VectorXd orig_edge_lens;
+    // Per-edge current and target lengths
     Eigen::VectorXd curr_edge_lens;
     Eigen::VectorXd target_edge_lens;
 
-    // Per-edge similarity term weight - based on dihedral angles.
-    Eigen::VectorXd similarity_term_edge_w;
-
     // Per-edge length-based weights (max(1.0, l_ij/L_avg))
     Eigen::VectorXd length_based_edge_w;
 
+    // Reference edge vectors, edge lengths and triangle normals of the solves.
+    // These are the context's input ones unless handle-error distribution has
+    // retargeted them, in which case the state's own copy is returned.
+    const Eigen::MatrixXd& orig_edges() const {
+        return orig_edges_overlay.size() > 0 ? orig_edges_overlay : context->orig_edges;
+    }
+
+    const Eigen::VectorXd& orig_edge_lens() const {
+        return orig_edge_lens_overlay.size() > 0 ? orig_edge_lens_overlay : context->orig_edge_lens;
+    }
+
+    const Eigen::MatrixXd& orig_tri_N() const {
+        return orig_tri_N_overlay.size() > 0 ? orig_tri_N_overlay : context->orig_tri_N;
+    }
+
+    // Writable references, copying the context's values on first use
+    Eigen::MatrixXd& mutable_orig_edges() {
+        if(orig_edges_overlay.size() == 0)
+            orig_edges_overlay = context->orig_edges;
+        return orig_edges_overlay;
+    }
+
+    Eigen::VectorXd& mutable_orig_edge_lens() {
+        if(orig_edge_lens_overlay.size() == 0)
+            orig_edge_lens_overlay = context->orig_edge_lens;
+        return orig_edge_lens_overlay;
+    }
+
+    Eigen::MatrixXd& mutable_orig_tri_N() {
+        if(orig_tri_N_overlay.size() == 0)
+            orig_tri_N_overlay = context->orig_tri_N;
+        return orig_tri_N_overlay;
+    }
+
+    // Copy-on-write overlays of the accessors above (empty until written)
+    Eigen::MatrixXd orig_edges_overlay;
+    Eigen::VectorXd orig_edge_lens_overlay;
+    Eigen::MatrixXd orig_tri_N_overlay;
+
     ////////////////////////////////////////////////////////
     // Handle error distribution parameters
     // See Appendix A (Finalizing Outputs) for more details
@@ -96,26 +187,74 @@ struct ReshapingData {
     TerminationCriterion termination_type;
 
     // Vertex Position solve and status of the last solve call
-    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> vertex_solver;
+    // (see VertexSolveParams::linear_solver)
+    std::unique_ptr<LinearSolverBackend> vertex_solver;
     bool last_vertex_sol_succ = false;
 
+    // Vertex-solve normal equations and the mapping of its term stencils into them
+    // (see VertexSolveParams::reuse_system_pattern). The pattern is rebuilt
+    // whenever the system size changes.
+    Eigen::SparseMatrix<double> vertex_AtWA;
+    StencilPattern vertex_sys_pattern;
+    Eigen::Vector2i vertex_sys_size = Eigen::Vector2i::Zero();
+
+    // Column of every vertex-solve unknown in the reduced system, or -1 if eliminated
+    // (see VertexSolveParams::exact_constraints). Empty if no unknown is eliminated.
+    std::vector<int> vertex_sys_cols;
+
+    // Iteration of the last vertex-system factorization (-1 if none), reused as
+    // preconditioner by the warm-started solve (see VertexSolveParams::warm_start),
+    // and the absolute tolerance of that solve
+    int vertex_factor_iter = -1;
+    double vertex_warm_start_tol = 0.0;
+
     // Tranformation solver and status of the last solve call
-    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> transf_solver;
+    // (see TransfSolveParams::linear_solver)
+    std::unique_ptr<LinearSolverBackend> transf_solver;
     bool last_transf_sol_succ = false;
 
+    // Transformation-solve normal equations and stencil mapping, used when the
+    // system is not factorized once (see TransfSolveParams::factor_once)
+    Eigen::SparseMatrix<double> transf_AtWA;
+    StencilPattern transf_sys_pattern;
+
     // Time measurements
     double total_time = 0.0;
     double avg_iter_time = 0.0;
 
+    // Anderson acceleration statistics (see ReshapingParams::anderson): accepted
+    // accelerated iterations, rejected ones (each followed by a restart) and time
+    // spent extrapolating the iterates
+    int num_accelerated_iters = 0;
+    int num_anderson_restarts = 0;
+    double anderson_time = 0.0;
+
+    // Continuation statistics (see warm_start_from_solution): number of iterations
+    // of the cold-started solve the warm start chain originates from, or -1 if this
+    // solve was cold-started
+    int warm_start_ref_iters = -1;
+
     /**************************************************
      * Debug options and information only
      * TODO: add DEBUG flag
      **************************************************/
+
+    // Vertex-solve solutions kept according to ReshapingParams::iter_history and
+    // the iteration of each one
     std::vector<Eigen::MatrixXd> iter_vertex_sol;
+    std::vector<int> iter_vertex_sol_iters;
+
     std::vector<ReshapingEnergy> iter_energy_costs;
     std::vector<double> iter_energy_delta;
     std::vector<double> iter_max_vertex_change;
+    std::vector<bool> iter_accelerated;
     std::vector<double> iter_max_positional_constr_dist;
+
+    // Per-iteration vertex and transformation systems. The vertex system of a
+    // first solve shared with other edits is empty (zero rows), and the last
+    // iteration has no transformation solve.
+    std::vector<LinearSystemStats> iter_vertex_sys_stats;
+    std::vector<LinearSystemStats> iter_transf_sys_stats;
 };
 
 }
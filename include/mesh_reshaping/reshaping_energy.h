@@ -5,7 +5,7 @@
 #include <mesh_reshaping/transformation_solve_energy.h>
 
 namespace reshaping {
-    struct ReshapingData;
+    struct ReshapingState;
 }
 
 namespace reshaping {
@@ -15,10 +15,19 @@ struct ReshapingEnergy {
     TransfSolveEnergy transf_sol;
 
     double total_cost = 0.0;
+
+    // Whether the energy was evaluated on its iteration (see
+    // ReshapingParams::compute_energy_every_n_iters). The costs of an iteration
+    // that was not evaluated are the ones of the last evaluated iteration.
+    bool evaluated = true;
+
+    // Evaluation time (ms) of each solve's energy
+    double vertex_sol_time = 0.0;
+    double transf_sol_time = 0.0;
 };
 
 ReshapingEnergy compute_reshaping_energy(const ReshapingParams& params,
-                                         const ReshapingData& data,
+                                         const ReshapingState& data,
                                          const Eigen::MatrixXd& V);
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <mesh_reshaping/straight_chains.h>
+#include <mesh_reshaping/linear_solver.h>
 #include <ca_essentials/core/geom_utils.h>
 
 #include <Eigen/Core>
@@ -11,6 +12,25 @@
 
 namespace reshaping {
 
+// Vertex-solve solutions kept along the iterations (see ReshapingState::iter_vertex_sol)
+enum class IterationHistory {
+    // No solution is kept. The max vertex change of an iteration is measured
+    // against the vertices it starts from, i.e., the extrapolated ones when
+    // Anderson acceleration is on.
+    NONE,
+
+    // Only the solution of the previous iteration, used to measure the max vertex change
+    PREVIOUS_ONLY,
+
+    // The previous solution and those of every n-th iteration
+    // (see ReshapingParams::history_every_n_iters)
+    EVERY_N,
+
+    // All solutions. Also enables the export of the iteration solutions
+    // (see ReshapingParams::debug_folder)
+    FULL
+};
+
 // Handle-error distribution parameters
 // 
 // See details in Appendix A (Finalizing Outputs)
@@ -37,6 +57,27 @@ struct HandleErrorDistribParams {
     double min_error_tol = ca_essentials::core::to_radians(10.0);
 };
 
+// Warm-started vertex solve
+//
+// Consecutive vertex solves change the solution only slightly. When enabled,
+// iterations after the first one run a conjugate gradient starting from the
+// current vertices, preconditioned with the last factorization of the system
+// (lagged factor), instead of factorizing the new system.
+struct VertexWarmStartParams {
+    bool is_active = false;
+
+    // CG stops once the estimated maximum vertex error falls below
+    //   tol_factor * max_vertex_change_tol * avg_edge_len
+    double tol_factor = 0.01;
+
+    // The system is factorized again (and solved directly) if CG has not
+    // converged after this many iterations
+    int max_cg_iters = 30;
+
+    // Forces a new factorization every n iterations (0 disables it)
+    int refactor_every_n_iters = 0;
+};
+
 struct VertexSolveParams {
     double normal_weight = 10.0;
     double edge_weight = 1.0;
@@ -46,6 +87,28 @@ struct VertexSolveParams {
     double regularizer_weight = 1e-4;
     double bc_weight = 1e5;
 
+    // The sparsity pattern of the vertex-solve system does not change between
+    // iterations. When enabled, the stencil-to-non-zero mapping is built once and
+    // later iterations write the system values in place.
+    bool reuse_system_pattern = true;
+
+    // Computes the term stencils on multiple threads. The assembled system is
+    // bit-identical to the serial one.
+    bool parallel_assembly = true;
+
+    // Treats positional constraints as exact: constrained vertices are removed from
+    // the unknowns (their values move to the right-hand side) instead of being held
+    // by bc_weight penalty rows. During handle-error distribution, off-zone vertices
+    // are the ones eliminated, so only in-zone vertices are solved for (handles keep
+    // their weakened_hc_weight penalty).
+    bool exact_constraints = false;
+
+    // Sparse solver used for the vertex-solve system
+    LinearSolverParams linear_solver;
+
+    // Only used with direct solvers (iterative ones always start from the current vertices)
+    VertexWarmStartParams warm_start;
+
     HandleErrorDistribParams handle_error_distrib;
 };
 
@@ -58,6 +121,31 @@ struct TransfSolveParams {
 
     const double similarity_sigma = M_PI / 6.0;
     const double similarity_cutoff_angle = ca_essentials::core::to_radians(90.0 + 15.0);
+
+    // The transformation-solve system matrix only depends on the input mesh, so it
+    // can be assembled and factorized once during precomputation. When enabled,
+    // each iteration only rebuilds the right-hand side and performs the solve.
+    bool factor_once = true;
+
+    // Computes the term stencils on multiple threads. The assembled system is
+    // bit-identical to the serial one.
+    bool parallel_assembly = true;
+
+    // Sparse solver used for the transformation-solve system
+    LinearSolverParams linear_solver;
+};
+
+// Anderson acceleration of the alternating vertex/transformation iterations.
+//
+// The combined (vertices, transformations) state produced by each iteration is
+// extrapolated from the previous ones. An accelerated step that increases the
+// energy (i.e. that would trigger NEGATIVE_DELTA) is rejected: the iteration
+// restarts from the plain iterate with an empty history.
+struct AndersonAccelerationParams {
+    bool is_active = false;
+
+    // Number of previous iterates used in the extrapolation
+    int history_size = 5;
 };
 
 struct ReshapingParams {
@@ -82,11 +170,31 @@ struct ReshapingParams {
     /////////////////////////////////////////////
     bool handle_error_distrib_enabled = false;
 
+    AndersonAccelerationParams anderson;
+
+    // Evaluates the energy only every n iterations (and whenever the iterations
+    // stop). The energy delta of an evaluated iteration is taken against the last
+    // evaluated one, and the energy-based termination criteria and best-solution
+    // updates are only applied on evaluated iterations. 1 evaluates it on every
+    // iteration.
+    int compute_energy_every_n_iters = 1;
+
+    // Sums the energy terms on multiple threads. The energy does not depend on it.
+    bool parallel_energy = true;
+
     /////////////////////////////////////////////
     // Debugging paramaters
     /////////////////////////////////////////////
 
-    // Optional parameter used for exporting debugging files
+    // Vertex solutions kept along the iterations. Only the previous one is
+    // required by the termination criteria.
+    IterationHistory iter_history = IterationHistory::PREVIOUS_ONLY;
+
+    // Frequency (in iterations) at which solutions are kept with IterationHistory::EVERY_N
+    int history_every_n_iters = 10;
+
+    // Optional parameter used for exporting debugging files. The iteration
+    // solutions are only exported with IterationHistory::FULL.
     std::filesystem::path debug_folder;
 
     // Defines the frequency (in iterations) at which new vertex solutions are exported to OBJ files.
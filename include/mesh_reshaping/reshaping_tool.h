@@ -17,6 +17,17 @@ namespace reshaping {
 // Returns:
 //     Reshaped mesh vertices
 Eigen::MatrixXd reshaping_solve(const ReshapingParams& params,
-                                ReshapingData& data);
+                                ReshapingState& data);
 
-}
\ No newline at end of file
+// Continuation: starts data's solve from the solution of a neighbor edit (e.g. the
+// previous step of a parametric sweep), instead of from the input mesh and identity
+// transformations. src must have been solved (see reshaping_solve) on the same
+// context, and data must not be solved yet.
+void warm_start_from_solution(const ReshapingState& src,
+                              ReshapingState& data);
+
+// Updates the target length of every edge to the average of the input edge
+// transformed by the current transformations of its two adjacent triangles
+void update_target_edge_lengths(ReshapingState& data);
+
+}
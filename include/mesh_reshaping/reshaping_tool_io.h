@@ -33,7 +33,7 @@ namespace reshaping {
                                          const std::string& folder);
 
     bool save_optimization_info_to_json(const ca_essentials::meshes::TriMesh& mesh,
-                                        const reshaping::ReshapingData& opt_data,
+                                        const reshaping::ReshapingState& opt_data,
                                         const reshaping::ReshapingParams& opt_params,
                                         const std::string& out_dir,
                                         const std::string& res_name);
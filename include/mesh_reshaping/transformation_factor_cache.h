@@ -0,0 +1,62 @@
+#pragma once
+
+#include <mesh_reshaping/reshaping_params.h>
+#include <mesh_reshaping/linear_solver.h>
+#include <mesh_reshaping/linear_system_stats.h>
+
+#include <Eigen/Sparse>
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace reshaping {
+    struct ReshapingContext;
+    struct ReshapingState;
+}
+
+namespace reshaping {
+
+// Factorized transformation-solve system (see prefactor_transformation_system).
+//
+// The system never references the boundary conditions, so the same factor can be
+// shared (read-only) by every ReshapingContext created for the same mesh.
+struct TransfSolveFactor {
+    std::unique_ptr<LinearSolverBackend> solver;
+
+    // Sizes and assembly/factorization timings of the factorized system
+    LinearSystemStats sys_stats;
+};
+
+// Thread-safe cache of transformation-solve factors keyed by mesh content
+// (vertices, faces and per-face curvature values), the sphericity and similarity
+// terms of the system and linear solver options.
+//
+// Concurrent requests for the same mesh wait on a single factorization.
+class TransfSolveFactorCache {
+public:
+    // Returns the cached factor for the mesh referenced by data, computing it if needed.
+    // Returns nullptr if the factorization fails.
+    std::shared_ptr<const TransfSolveFactor> get_or_compute(const TransfSolveParams& params,
+                                                            const ReshapingState& data);
+
+    // Number of cached factors
+    size_t size() const;
+
+    // Removes all cached factors. Factors already shared with a ReshapingContext are kept
+    // alive by their owners.
+    void clear();
+
+private:
+    using FactorFuture = std::shared_future<std::shared_ptr<const TransfSolveFactor>>;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, FactorFuture> m_factors;
+};
+
+// Computes the key used by TransfSolveFactorCache for the given reshaping context
+uint64_t compute_transf_factor_key(const ReshapingContext& ctx);
+
+}
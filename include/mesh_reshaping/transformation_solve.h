@@ -2,13 +2,55 @@
 
 #include <mesh_reshaping/reshaping_params.h>
 #include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/transformation_factor_cache.h>
+#include <mesh_reshaping/linear_system_stats.h>
 
 #include <Eigen/Geometry>
 
 namespace reshaping {
 
+// Term groups of the transformation-solve system. The connect and similarity rows
+// of an edge share a single stencil (EdgePairs), as do the transform and
+// normal rows of an edge and adjacent face (EdgeFaces).
+enum class TransfSolveTerms {
+    EdgePairs,
+    EdgeFaces,
+    Sphericity,
+    Regularizer,
+    All
+};
+
+// Assembles and factorizes the transformation-solve system matrix.
+//
+// The matrix only depends on the input mesh (edges, normals, sphericity and
+// similarity weights), so the factorization is reused by every subsequent
+// solve_for_transformations call when TransfSolveParams::factor_once is set.
+//
+// Returns nullptr if the factorization fails.
+std::shared_ptr<const TransfSolveFactor>
+prefactor_transformation_system(const TransfSolveParams& params,
+                                const ReshapingState& data);
+
+// Solves the per-triangle transformations of the current iteration. The sizes
+// and timings of the solved system are written to stats, if given.
 bool solve_for_transformations(const TransfSolveParams& params,
-                               ReshapingData& data,
-                               std::vector<Eigen::Matrix3d>& out_T);
+                               ReshapingState& data,
+                               std::vector<Eigen::Matrix3d>& out_T,
+                               LinearSystemStats* stats = nullptr);
+
+// Assembles the transformation-solve normal equations of the current state into
+// data.transf_AtWA and AtWb, without solving them (nor using the pre-computed
+// factorization). Used by the kernel benchmarks.
+void assemble_transformation_solve_normal_equations(const TransfSolveParams& params,
+                                                    ReshapingState& data,
+                                                    Eigen::VectorXd& AtWb,
+                                                    LinearSystemStats* stats = nullptr);
+
+// Evaluates the stencils of the given terms for the current state (serially),
+// without summing them into a system. Returns the sum of their diagonal and
+// right-hand side entries. Used by the kernel benchmarks.
+double evaluate_transformation_solve_stencils(const TransfSolveParams& params,
+                                              const ReshapingState& data,
+                                              TransfSolveTerms terms);
 
-}
\ No newline at end of file
+}
@@ -3,7 +3,7 @@
 #include <mesh_reshaping/reshaping_params.h>
 
 namespace reshaping {
-    struct ReshapingData;
+    struct ReshapingState;
 }
 
 namespace reshaping {
@@ -21,8 +21,11 @@ struct TransfSolveEnergy {
     double total_cost = 0.0;
 };
 
+// Evaluates the transformation-solve energy of the current transformations. The
+// terms are summed on multiple threads if parallel is set (the sum does not
+// depend on it).
 TransfSolveEnergy compute_transf_solve_energy(const TransfSolveParams& params,
-                                              const ReshapingData& data,
-                                              const Eigen::MatrixXd& V);
+                                              const ReshapingState& data,
+                                              bool parallel = true);
 
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace reshaping {
+
+// Extension of variant archive files
+inline constexpr const char* VARIANT_ARCHIVE_EXT = ".rsva";
+
+struct VariantArchiveParams {
+    // Bits of every quantized displacement coordinate (1 to 30)
+    int quantization_bits = 16;
+
+    // Lossless coding (deflate) of the quantized displacements, kept for the variants
+    // it makes smaller. Ignored (with a warning) if the library was built without zlib.
+    bool entropy_coding = true;
+};
+
+// Entry of the variant index
+struct VariantArchiveEntry {
+    std::string label;
+    int64_t offset = 0;
+    int64_t size   = 0;
+};
+
+// Writer of variant archives: many deformed versions (variants) of the same mesh
+// stored as one copy of the rest mesh plus, per variant, its vertex displacements.
+//
+// Displacements are quantized per coordinate within their bounding box, so the
+// error of every coordinate is at most half the box extent / (2^bits - 1). They are
+// then bit packed or, optionally, delta coded along a spatial order of the rest
+// vertices and deflated. An index of the variants (by label) is written at the end
+// of the file by close().
+//
+// add_variant() can be called concurrently.
+class VariantArchiveWriter {
+public:
+    ~VariantArchiveWriter();
+
+    // Creates the archive and writes the rest mesh. Returns nullptr on failure.
+    static std::unique_ptr<VariantArchiveWriter> create(const std::string& fn,
+                                                        const Eigen::MatrixXd& rest_V,
+                                                        const Eigen::MatrixXi& F,
+                                                        const VariantArchiveParams& params = {});
+
+    // Appends a variant (same number of vertices as the rest mesh). Labels must be
+    // unique.
+    bool add_variant(const std::string& label, const Eigen::MatrixXd& V);
+
+    // Writes the index and closes the file (also done by the destructor)
+    bool close();
+
+    int num_variants() const;
+
+private:
+    VariantArchiveWriter() = default;
+
+    VariantArchiveParams m_params;
+    Eigen::MatrixXd m_rest_V;
+    std::vector<int64_t> m_order;
+
+    mutable std::mutex m_mutex;
+    std::ofstream m_file;
+    int64_t m_end = 0;
+    std::vector<VariantArchiveEntry> m_entries;
+    std::unordered_map<std::string, int> m_label_to_entry;
+};
+
+// Reader of variant archives (see VariantArchiveWriter). Opening reads the rest mesh
+// and the index only; every variant is read and decoded on demand. load_variant()
+// can be called concurrently.
+class VariantArchive {
+public:
+    // Opens and validates the given archive. Returns nullptr on failure.
+    static std::unique_ptr<VariantArchive> open(const std::string& fn);
+
+    const Eigen::MatrixXd& rest_vertices() const { return m_rest_V; }
+    const Eigen::MatrixXi& facets() const { return m_F; }
+
+    int num_variants() const { return (int) m_entries.size(); }
+    const std::string& label(int i) const { return m_entries.at(i).label; }
+
+    // Index of the variant with the given label (-1 if not found)
+    int find(const std::string& label) const;
+
+    // Rebuilds the vertices of a variant
+    bool load_variant(int i, Eigen::MatrixXd& V) const;
+    bool load_variant(const std::string& label, Eigen::MatrixXd& V) const;
+
+private:
+    VariantArchive() = default;
+
+    std::string m_fn;
+    Eigen::MatrixXd m_rest_V;
+    Eigen::MatrixXi m_F;
+    std::vector<int64_t> m_order;
+
+    std::vector<VariantArchiveEntry> m_entries;
+    std::unordered_map<std::string, int> m_label_to_entry;
+};
+
+}
@@ -2,14 +2,63 @@
 
 #include <mesh_reshaping/reshaping_params.h>
 #include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/linear_system_stats.h>
 
 #include <Eigen/Geometry>
 
+#include <unordered_map>
+#include <vector>
+
 
 namespace reshaping {
 
+// Term groups of the vertex-solve system. The edge length, normal and regularizer
+// rows of an edge share a single stencil (Edges).
+enum class VertexSolveTerms {
+    Edges,
+    Straightness,
+    Sphericity,
+    Constraints,
+    All
+};
+
+// Solves the vertex positions of the current iteration. The sizes and timings of
+// the solved system are written to stats, if given.
 bool solve_for_vertices(const VertexSolveParams& params,
-                        ReshapingData& data,
-                        Eigen::MatrixXd& outV);
+                        ReshapingState& data,
+                        Eigen::MatrixXd& outV,
+                        LinearSystemStats* stats = nullptr);
+
+// Solves the first (iteration 0) vertex solve of several edit operations that
+// constrain the same set of vertices, differing only in their target positions.
+//
+// Before the first transformation solve, the system matrix only depends on which
+// vertices are constrained, so it is assembled and factorized once and all the
+// edits are solved as a single multi-column right-hand side. The right-hand sides
+// of the other edits only recompute their constraint-dependent terms.
+//
+// data must be a state that has not been optimized yet. It is only used as
+// workspace (its bc is overwritten). outV receives the vertices of every edit.
+//
+// Returns false if the edits do not constrain the same vertices or the solve fails.
+bool solve_initial_vertices_for_edits(const VertexSolveParams& params,
+                                      ReshapingState& data,
+                                      const std::vector<std::unordered_map<int, Eigen::Vector3d>>& bcs,
+                                      std::vector<Eigen::MatrixXd>& outV);
+
+// Assembles the vertex-solve normal equations of the current state into
+// data.vertex_AtWA and AtWb, as solve_for_vertices does, without solving them.
+// Returns the number of unknowns. Used by the kernel benchmarks.
+int assemble_vertex_solve_normal_equations(const VertexSolveParams& params,
+                                           ReshapingState& data,
+                                           Eigen::VectorXd& AtWb,
+                                           LinearSystemStats* stats = nullptr);
+
+// Evaluates the stencils of the given terms for the current state (serially),
+// without summing them into a system. Returns the sum of their diagonal and
+// right-hand side entries. Used by the kernel benchmarks.
+double evaluate_vertex_solve_stencils(const VertexSolveParams& params,
+                                      const ReshapingState& data,
+                                      VertexSolveTerms terms);
 
-}
\ No newline at end of file
+}
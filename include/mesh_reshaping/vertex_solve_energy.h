@@ -3,7 +3,7 @@
 #include <mesh_reshaping/reshaping_params.h>
 
 namespace reshaping {
-    struct ReshapingData;
+    struct ReshapingState;
 }
 
 namespace reshaping {
@@ -21,8 +21,12 @@ struct VertexSolveEnergy {
     double total_cost = 0.0;
 };
 
+// Evaluates the vertex-solve energy of the vertices V. The per-edge and
+// sphericity terms are summed on multiple threads if parallel is set (the sum
+// does not depend on it).
 VertexSolveEnergy compute_vertex_solve_energy(const VertexSolveParams& params,
-                                              const ReshapingData& data,
-                                              const Eigen::MatrixXd& V);
+                                              const ReshapingState& data,
+                                              const Eigen::MatrixXd& V,
+                                              bool parallel = true);
 
 }
\ No newline at end of file
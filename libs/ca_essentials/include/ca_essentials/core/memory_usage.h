@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ca_essentials {
+namespace core {
+
+// Peak resident set size (bytes) of the current process, or 0 if not available.
+// It is the peak since the last successful reset_peak_resident_memory() call.
+size_t get_peak_resident_memory();
+
+// Resets the peak resident set size to the current one, so that the peak of a
+// phase can be measured. Only supported on Linux; returns false otherwise.
+bool reset_peak_resident_memory();
+
+}
+}
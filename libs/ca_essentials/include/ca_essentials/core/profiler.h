@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Profiling scopes are compiled in unless CA_ESSENTIALS_PROFILING is defined to 0.
+// Even when compiled in, nothing is recorded until Profiler::set_enabled(true).
+#ifndef CA_ESSENTIALS_PROFILING
+#define CA_ESSENTIALS_PROFILING 1
+#endif
+
+namespace ca_essentials {
+namespace core {
+
+// Time interval of a profiled scope
+struct ProfileEvent {
+    // Scope name (string literal, not owned)
+    const char* name = nullptr;
+
+    // Nanoseconds since the profiler epoch
+    int64_t start_ns = 0;
+    int64_t duration_ns = 0;
+
+    // Number of enclosing scopes in the same thread
+    int depth = 0;
+};
+
+// Events recorded by one thread
+struct ProfileThreadEvents {
+    int thread_id = 0;
+    std::vector<ProfileEvent> events;
+};
+
+// Hierarchical profiler of RAII scopes (see ScopedProfile and CA_PROFILE_SCOPE).
+//
+// Every thread records its events into its own buffer, without locking. Buffers
+// outlive their threads, and are read by collect(), save_chrome_trace(),
+// log_summary() and cleared by clear(), which must not run while profiled code is
+// running in other threads.
+class Profiler {
+public:
+    static void set_enabled(bool enabled) {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool is_enabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Steady clock time (ns) since the profiler epoch
+    static int64_t now_ns();
+
+    // Appends an event to the buffer of the calling thread
+    static void record(const char* name, int64_t start_ns, int64_t end_ns, int depth);
+
+    static std::vector<ProfileThreadEvents> collect();
+    static void clear();
+
+    // Exports the events in the Chrome trace-event format (chrome://tracing, Perfetto)
+    static bool save_chrome_trace(const std::string& fn);
+
+    // Logs the number of calls, total and mean time of every scope name
+    static void log_summary();
+
+private:
+    static inline std::atomic<bool> s_enabled{ false };
+};
+
+namespace detail {
+    // Number of open profiled scopes of the calling thread
+    inline thread_local int profile_depth = 0;
+}
+
+// Records the lifetime of the scope it is declared in (if the profiler is enabled)
+class ScopedProfile {
+public:
+    explicit ScopedProfile(const char* name) {
+        if(Profiler::is_enabled()) {
+            m_name = name;
+            m_depth = detail::profile_depth++;
+            m_start_ns = Profiler::now_ns();
+        }
+    }
+
+    ~ScopedProfile() {
+        if(m_name) {
+            Profiler::record(m_name, m_start_ns, Profiler::now_ns(), m_depth);
+            detail::profile_depth--;
+        }
+    }
+
+    ScopedProfile(const ScopedProfile&) = delete;
+    ScopedProfile& operator=(const ScopedProfile&) = delete;
+
+private:
+    const char* m_name = nullptr;
+    int64_t m_start_ns = 0;
+    int m_depth = 0;
+};
+
+}
+}
+
+#define CA_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CA_PROFILE_CONCAT(a, b) CA_PROFILE_CONCAT_IMPL(a, b)
+
+// Profiles the enclosing scope under name (a string literal)
+#if CA_ESSENTIALS_PROFILING
+#define CA_PROFILE_SCOPE(name) \
+    ::ca_essentials::core::ScopedProfile CA_PROFILE_CONCAT(ca_profile_scope_, __LINE__)(name)
+#else
+#define CA_PROFILE_SCOPE(name) ((void) 0)
+#endif
@@ -23,10 +23,10 @@ public:
         auto curr_time = now();
         const auto itr = m_start_points.find(start_point_id);
 
-        assert(itr != m_start_points.end() &&
-               "Unexpected start point id \"" + start_point_id.c_str() + "\"");
+        assert(itr != m_start_points.end() && "Unexpected start point id");
 
-        return (double) chrono::duration_cast<chrono::milliseconds>(curr_time - itr->second).count();
+        // Milliseconds, with sub-millisecond precision
+        return chrono::duration<double, std::milli>(curr_time - itr->second).count();
     }
 
 private:
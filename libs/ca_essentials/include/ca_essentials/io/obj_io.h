@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <string>
+
+namespace ca_essentials {
+namespace io {
+
+// Fast reader of triangle-mesh OBJ files (vertex positions and triangles only).
+//
+// The file is read at once and parsed in parallel chunks split on line boundaries,
+// using std::from_chars (same values as strtod/scanf). Face corners may use the
+// v/vt/vn syntax and negative indices. Other statements are ignored.
+//
+// Returns false if the file cannot be read or has non-triangular faces, or invalid
+// vertex indices.
+bool load_obj(const std::string& fn,
+              Eigen::MatrixXd& V,
+              Eigen::MatrixXi& F);
+
+// Fast writer of triangle-mesh OBJ files. Rows are formatted in parallel blocks
+// with std::to_chars (shortest representation that reads back the same value) and
+// written with large buffered writes.
+//
+// Returns false if the file cannot be written, or V or F do not have 3 columns.
+bool save_obj(const std::string& fn,
+              const Eigen::MatrixXd& V,
+              const Eigen::MatrixXi& F);
+
+}
+}
@@ -0,0 +1,64 @@
+#include <ca_essentials/core/memory_usage.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#if defined(__linux__)
+#include <fstream>
+#include <string>
+#endif
+
+namespace ca_essentials {
+namespace core {
+
+size_t get_peak_resident_memory() {
+#if defined(__linux__)
+    // VmHWM (unlike ru_maxrss) is reset by reset_peak_resident_memory()
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0)
+            return (size_t) std::stoull(line.substr(6)) * 1024;
+    }
+#endif
+
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return (size_t) counters.PeakWorkingSetSize;
+#elif defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#if defined(__APPLE__)
+    // Bytes on macOS, kilobytes elsewhere
+    return (size_t) usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+bool reset_peak_resident_memory() {
+#if defined(__linux__)
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.close();
+
+    return !clear_refs.fail();
+#else
+    return false;
+#endif
+}
+
+}
+}
@@ -0,0 +1,160 @@
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/logger.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point s_epoch = Clock::now();
+
+// Events recorded by one thread (owned by the registry, so they outlive the thread)
+struct ThreadBuffer {
+    int thread_id = 0;
+    std::vector<ca_essentials::core::ProfileEvent> events;
+};
+
+std::mutex s_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> s_buffers;
+
+// Buffer of the calling thread, registered on first use
+ThreadBuffer& thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+
+    if(!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.reserve(1 << 12);
+
+        std::lock_guard<std::mutex> lock(s_registry_mutex);
+        buffer->thread_id = (int) s_buffers.size();
+        s_buffers.push_back(buffer);
+    }
+
+    return *buffer;
+}
+
+// Writes name as a JSON string
+void write_json_string(std::FILE* out_f, const char* name) {
+    std::fputc('"', out_f);
+    for(const char* c = name; *c; ++c) {
+        if(*c == '"' || *c == '\\')
+            std::fputc('\\', out_f);
+        std::fputc(*c, out_f);
+    }
+    std::fputc('"', out_f);
+}
+
+}
+
+namespace ca_essentials {
+namespace core {
+
+int64_t Profiler::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s_epoch).count();
+}
+
+void Profiler::record(const char* name, int64_t start_ns, int64_t end_ns, int depth) {
+    ProfileEvent event;
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    event.depth = depth;
+
+    thread_buffer().events.push_back(event);
+}
+
+std::vector<ProfileThreadEvents> Profiler::collect() {
+    std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+    std::vector<ProfileThreadEvents> threads;
+    for(const auto& buffer : s_buffers) {
+        if(buffer->events.empty())
+            continue;
+
+        ProfileThreadEvents thread;
+        thread.thread_id = buffer->thread_id;
+        thread.events = buffer->events;
+
+        // Events are recorded when their scope ends: sorting by start time
+        // (enclosing scopes first)
+        std::sort(thread.events.begin(), thread.events.end(),
+                  [](const ProfileEvent& a, const ProfileEvent& b) {
+                      return a.start_ns != b.start_ns ? a.start_ns < b.start_ns : a.depth < b.depth;
+                  });
+
+        threads.push_back(std::move(thread));
+    }
+
+    return threads;
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(s_registry_mutex);
+
+    for(auto& buffer : s_buffers)
+        buffer->events.clear();
+}
+
+bool Profiler::save_chrome_trace(const std::string& fn) {
+    std::FILE* out_f = std::fopen(fn.c_str(), "w");
+    if(!out_f)
+        return false;
+
+    // Complete ("X") events, with times in microseconds
+    std::fprintf(out_f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    bool first = true;
+    for(const auto& thread : collect()) {
+        std::fprintf(out_f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                            "\"args\":{\"name\":\"thread %d\"}}",
+                     first ? "" : ",", thread.thread_id, thread.thread_id);
+        first = false;
+
+        for(const auto& event : thread.events) {
+            std::fprintf(out_f, ",\n{\"name\":");
+            write_json_string(out_f, event.name);
+            std::fprintf(out_f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                         thread.thread_id, event.start_ns / 1000.0, event.duration_ns / 1000.0);
+        }
+    }
+
+    std::fprintf(out_f, "\n]}\n");
+
+    return std::fclose(out_f) == 0;
+}
+
+void Profiler::log_summary() {
+    struct ScopeStats {
+        int64_t count = 0;
+        int64_t total_ns = 0;
+    };
+
+    // Names are literals: the same name may have several addresses
+    std::map<std::string, ScopeStats> stats;
+    for(const auto& thread : collect()) {
+        for(const auto& event : thread.events) {
+            ScopeStats& s = stats[event.name];
+            s.count++;
+            s.total_ns += event.duration_ns;
+        }
+    }
+
+    std::vector<std::pair<std::string, ScopeStats>> sorted(stats.begin(), stats.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.second.total_ns > b.second.total_ns; });
+
+    LOGGER.info("{:<40} {:>8} {:>12} {:>12}", "Profiled scope", "Calls", "Total (ms)", "Mean (us)");
+    for(const auto& [name, s] : sorted) {
+        LOGGER.info("{:<40} {:>8} {:>12.3f} {:>12.3f}",
+                    name, s.count, s.total_ns / 1e6, s.total_ns / 1e3 / s.count);
+    }
+}
+
+}
+}
@@ -0,0 +1,287 @@
+#include <ca_essentials/io/obj_io.h>
+#include <ca_essentials/core/profiler.h>
+
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Files smaller than this are parsed by a single thread
+constexpr size_t MIN_PARALLEL_PARSE_BYTES = 1 << 20;
+
+// Rows formatted by each task of the writer
+constexpr int WRITE_BLOCK_ROWS = 1 << 16;
+
+// Longest formatted row: "v" + 3 x (separator + shortest double, up to 24 chars) + "\n"
+constexpr size_t MAX_ROW_CHARS = 1 + 3 * 25 + 1;
+
+// Room given to std::to_chars for every number
+constexpr size_t MAX_NUMBER_CHARS = 32;
+
+// Vertices and faces parsed from a chunk of the file
+struct ChunkData {
+    std::vector<double> verts;
+    std::vector<int> faces;
+
+    // Face corners with negative (relative) indices: <corner, number of chunk
+    // vertices read before the face>
+    std::vector<std::pair<size_t, int>> relative_corners;
+
+    bool valid = true;
+};
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_blanks(const char* p, const char* end) {
+    while(p < end && is_blank(*p))
+        ++p;
+    return p;
+}
+
+inline const char* skip_token(const char* p, const char* end) {
+    while(p < end && !is_blank(*p) && *p != '\n')
+        ++p;
+    return p;
+}
+
+bool parse_double(const char*& p, const char* end, double& value) {
+    p = skip_blanks(p, end);
+
+    // from_chars does not accept an explicit plus sign
+    if(p < end && *p == '+')
+        ++p;
+
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    if(ec != std::errc())
+        return false;
+
+    p = ptr;
+    return true;
+}
+
+// Parses a vertex line (after "v"): x y z [w ...]
+bool parse_vertex(const char* p, const char* end, ChunkData& chunk) {
+    for(int i = 0; i < 3; ++i) {
+        double coord;
+        if(!parse_double(p, end, coord))
+            return false;
+
+        chunk.verts.push_back(coord);
+    }
+
+    return true;
+}
+
+// Parses a face line (after "f"): v[/vt][/vn] corners, keeping the vertex indices
+bool parse_face(const char* p, const char* end, ChunkData& chunk) {
+    const int num_chunk_verts = (int) chunk.verts.size() / 3;
+
+    int num_corners = 0;
+    while(true) {
+        p = skip_blanks(p, end);
+        if(p == end || *p == '\n')
+            break;
+
+        int idx = 0;
+        auto [ptr, ec] = std::from_chars(p, end, idx);
+        if(ec != std::errc() || idx == 0)
+            return false;
+
+        if(++num_corners > 3)
+            return false;
+
+        if(idx < 0)
+            chunk.relative_corners.emplace_back(chunk.faces.size(), num_chunk_verts);
+
+        chunk.faces.push_back(idx);
+        p = skip_token(ptr, end);
+    }
+
+    return num_corners == 3;
+}
+
+void parse_chunk(const char* begin, const char* end, ChunkData& chunk) {
+    const char* line = begin;
+    while(line < end) {
+        const char* line_end = std::find(line, end, '\n');
+        const char* p = skip_blanks(line, line_end);
+
+        if(line_end - p > 1 && p[0] == 'v' && is_blank(p[1]))
+            chunk.valid = parse_vertex(p + 1, line_end, chunk);
+        else if(line_end - p > 1 && p[0] == 'f' && is_blank(p[1]))
+            chunk.valid = parse_face(p + 1, line_end, chunk);
+
+        if(!chunk.valid)
+            return;
+
+        line = line_end + 1;
+    }
+}
+
+bool read_file(const std::string& fn, std::vector<char>& content) {
+    std::ifstream in_f(fn, std::ios::binary | std::ios::ate);
+    if(!in_f)
+        return false;
+
+    const std::streamsize size = in_f.tellg();
+    in_f.seekg(0);
+
+    content.resize((size_t) size);
+    return (bool) in_f.read(content.data(), size);
+}
+
+template<typename T>
+char* format_number(char* p, T value) {
+    return std::to_chars(p, p + MAX_NUMBER_CHARS, value).ptr;
+}
+
+}
+
+namespace ca_essentials {
+namespace io {
+
+bool load_obj(const std::string& fn,
+              Eigen::MatrixXd& V,
+              Eigen::MatrixXi& F) {
+    CA_PROFILE_SCOPE("io/load_obj");
+
+    std::vector<char> content;
+    if(!read_file(fn, content))
+        return false;
+
+    const char* data = content.data();
+    const size_t size = content.size();
+
+    // Chunks start right after a line break (or at the beginning of the file)
+    size_t num_chunks = 1;
+    if(size >= MIN_PARALLEL_PARSE_BYTES)
+        num_chunks = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    std::vector<size_t> chunk_begin(num_chunks + 1, size);
+    chunk_begin[0] = 0;
+    for(size_t c = 1; c < num_chunks; ++c) {
+        const char* p = std::find(data + std::max(c * size / num_chunks, chunk_begin[c - 1]), data + size, '\n');
+        chunk_begin[c] = std::min((size_t) (p - data) + 1, size);
+    }
+
+    std::vector<ChunkData> chunks(num_chunks);
+    igl::parallel_for((int) num_chunks, [&](int c) {
+        parse_chunk(data + chunk_begin[c], data + chunk_begin[c + 1], chunks[c]);
+    }, 2);
+
+    // Number of vertices before every chunk
+    std::vector<int> vert_offsets(num_chunks + 1, 0);
+    std::vector<int> face_offsets(num_chunks + 1, 0);
+    for(size_t c = 0; c < num_chunks; ++c) {
+        if(!chunks[c].valid)
+            return false;
+
+        vert_offsets[c + 1] = vert_offsets[c] + (int) chunks[c].verts.size() / 3;
+        face_offsets[c + 1] = face_offsets[c] + (int) chunks[c].faces.size() / 3;
+    }
+
+    const int num_verts = vert_offsets.back();
+    const int num_faces = face_offsets.back();
+
+    V.resize(num_verts, 3);
+    F.resize(num_faces, 3);
+
+    std::vector<char> valid_chunks(num_chunks, 1);
+    igl::parallel_for((int) num_chunks, [&](int c) {
+        ChunkData& chunk = chunks[c];
+
+        // OBJ indices are 1-based, or relative to the last vertex read if negative
+        for(const auto& [corner, num_prev_verts] : chunk.relative_corners)
+            chunk.faces[corner] += vert_offsets[c] + num_prev_verts + 1;
+        for(auto& idx : chunk.faces)
+            idx--;
+
+        for(int i = 0; i < (int) chunk.verts.size() / 3; ++i)
+            for(int j = 0; j < 3; ++j)
+                V(vert_offsets[c] + i, j) = chunk.verts[i * 3 + j];
+
+        for(int i = 0; i < (int) chunk.faces.size() / 3; ++i) {
+            for(int j = 0; j < 3; ++j) {
+                const int idx = chunk.faces[i * 3 + j];
+                if(idx < 0 || idx >= num_verts)
+                    valid_chunks[c] = 0;
+
+                F(face_offsets[c] + i, j) = idx;
+            }
+        }
+    }, 2);
+
+    return std::all_of(valid_chunks.begin(), valid_chunks.end(), [](char valid) { return valid; });
+}
+
+bool save_obj(const std::string& fn,
+              const Eigen::MatrixXd& V,
+              const Eigen::MatrixXi& F) {
+    CA_PROFILE_SCOPE("io/save_obj");
+
+    if(V.cols() != 3 || F.cols() != 3)
+        return false;
+
+    std::FILE* out_f = std::fopen(fn.c_str(), "wb");
+    if(!out_f)
+        return false;
+
+    const int num_verts = (int) V.rows();
+    const int num_rows  = num_verts + (int) F.rows();
+    const int num_blocks = (num_rows + WRITE_BLOCK_ROWS - 1) / WRITE_BLOCK_ROWS;
+
+    // Blocks are formatted concurrently, and written in order by groups of as many
+    // blocks as threads (bounding the formatted text kept in memory)
+    const int group_size = std::max<int>(std::thread::hardware_concurrency(), 1);
+    std::vector<std::vector<char>> buffers(std::min(group_size, std::max(num_blocks, 1)));
+
+    bool succ = true;
+    for(int first = 0; first < num_blocks && succ; first += group_size) {
+        const int num_group_blocks = std::min(group_size, num_blocks - first);
+
+        igl::parallel_for(num_group_blocks, [&](int b) {
+            const int row_begin = (first + b) * WRITE_BLOCK_ROWS;
+            const int row_end   = std::min(row_begin + WRITE_BLOCK_ROWS, num_rows);
+
+            std::vector<char>& buffer = buffers[b];
+            buffer.resize((size_t) (row_end - row_begin) * MAX_ROW_CHARS + MAX_NUMBER_CHARS);
+
+            char* p = buffer.data();
+            for(int r = row_begin; r < row_end; ++r) {
+                if(r < num_verts) {
+                    *p++ = 'v';
+                    for(int j = 0; j < 3; ++j) {
+                        *p++ = ' ';
+                        p = format_number(p, V(r, j));
+                    }
+                }
+                else {
+                    *p++ = 'f';
+                    for(int j = 0; j < 3; ++j) {
+                        *p++ = ' ';
+                        p = format_number(p, F(r - num_verts, j) + 1);
+                    }
+                }
+                *p++ = '\n';
+            }
+
+            buffer.resize(p - buffer.data());
+        }, 2);
+
+        for(int b = 0; b < num_group_blocks && succ; ++b)
+            succ = std::fwrite(buffers[b].data(), 1, buffers[b].size(), out_f) == buffers[b].size();
+    }
+
+    return std::fclose(out_f) == 0 && succ;
+}
+
+}
+}
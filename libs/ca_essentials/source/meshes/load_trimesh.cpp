@@ -1,5 +1,6 @@
 #include <ca_essentials/meshes/load_trimesh.h>
 #include <ca_essentials/meshes/normalize_to_unitbox.h>
+#include <ca_essentials/io/obj_io.h>
 #include <ca_essentials/core/logger.h>
 
 #include <igl/readOBJ.h>
@@ -20,8 +21,12 @@ load_trimesh(const std::string& fn, bool normalize) {
     bool succ = false;
 
     std::string ext = fs::path(fn).extension().string();
-    if(ext == ".obj")
-        succ = igl::readOBJ(fn, V, F);
+    if(ext == ".obj") {
+        // Falls back to libigl for the files the fast reader does not support
+        // (e.g. non-triangular faces)
+        succ = io::load_obj(fn, V, F) ||
+               igl::readOBJ(fn, V, F);
+    }
     else if(ext == ".ply")
         succ = igl::readPLY(fn, V, F);
     else
@@ -1,4 +1,5 @@
 #include <ca_essentials/meshes/save_trimesh.h>
+#include <ca_essentials/io/obj_io.h>
 
 #include <igl/writeOBJ.h>
 
@@ -6,12 +7,18 @@ namespace ca_essentials {
 namespace meshes {
 
 bool save_trimesh(const std::string& fn, const TriMesh& mesh) {
-    return igl::writeOBJ(fn, mesh.get_vertices(),
-                             mesh.get_facets());
+    const Eigen::MatrixXd& V = mesh.get_vertices();
+    const Eigen::MatrixXi F  = mesh.get_facets();
+
+    return save_trimesh(fn, V, F);
 }
 
 bool save_trimesh(const std::string& fn,
                   const Eigen::MatrixXd& V, const Eigen::MatrixXi& F) {
+    // Non-triangular meshes are written by libigl
+    if(V.cols() == 3 && F.cols() == 3)
+        return io::save_obj(fn, V, F);
+
     return igl::writeOBJ(fn, V, F);
 }
 
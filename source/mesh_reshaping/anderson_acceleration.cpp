@@ -0,0 +1,54 @@
+#include <mesh_reshaping/anderson_acceleration.h>
+
+#include <Eigen/QR>
+
+#include <algorithm>
+
+namespace reshaping {
+
+void AndersonAcceleration::init(int history_size, const Eigen::VectorXd& x0) {
+    m_history_size = std::max(history_size, 1);
+
+    m_dF.resize(x0.size(), m_history_size);
+    m_dG.resize(x0.size(), m_history_size);
+
+    reset(x0);
+}
+
+void AndersonAcceleration::reset(const Eigen::VectorXd& x) {
+    m_num_cols = 0;
+    m_next_col = 0;
+    m_has_prev = false;
+
+    m_x = x;
+}
+
+const Eigen::VectorXd& AndersonAcceleration::compute(const Eigen::VectorXd& g) {
+    const Eigen::VectorXd f = g - m_x;
+
+    if(!m_has_prev) {
+        // Plain fixed-point step
+        m_x = g;
+    }
+    else {
+        // Stores the newest differences, overwriting the oldest ones
+        m_dF.col(m_next_col) = f - m_prev_f;
+        m_dG.col(m_next_col) = g - m_prev_g;
+
+        m_num_cols = std::min(m_num_cols + 1, m_history_size);
+        m_next_col = (m_next_col + 1) % m_history_size;
+
+        // The mixing does not depend on the column order, so the circular
+        // history is used as is
+        const Eigen::VectorXd gamma = m_dF.leftCols(m_num_cols).colPivHouseholderQr().solve(f);
+        m_x = g - m_dG.leftCols(m_num_cols) * gamma;
+    }
+
+    m_prev_f = f;
+    m_prev_g = g;
+    m_has_prev = true;
+
+    return m_x;
+}
+
+}
@@ -0,0 +1,95 @@
+#include <mesh_reshaping/async_output_writer.h>
+
+#include <mesh_reshaping/globals.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace reshaping {
+
+AsyncOutputWriter::AsyncOutputWriter(int max_pending_jobs)
+: m_max_pending_jobs(std::max(max_pending_jobs, 1)) {
+    m_worker = std::thread(&AsyncOutputWriter::worker_loop, this);
+}
+
+AsyncOutputWriter::~AsyncOutputWriter() {
+    flush();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_added.notify_one();
+
+    m_worker.join();
+}
+
+void AsyncOutputWriter::push(std::unique_ptr<JobBase> job) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Back-pressure: the producer waits for the writer to catch up
+    m_job_done.wait(lock, [this]() { return (int) m_jobs.size() < m_max_pending_jobs; });
+
+    m_jobs.push_back(std::move(job));
+    lock.unlock();
+
+    m_job_added.notify_one();
+}
+
+bool AsyncOutputWriter::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_done.wait(lock, [this]() { return m_jobs.empty() && !m_running_job; });
+
+    if(m_failed_jobs.empty())
+        return true;
+
+    for(const auto& name : m_failed_jobs)
+        LOGGER.error("Output job \"{}\" failed", name);
+    LOGGER.error("{} output jobs failed", m_failed_jobs.size());
+
+    m_failed_jobs.clear();
+    return false;
+}
+
+int AsyncOutputWriter::num_pending_jobs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int) m_jobs.size() + (m_running_job ? 1 : 0);
+}
+
+void AsyncOutputWriter::worker_loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(true) {
+        m_job_added.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+        if(m_jobs.empty())
+            return;
+
+        std::unique_ptr<JobBase> job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_running_job = true;
+        lock.unlock();
+
+        // A slot is free again
+        m_job_done.notify_all();
+
+        bool succ = false;
+        try {
+            succ = job->run();
+        } catch(const std::exception& e) {
+            LOGGER.error("Output job \"{}\": {}", job->name, e.what());
+        }
+
+        // Releasing the job data outside the lock
+        const std::string name = job->name;
+        job.reset();
+
+        lock.lock();
+        m_running_job = false;
+        if(!succ)
+            m_failed_jobs.push_back(name);
+
+        m_job_done.notify_all();
+    }
+}
+
+}
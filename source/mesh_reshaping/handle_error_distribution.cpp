@@ -6,6 +6,7 @@
 
 #include <ca_essentials/core/logger.h>
 #include <ca_essentials/io/saveOBJ.h>
+#include <ca_essentials/meshes/save_trimesh.h>
 
 #include <igl/per_face_normals.h>
 
@@ -290,7 +291,7 @@ namespace
 
     // Prepares reshaping data for a vertex solve step enabling handle error distribution
     bool prepare_data_for_handle_error_distribution(const reshaping::ReshapingParams &params,
-                                                    reshaping::ReshapingData &data)
+                                                    reshaping::ReshapingState &data)
     {
         const auto &mesh = data.mesh;
         const Eigen::MatrixXi &F = mesh.get_facets();
@@ -300,7 +301,7 @@ namespace
 
         auto zones_info = compute_distribution_zone_info(mesh,
                                                          data.bc,
-                                                         data.orig_tri_N,
+                                                         data.orig_tri_N(),
                                                          curr_tri_N,
                                                          params.vertex_sol.handle_error_distrib);
 
@@ -316,6 +317,12 @@ namespace
         // Preparing input data
         //////////////////////////////////////////
 
+        // Retargeted edges and normals are written to the state's own copy, leaving
+        // the shared context untouched
+        Eigen::MatrixXd &orig_edges = data.mutable_orig_edges();
+        Eigen::VectorXd &orig_edge_lens = data.mutable_orig_edge_lens();
+        Eigen::MatrixXd &orig_tri_N = data.mutable_orig_tri_N();
+
         // off-zone edges: target edges are defined as the ones from reshaping call output
         for (int eid : zones_info.off_zone_edges)
         {
@@ -324,13 +331,13 @@ namespace
             Eigen::Vector3d curr_E = data.curr_vertices.row(edge_verts[1]) -
                                      data.curr_vertices.row(edge_verts[0]);
 
-            data.orig_edges.row(eid) = curr_E;
-            data.orig_edge_lens(eid) = curr_E.norm();
+            orig_edges.row(eid) = curr_E;
+            orig_edge_lens(eid) = curr_E.norm();
         }
 
         // off-zone tris: target face normals are defined as the ones from reshaping call output
         for (int fid : zones_info.off_zone_tris)
-            data.orig_tri_N.row(fid) = curr_tri_N.row(fid);
+            orig_tri_N.row(fid) = curr_tri_N.row(fid);
 
         // off-zone tris: target transformations are defined as identity
         for (int fid : zones_info.off_zone_tris)
@@ -338,7 +345,7 @@ namespace
 
         // on-zone edges: target lengths are defined as the original ones
         for (int eid : zones_info.in_zone_edges)
-            data.target_edge_lens(eid) = data.orig_edge_lens(eid);
+            data.target_edge_lens(eid) = orig_edge_lens(eid);
 
         // on-zone tris: target normals are interpolated between original and output ones
         for (const auto [fid, ring_i] : zones_info.face_to_ring)
@@ -349,11 +356,11 @@ namespace
             // Factor of the new normal
             double f = (ring_i - 1) * (1.0 / params.vertex_sol.handle_error_distrib.num_rings);
 
-            const Eigen::Vector3d &orig_N = data.orig_tri_N.row(fid);
+            const Eigen::Vector3d &orig_N = orig_tri_N.row(fid);
             const Eigen::Vector3d &curr_N = curr_tri_N.row(fid);
 
             Eigen::Vector3d mix_N = (f * curr_N + (1.0 - f) * orig_N).normalized();
-            data.orig_tri_N.row(fid) = mix_N;
+            orig_tri_N.row(fid) = mix_N;
         }
 
         // Define the set of all vertices (outside rings) that need to held in place
@@ -370,7 +377,7 @@ namespace reshaping
 {
 
     void perform_handle_error_distribution(const ReshapingParams &params,
-                                           ReshapingData &data,
+                                           ReshapingState &data,
                                            Eigen::MatrixXd &V)
     {
         const auto &mesh = data.mesh;
@@ -381,14 +388,13 @@ namespace reshaping
         if (!prepare_data_for_handle_error_distribution(params, data))
             return;
 
-#if !OPTIMIZED_VERSION_ON
+        if (params.iter_history == IterationHistory::FULL && !params.debug_folder.empty())
         {
-            auto fn = m_params->debug_folder / (params.input_name + "_before_dimples_fix.obj");
+            auto fn = params.debug_folder / (params.input_name + "_before_dimples_fix.obj");
             ca_essentials::meshes::save_trimesh(fn.string(),
                                                 data.curr_vertices,
                                                 mesh.get_facets());
         }
-#endif
 
         LOGGER.debug("Performing dimple fix");
 
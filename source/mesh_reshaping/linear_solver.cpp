@@ -0,0 +1,276 @@
+#include <mesh_reshaping/linear_solver.h>
+
+#include <ca_essentials/core/logger.h>
+
+#include <Eigen/IterativeLinearSolvers>
+#include <Eigen/OrderingMethods>
+
+#if RESHAPING_WITH_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
+
+#if RESHAPING_WITH_METIS
+#include <Eigen/MetisSupport>
+#endif
+
+#include <mutex>
+
+namespace {
+
+using SparseMatrix = Eigen::SparseMatrix<double>;
+
+// Non-zeros of the L factor of Eigen's simplicial solvers, diagonal included
+// (SimplicialLDLT stores a unit L, without its diagonal)
+template<typename Ordering>
+int64_t factor_nonzeros(const Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, Ordering>& solver) {
+    return (int64_t) solver.matrixL().nestedExpression().nonZeros();
+}
+
+template<typename Ordering>
+int64_t factor_nonzeros(const Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Ordering>& solver) {
+    return (int64_t) solver.matrixL().nestedExpression().nonZeros() + solver.rows();
+}
+
+// Wraps Eigen's direct sparse solvers
+template<typename Solver>
+class EigenDirectBackend : public reshaping::LinearSolverBackend {
+public:
+    explicit EigenDirectBackend(std::string name)
+    : m_name(std::move(name)) {
+
+    }
+
+    std::string name() const override { return m_name; }
+
+    bool analyze_pattern(const SparseMatrix& A) override {
+        m_solver.analyzePattern(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool factorize(const SparseMatrix& A) override {
+        m_solver.factorize(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool solve(const Eigen::VectorXd& b, Eigen::VectorXd& x) const override {
+        x = m_solver.solve(b);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool solve_multiple(const Eigen::MatrixXd& B, Eigen::MatrixXd& X) const override {
+        X = m_solver.solve(B);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    int64_t factor_nonzeros() const override {
+        return m_solver.info() == Eigen::Success ? ::factor_nonzeros(m_solver) : -1;
+    }
+
+private:
+    std::string m_name;
+    Solver m_solver;
+};
+
+template<typename Ordering>
+class ConjugateGradientBackend : public reshaping::LinearSolverBackend {
+public:
+    ConjugateGradientBackend(std::string name, const reshaping::LinearSolverParams& params)
+    : m_name(std::move(name)) {
+        m_solver.setTolerance(params.cg_tolerance);
+        if(params.cg_max_iters > 0)
+            m_solver.setMaxIterations(params.cg_max_iters);
+    }
+
+    std::string name() const override { return m_name; }
+
+    bool is_iterative() const override { return true; }
+
+    bool analyze_pattern(const SparseMatrix& A) override {
+        m_solver.analyzePattern(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool factorize(const SparseMatrix& A) override {
+        m_solver.factorize(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    // Eigen's solver records the status of the last solve, so concurrent solves
+    // are serialized
+    bool solve(const Eigen::VectorXd& b, Eigen::VectorXd& x) const override {
+        std::lock_guard<std::mutex> lock(m_solve_mutex);
+
+        if(x.size() != b.size())
+            x.setZero(b.size());
+
+        x = m_solver.solveWithGuess(b, x);
+
+        if(m_solver.info() == Eigen::NoConvergence) {
+            LOGGER.warn("Conjugate gradient stopped after {} iterations (error {:.3e})",
+                        m_solver.iterations(), m_solver.error());
+        }
+
+        return m_solver.info() == Eigen::Success;
+    }
+
+    int64_t factor_nonzeros() const override {
+        return (int64_t) m_solver.preconditioner().matrixL().nonZeros();
+    }
+
+private:
+    using Preconditioner = Eigen::IncompleteCholesky<double, Eigen::Lower, Ordering>;
+
+    std::string m_name;
+    Eigen::ConjugateGradient<SparseMatrix, Eigen::Lower | Eigen::Upper, Preconditioner> m_solver;
+    mutable std::mutex m_solve_mutex;
+};
+
+#if RESHAPING_WITH_CHOLMOD
+class CholmodSupernodalBackend : public reshaping::LinearSolverBackend {
+public:
+    CholmodSupernodalBackend(std::string name, reshaping::FillReducingOrdering ordering)
+    : m_name(std::move(name)) {
+        cholmod_common& c = m_solver.cholmod();
+        c.nmethods = 1;
+
+        switch(ordering) {
+            case reshaping::FillReducingOrdering::AMD:
+                c.method[0].ordering = CHOLMOD_AMD;
+                break;
+            case reshaping::FillReducingOrdering::COLAMD:
+                c.method[0].ordering = CHOLMOD_COLAMD;
+                break;
+            case reshaping::FillReducingOrdering::NESTED_DISSECTION:
+                c.method[0].ordering = CHOLMOD_METIS;
+                break;
+        }
+    }
+
+    std::string name() const override { return m_name; }
+
+    bool analyze_pattern(const SparseMatrix& A) override {
+        m_solver.analyzePattern(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool factorize(const SparseMatrix& A) override {
+        m_solver.factorize(A);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    // CHOLMOD reuses its workspace while solving, so concurrent solves are serialized
+    bool solve(const Eigen::VectorXd& b, Eigen::VectorXd& x) const override {
+        std::lock_guard<std::mutex> lock(m_solve_mutex);
+
+        x = m_solver.solve(b);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    bool solve_multiple(const Eigen::MatrixXd& B, Eigen::MatrixXd& X) const override {
+        std::lock_guard<std::mutex> lock(m_solve_mutex);
+
+        X = m_solver.solve(B);
+        return m_solver.info() == Eigen::Success;
+    }
+
+    int64_t factor_nonzeros() const override {
+        return m_solver.factor_nonzeros();
+    }
+
+private:
+    // Exposes the factor kept by Eigen's wrapper
+    struct Solver : Eigen::CholmodSupernodalLLT<SparseMatrix, Eigen::Lower> {
+        // Stored entries of the factor (supernodes include explicit zeros)
+        int64_t factor_nonzeros() const {
+            if(!m_cholmodFactor || !m_factorizationIsOk)
+                return -1;
+
+            return (int64_t) (m_cholmodFactor->is_super ? m_cholmodFactor->xsize
+                                                        : m_cholmodFactor->nzmax);
+        }
+    };
+
+    std::string m_name;
+    Solver m_solver;
+    mutable std::mutex m_solve_mutex;
+};
+#endif
+
+template<typename Ordering>
+using SimplicialLDLT = Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Ordering>;
+
+template<typename Ordering>
+using SimplicialLLT = Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, Ordering>;
+
+// Instantiates a simplicial solver with the requested fill-reducing ordering
+template<template<typename> class Solver>
+std::unique_ptr<reshaping::LinearSolverBackend>
+make_simplicial_backend(const std::string& name, reshaping::FillReducingOrdering ordering) {
+    using Ordering = reshaping::FillReducingOrdering;
+
+    switch(ordering) {
+        case Ordering::COLAMD:
+            return std::make_unique<EigenDirectBackend<Solver<Eigen::COLAMDOrdering<int>>>>(name + " (COLAMD)");
+
+        case Ordering::NESTED_DISSECTION:
+#if RESHAPING_WITH_METIS
+            return std::make_unique<EigenDirectBackend<Solver<Eigen::MetisOrdering<int>>>>(name + " (METIS)");
+#else
+            LOGGER.warn("Nested dissection ordering requires METIS. Using AMD instead");
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    return std::make_unique<EigenDirectBackend<Solver<Eigen::AMDOrdering<int>>>>(name + " (AMD)");
+}
+
+}
+
+namespace reshaping {
+
+bool LinearSolverBackend::solve_multiple(const Eigen::MatrixXd& B, Eigen::MatrixXd& X) const {
+    X.setZero(B.rows(), B.cols());
+
+    for(int c = 0; c < (int) B.cols(); ++c) {
+        Eigen::VectorXd x = X.col(c);
+        if(!solve(B.col(c), x))
+            return false;
+
+        X.col(c) = x;
+    }
+
+    return true;
+}
+
+std::unique_ptr<LinearSolverBackend> make_linear_solver(const LinearSolverParams& params) {
+    switch(params.type) {
+        case LinearSolverType::SIMPLICIAL_LLT:
+            return make_simplicial_backend<SimplicialLLT>("SimplicialLLT", params.ordering);
+
+        case LinearSolverType::SUPERNODAL_CHOLESKY:
+#if RESHAPING_WITH_CHOLMOD
+            return std::make_unique<CholmodSupernodalBackend>("CHOLMOD supernodal", params.ordering);
+#else
+            LOGGER.warn("Supernodal Cholesky requires CHOLMOD. Using SimplicialLDLT instead");
+            break;
+#endif
+
+        case LinearSolverType::CONJUGATE_GRADIENT:
+            // The incomplete Cholesky preconditioner only supports symmetric orderings
+            if(params.ordering != FillReducingOrdering::AMD)
+                LOGGER.warn("Conjugate gradient preconditioner only supports AMD ordering");
+
+            return std::make_unique<ConjugateGradientBackend<Eigen::AMDOrdering<int>>>(
+                "ConjugateGradient (IC, AMD)", params);
+
+        default:
+            break;
+    }
+
+    return make_simplicial_backend<SimplicialLDLT>("SimplicialLDLT", params.ordering);
+}
+
+}
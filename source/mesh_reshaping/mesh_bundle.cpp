@@ -0,0 +1,574 @@
+#include <mesh_reshaping/mesh_bundle.h>
+
+#include <mesh_reshaping/data_filenames.h>
+#include <mesh_reshaping/face_principal_curvatures_io.h>
+
+#include <ca_essentials/meshes/load_trimesh.h>
+#include <ca_essentials/meshes/save_trimesh.h>
+#include <ca_essentials/meshes/normalize_to_unitbox.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char BUNDLE_MAGIC[4] = { 'R', 'S', 'H', 'B' };
+constexpr uint32_t BUNDLE_VERSION = 1;
+
+// Written as is: a bundle saved on a machine with another byte order is rejected
+constexpr uint32_t BUNDLE_BYTE_ORDER = 0x01020304;
+
+// Alignment of every section payload
+constexpr int64_t SECTION_ALIGNMENT = 64;
+
+enum SectionType {
+    VERTICES = 0,       // double, num_vertices x 3 (column-major)
+    FACETS,             // int32, num_faces x 3 (column-major)
+    FACE_CURVATURES,    // double, num_faces x 2 (column-major: k1, k2)
+    CHAIN_OFFSETS,      // int32, num_chains + 1
+    CHAIN_VERTICES,     // int32
+    EDIT_OFFSETS,       // int32, num_edits + 1
+    EDIT_VERTICES,      // int32
+    EDIT_DISPLACEMENTS, // double, num_edit_vertices x 3 (row-major)
+    EDIT_LABEL_OFFSETS, // int32, num_edits + 1
+    EDIT_LABELS,        // char
+    CAMERAS,            // char (camera file content)
+    NUM_SECTION_TYPES
+};
+
+// Element size and number of columns of every section type
+constexpr int64_t SECTION_ELEM_SIZE[NUM_SECTION_TYPES] = { 8, 4, 8, 4, 4, 4, 4, 8, 4, 1, 1 };
+constexpr int64_t SECTION_NUM_COLS[NUM_SECTION_TYPES]  = { 3, 3, 2, 1, 1, 1, 1, 3, 1, 1, 1 };
+
+struct BundleHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_sections;
+};
+
+struct SectionEntry {
+    uint32_t type;
+    uint32_t reserved;
+    int64_t offset;
+    int64_t size;
+
+    // Number of rows
+    int64_t count;
+};
+
+// Section payload being written
+struct SectionBuffer {
+    int type = 0;
+    int64_t count = 0;
+    std::vector<char> bytes;
+};
+
+template<typename T>
+SectionBuffer make_section(int type, const T* values, int64_t count) {
+    SectionBuffer section;
+    section.type  = type;
+    section.count = count;
+
+    const char* begin = reinterpret_cast<const char*>(values);
+    section.bytes.assign(begin, begin + count * SECTION_NUM_COLS[type] * sizeof(T));
+
+    return section;
+}
+
+int64_t align_offset(int64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// True if offsets (count + 1 entries) are non-decreasing, starting at 0 and ending
+// at num_values
+bool check_offsets(const int32_t* offsets, int64_t count, int64_t num_values) {
+    if(count == 0)
+        return num_values == 0;
+
+    if(offsets[0] != 0 || offsets[count - 1] != num_values)
+        return false;
+
+    for(int64_t i = 1; i < count; ++i)
+        if(offsets[i] < offsets[i - 1])
+            return false;
+
+    return true;
+}
+
+// True if all the count indices are in [0, num_elems)
+bool check_indices(const int32_t* indices, int64_t count, int64_t num_elems) {
+    for(int64_t i = 0; i < count; ++i)
+        if(indices[i] < 0 || indices[i] >= num_elems)
+            return false;
+
+    return true;
+}
+
+std::string read_text_file(const std::string& fn) {
+    std::ifstream in_f(fn, std::ios::binary);
+
+    std::ostringstream content;
+    content << in_f.rdbuf();
+
+    return content.str();
+}
+
+}
+
+namespace reshaping {
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    ~MappedFile() {
+#ifdef _WIN32
+        if(m_data)
+            UnmapViewOfFile(m_data);
+        if(m_mapping)
+            CloseHandle(m_mapping);
+        if(m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if(m_data)
+            munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+
+    bool open(const std::string& fn) {
+#ifdef _WIN32
+        m_file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(m_file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+            return false;
+        m_size = (size_t) size.QuadPart;
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!m_mapping)
+            return false;
+
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        return m_data != nullptr;
+#else
+        int fd = ::open(fn.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        m_size = (size_t) st.st_size;
+
+        // The mapping stays valid once the descriptor is closed
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if(data == MAP_FAILED)
+            return false;
+
+        m_data = static_cast<const char*>(data);
+        return true;
+#endif
+    }
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+bool load_mesh_asset_files(const std::string& mesh_fn, MeshAssetData& asset) {
+    namespace fs = std::filesystem;
+    namespace meshes = ca_essentials::meshes;
+
+    auto mesh = meshes::load_trimesh(mesh_fn, false);
+    if(!mesh)
+        return false;
+
+    asset.V = mesh->get_vertices();
+    asset.F = mesh->get_facets();
+
+    const std::string fk_fn = get_curvature_fn(mesh_fn);
+    if(fs::exists(fk_fn) && !load_face_principal_curvature_values(fk_fn, asset.PV1, asset.PV2))
+        return false;
+
+    const std::string straight_fn = get_straightness_fn(mesh_fn);
+    if(fs::exists(straight_fn) && !asset.straight_chains.load_from_file(straight_fn)) {
+        LOGGER.error("Error while loading straightness information from {}", straight_fn);
+        return false;
+    }
+
+    const std::string edit_op_fn = get_edit_operation_fn(mesh_fn);
+    if(fs::exists(edit_op_fn) && !load_edit_operations_from_json(edit_op_fn, asset.edit_ops)) {
+        LOGGER.error("Error while loading edit operations from {}", edit_op_fn);
+        return false;
+    }
+
+    const std::string camera_fn = get_camera_fn(mesh_fn);
+    if(fs::exists(camera_fn))
+        asset.cameras_json = read_text_file(camera_fn);
+
+    return true;
+}
+
+bool save_mesh_asset_files(const std::string& mesh_fn, const MeshAssetData& asset) {
+    namespace meshes = ca_essentials::meshes;
+
+    if(!meshes::save_trimesh(mesh_fn, asset.V, asset.F)) {
+        LOGGER.error("Error while saving mesh to {}", mesh_fn);
+        return false;
+    }
+
+    if(asset.PV1.size() > 0 &&
+       !save_face_principal_curvature_values(get_curvature_fn(mesh_fn), asset.PV1, asset.PV2))
+        return false;
+
+    if(asset.straight_chains.num_chains() > 0) {
+        StraightChains chains = asset.straight_chains;
+        if(!chains.save_to_file(get_straightness_fn(mesh_fn))) {
+            LOGGER.error("Error while saving straightness information to {}", get_straightness_fn(mesh_fn));
+            return false;
+        }
+    }
+
+    if(!asset.edit_ops.empty() &&
+       !write_edit_operations_to_json(asset.edit_ops, get_edit_operation_fn(mesh_fn)))
+        return false;
+
+    if(!asset.cameras_json.empty()) {
+        std::ofstream out_f(get_camera_fn(mesh_fn), std::ios::binary);
+        out_f << asset.cameras_json;
+
+        if(!out_f) {
+            LOGGER.error("Error while saving cameras to {}", get_camera_fn(mesh_fn));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool save_mesh_bundle(const std::string& fn, const MeshAssetData& asset) {
+    std::vector<SectionBuffer> sections;
+
+    const Eigen::MatrixXd V = asset.V;
+    const Eigen::MatrixXi F = asset.F;
+    sections.push_back(make_section(VERTICES, V.data(), V.rows()));
+    sections.push_back(make_section(FACETS, F.data(), F.rows()));
+
+    if(asset.PV1.size() > 0) {
+        Eigen::MatrixXd PV(asset.PV1.size(), 2);
+        PV << asset.PV1, asset.PV2;
+        sections.push_back(make_section(FACE_CURVATURES, PV.data(), PV.rows()));
+    }
+
+    // Straight chains
+    {
+        std::vector<int32_t> offsets(1, 0);
+        std::vector<int32_t> vids;
+        for(int c = 0; c < asset.straight_chains.num_chains(); ++c) {
+            const auto& chain = asset.straight_chains.get_chain(c);
+            vids.insert(vids.end(), chain.begin(), chain.end());
+            offsets.push_back((int32_t) vids.size());
+        }
+
+        sections.push_back(make_section(CHAIN_OFFSETS, offsets.data(), (int64_t) offsets.size()));
+        sections.push_back(make_section(CHAIN_VERTICES, vids.data(), (int64_t) vids.size()));
+    }
+
+    // Edit operations (handle vertices in increasing order)
+    {
+        std::vector<int32_t> offsets(1, 0);
+        std::vector<int32_t> vids;
+        std::vector<double> disps;
+        std::vector<int32_t> label_offsets(1, 0);
+        std::string labels;
+        for(const auto& edit_op : asset.edit_ops) {
+            std::vector<int> edit_vids;
+            for(const auto& [vid, disp] : edit_op.displacements)
+                edit_vids.push_back(vid);
+            std::sort(edit_vids.begin(), edit_vids.end());
+
+            for(int vid : edit_vids) {
+                const Eigen::Vector3d& disp = edit_op.displacements.at(vid);
+                vids.push_back(vid);
+                disps.insert(disps.end(), disp.data(), disp.data() + 3);
+            }
+            offsets.push_back((int32_t) vids.size());
+
+            labels += edit_op.label;
+            label_offsets.push_back((int32_t) labels.size());
+        }
+
+        sections.push_back(make_section(EDIT_OFFSETS, offsets.data(), (int64_t) offsets.size()));
+        sections.push_back(make_section(EDIT_VERTICES, vids.data(), (int64_t) vids.size()));
+        sections.push_back(make_section(EDIT_DISPLACEMENTS, disps.data(), (int64_t) vids.size()));
+        sections.push_back(make_section(EDIT_LABEL_OFFSETS, label_offsets.data(), (int64_t) label_offsets.size()));
+        sections.push_back(make_section(EDIT_LABELS, labels.data(), (int64_t) labels.size()));
+    }
+
+    sections.push_back(make_section(CAMERAS, asset.cameras_json.data(), (int64_t) asset.cameras_json.size()));
+
+    // Header and section table, followed by the aligned payloads
+    BundleHeader header;
+    std::copy(BUNDLE_MAGIC, BUNDLE_MAGIC + 4, header.magic);
+    header.version      = BUNDLE_VERSION;
+    header.byte_order   = BUNDLE_BYTE_ORDER;
+    header.num_sections = (uint32_t) sections.size();
+
+    std::vector<SectionEntry> entries;
+    int64_t offset = sizeof(BundleHeader) + sizeof(SectionEntry) * sections.size();
+    for(const auto& section : sections) {
+        offset = align_offset(offset);
+
+        SectionEntry entry;
+        entry.type     = (uint32_t) section.type;
+        entry.reserved = 0;
+        entry.offset   = offset;
+        entry.size     = (int64_t) section.bytes.size();
+        entry.count    = section.count;
+        entries.push_back(entry);
+
+        offset += entry.size;
+    }
+
+    std::ofstream out_f(fn, std::ios::binary);
+    if(!out_f) {
+        LOGGER.error("Error while saving mesh bundle to {}", fn);
+        return false;
+    }
+
+    out_f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_f.write(reinterpret_cast<const char*>(entries.data()), sizeof(SectionEntry) * entries.size());
+
+    int64_t pos = sizeof(BundleHeader) + sizeof(SectionEntry) * entries.size();
+    const char padding[SECTION_ALIGNMENT] = {};
+    for(int s = 0; s < (int) sections.size(); ++s) {
+        out_f.write(padding, entries.at(s).offset - pos);
+        out_f.write(sections.at(s).bytes.data(), entries.at(s).size);
+
+        pos = entries.at(s).offset + entries.at(s).size;
+    }
+
+    if(!out_f) {
+        LOGGER.error("Error while saving mesh bundle to {}", fn);
+        return false;
+    }
+
+    LOGGER.info("Mesh bundle saved to {}", fn);
+    return true;
+}
+
+MeshBundle::~MeshBundle() = default;
+
+std::unique_ptr<MeshBundle> MeshBundle::open(const std::string& fn) {
+    std::unique_ptr<MeshBundle> bundle(new MeshBundle());
+
+    bundle->m_file = std::make_unique<MappedFile>();
+    if(!bundle->m_file->open(fn)) {
+        LOGGER.error("Could not map mesh bundle {}", fn);
+        return nullptr;
+    }
+
+    const char* data = bundle->m_file->data();
+    const int64_t file_size = (int64_t) bundle->m_file->size();
+
+    auto invalid = [&fn](const std::string& reason) {
+        LOGGER.error("Invalid mesh bundle {}: {}", fn, reason);
+        return nullptr;
+    };
+
+    BundleHeader header;
+    if(file_size < (int64_t) sizeof(header))
+        return invalid("truncated header");
+
+    std::memcpy(&header, data, sizeof(header));
+    if(!std::equal(BUNDLE_MAGIC, BUNDLE_MAGIC + 4, header.magic))
+        return invalid("not a mesh bundle");
+    if(header.version != BUNDLE_VERSION)
+        return invalid("unsupported version " + std::to_string(header.version));
+    if(header.byte_order != BUNDLE_BYTE_ORDER)
+        return invalid("unsupported byte order");
+
+    const int64_t table_end = sizeof(header) + sizeof(SectionEntry) * (int64_t) header.num_sections;
+    if(file_size < table_end)
+        return invalid("truncated section table");
+
+    bundle->m_sections.resize(NUM_SECTION_TYPES);
+    for(uint32_t s = 0; s < header.num_sections; ++s) {
+        SectionEntry entry;
+        std::memcpy(&entry, data + sizeof(header) + sizeof(SectionEntry) * s, sizeof(entry));
+
+        // Unknown sections are skipped
+        if(entry.type >= NUM_SECTION_TYPES)
+            continue;
+
+        // Sizes are compared against the file size first so that they cannot overflow
+        const int64_t row_size = SECTION_NUM_COLS[entry.type] * SECTION_ELEM_SIZE[entry.type];
+        if(entry.offset % SECTION_ALIGNMENT != 0 || entry.offset < table_end ||
+           entry.offset > file_size || entry.count < 0 || entry.count > file_size / row_size ||
+           entry.size != entry.count * row_size || entry.size > file_size - entry.offset)
+            return invalid("corrupted section " + std::to_string(entry.type));
+
+        Section& section = bundle->m_sections.at(entry.type);
+        section.data  = data + entry.offset;
+        section.size  = entry.size;
+        section.count = entry.count;
+    }
+
+    // Array sizes and offsets
+    const auto& sections = bundle->m_sections;
+    if(sections.at(VERTICES).count == 0 || sections.at(FACETS).count == 0)
+        return invalid("missing mesh");
+
+    const int64_t num_verts = sections.at(VERTICES).count;
+    const int64_t num_faces = sections.at(FACETS).count;
+    if(num_verts > std::numeric_limits<int32_t>::max())
+        return invalid("too many vertices");
+    if(!check_indices(bundle->section_data<int32_t>(FACETS), 3 * num_faces, num_verts))
+        return invalid("face vertex index out of range");
+
+    if(sections.at(FACE_CURVATURES).count != 0 && sections.at(FACE_CURVATURES).count != num_faces)
+        return invalid("curvature values do not match the number of faces");
+
+    const int64_t num_edit_offsets = sections.at(EDIT_OFFSETS).count;
+    if(!check_offsets(bundle->section_data<int32_t>(CHAIN_OFFSETS), sections.at(CHAIN_OFFSETS).count,
+                      sections.at(CHAIN_VERTICES).count) ||
+       !check_offsets(bundle->section_data<int32_t>(EDIT_OFFSETS), num_edit_offsets,
+                      sections.at(EDIT_VERTICES).count) ||
+       !check_offsets(bundle->section_data<int32_t>(EDIT_LABEL_OFFSETS), sections.at(EDIT_LABEL_OFFSETS).count,
+                      sections.at(EDIT_LABELS).count) ||
+       sections.at(EDIT_LABEL_OFFSETS).count != num_edit_offsets ||
+       sections.at(EDIT_DISPLACEMENTS).count != sections.at(EDIT_VERTICES).count)
+        return invalid("corrupted chains or edit operations");
+
+    if(!check_indices(bundle->section_data<int32_t>(CHAIN_VERTICES), sections.at(CHAIN_VERTICES).count,
+                      num_verts) ||
+       !check_indices(bundle->section_data<int32_t>(EDIT_VERTICES), sections.at(EDIT_VERTICES).count,
+                      num_verts))
+        return invalid("chain or edit vertex index out of range");
+
+    return bundle;
+}
+
+Eigen::Map<const Eigen::MatrixXd> MeshBundle::vertices() const {
+    return { section_data<double>(VERTICES), (Eigen::Index) m_sections.at(VERTICES).count, 3 };
+}
+
+Eigen::Map<const Eigen::MatrixXi> MeshBundle::facets() const {
+    return { section_data<int>(FACETS), (Eigen::Index) m_sections.at(FACETS).count, 3 };
+}
+
+Eigen::Map<const Eigen::VectorXd> MeshBundle::face_k1() const {
+    return { section_data<double>(FACE_CURVATURES), (Eigen::Index) m_sections.at(FACE_CURVATURES).count };
+}
+
+Eigen::Map<const Eigen::VectorXd> MeshBundle::face_k2() const {
+    const Eigen::Index num_faces = (Eigen::Index) m_sections.at(FACE_CURVATURES).count;
+    return { num_faces > 0 ? section_data<double>(FACE_CURVATURES) + num_faces : nullptr, num_faces };
+}
+
+int MeshBundle::num_chains() const {
+    return (int) std::max<int64_t>(m_sections.at(CHAIN_OFFSETS).count - 1, 0);
+}
+
+Eigen::Map<const Eigen::VectorXi> MeshBundle::chain(int i) const {
+    const int32_t* offsets = section_data<int32_t>(CHAIN_OFFSETS);
+    return { section_data<int>(CHAIN_VERTICES) + offsets[i], offsets[i + 1] - offsets[i] };
+}
+
+int MeshBundle::num_edit_operations() const {
+    return (int) std::max<int64_t>(m_sections.at(EDIT_OFFSETS).count - 1, 0);
+}
+
+std::string_view MeshBundle::edit_label(int i) const {
+    const int32_t* offsets = section_data<int32_t>(EDIT_LABEL_OFFSETS);
+    return { section_data<char>(EDIT_LABELS) + offsets[i], (size_t) (offsets[i + 1] - offsets[i]) };
+}
+
+Eigen::Map<const Eigen::VectorXi> MeshBundle::edit_vertices(int i) const {
+    const int32_t* offsets = section_data<int32_t>(EDIT_OFFSETS);
+    return { section_data<int>(EDIT_VERTICES) + offsets[i], offsets[i + 1] - offsets[i] };
+}
+
+Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>>
+MeshBundle::edit_displacements(int i) const {
+    const int32_t* offsets = section_data<int32_t>(EDIT_OFFSETS);
+    return { section_data<double>(EDIT_DISPLACEMENTS) + 3 * offsets[i], offsets[i + 1] - offsets[i], 3 };
+}
+
+std::string_view MeshBundle::cameras_json() const {
+    return { section_data<char>(CAMERAS), (size_t) m_sections.at(CAMERAS).count };
+}
+
+StraightChains MeshBundle::straight_chains() const {
+    StraightChains chains;
+    for(int c = 0; c < num_chains(); ++c) {
+        const auto vids = chain(c);
+        chains.add_chain(std::vector<int>(vids.data(), vids.data() + vids.size()));
+    }
+
+    return chains;
+}
+
+EditOperation MeshBundle::edit_operation(int i) const {
+    EditOperation edit_op;
+    edit_op.label = std::string(edit_label(i));
+
+    const auto vids  = edit_vertices(i);
+    const auto disps = edit_displacements(i);
+    for(int k = 0; k < (int) vids.size(); ++k)
+        edit_op.displacements.insert({ vids(k), disps.row(k).transpose() });
+
+    return edit_op;
+}
+
+void MeshBundle::to_asset_data(MeshAssetData& asset) const {
+    asset.V   = vertices();
+    asset.F   = facets();
+    asset.PV1 = face_k1();
+    asset.PV2 = face_k2();
+    asset.straight_chains = straight_chains();
+
+    asset.edit_ops.clear();
+    for(int i = 0; i < num_edit_operations(); ++i)
+        asset.edit_ops.push_back(edit_operation(i));
+
+    asset.cameras_json = std::string(cameras_json());
+}
+
+std::unique_ptr<TriMesh> load_trimesh_from_bundle(const MeshBundle& bundle, bool normalize) {
+    Eigen::MatrixXd V = bundle.vertices();
+    if(normalize)
+        ca_essentials::meshes::normalize_to_unitbox(V);
+
+    return std::make_unique<TriMesh>(V, bundle.facets());
+}
+
+}
@@ -0,0 +1,197 @@
+#include <mesh_reshaping/normal_equations.h>
+
+#include <ca_essentials/core/logger.h>
+
+#include <limits>
+
+namespace reshaping {
+
+void StencilPattern::clear() {
+    m_num_entries = 0;
+
+    m_col_offsets.assign(1, 0);
+    m_cols.clear();
+    m_slot_offsets.assign(1, 0);
+    m_slots.clear();
+}
+
+bool StencilPattern::build(int num_unknowns, Eigen::SparseMatrix<double>& AtWA) {
+    const int num_stencils = (int) m_col_offsets.size() - 1;
+
+    // Stencils referencing every unknown (each stencil listed once per unknown)
+    std::vector<int64_t> stencil_offsets(num_unknowns + 1, 0);
+    std::vector<int> stencils;
+    m_num_entries = 0;
+    {
+        auto for_each_unique_col = [&](int s, const auto& func) {
+            const int* cols = m_cols.data() + m_col_offsets[s];
+            const int n     = (int) (m_col_offsets[s + 1] - m_col_offsets[s]);
+
+            for(int i = 0; i < n; ++i)
+                if(cols[i] >= 0 && std::find(cols, cols + i, cols[i]) == cols + i)
+                    func(cols[i]);
+        };
+
+        for(int s = 0; s < num_stencils; ++s)
+            for_each_unique_col(s, [&](int col) { stencil_offsets[col + 1]++; });
+
+        for(int c = 0; c < num_unknowns; ++c)
+            stencil_offsets[c + 1] += stencil_offsets[c];
+
+        stencils.resize(stencil_offsets.back());
+        std::vector<int64_t> next(stencil_offsets.begin(), stencil_offsets.end() - 1);
+        for(int s = 0; s < num_stencils; ++s)
+            for_each_unique_col(s, [&](int col) { stencils[next[col]++] = s; });
+
+        for(int col : m_cols)
+            m_num_entries += col >= 0;
+    }
+
+    // Rows r <= c of every column c: the unknowns sharing a stencil with c
+    std::vector<int64_t> upper_offsets(num_unknowns + 1, 0);
+    std::vector<int> upper_rows;
+    {
+        std::vector<int> last_col(num_unknowns, -1);
+        for(int c = 0; c < num_unknowns; ++c) {
+            const auto begin = upper_rows.size();
+
+            for(int64_t k = stencil_offsets[c]; k < stencil_offsets[c + 1]; ++k) {
+                const int s = stencils[k];
+                for(int64_t i = m_col_offsets[s]; i < m_col_offsets[s + 1]; ++i) {
+                    const int r = m_cols[i];
+                    if(r >= 0 && r <= c && last_col[r] != c) {
+                        last_col[r] = c;
+                        upper_rows.push_back(r);
+                    }
+                }
+            }
+
+            std::sort(upper_rows.begin() + begin, upper_rows.end());
+            upper_offsets[c + 1] = (int64_t) upper_rows.size();
+        }
+    }
+    std::vector<int64_t>().swap(stencil_offsets);
+    std::vector<int>().swap(stencils);
+
+    // Full pattern: the upper rows of every column followed by its lower ones, i.e.
+    // the transposed strictly upper entries (both ascending)
+    std::vector<int64_t> outer(num_unknowns + 1, 0);
+    for(int c = 0; c < num_unknowns; ++c) {
+        outer[c + 1] += upper_offsets[c + 1] - upper_offsets[c];
+
+        for(int64_t k = upper_offsets[c]; k < upper_offsets[c + 1]; ++k)
+            if(upper_rows[k] != c)
+                outer[upper_rows[k] + 1]++;
+    }
+
+    for(int c = 0; c < num_unknowns; ++c)
+        outer[c + 1] += outer[c];
+
+    // Eigen's sparse matrices index their non-zeros with ints
+    if(outer.back() > std::numeric_limits<int>::max()) {
+        LOGGER.error("Normal-equations matrix with too many non-zeros: {}", outer.back());
+        clear();
+        return false;
+    }
+
+    const int nnz = (int) outer.back();
+    AtWA.resize(num_unknowns, num_unknowns);
+    AtWA.resizeNonZeros(nnz);
+    {
+        int* outer_ptr = AtWA.outerIndexPtr();
+        int* inner_ptr = AtWA.innerIndexPtr();
+
+        std::vector<int64_t> next(num_unknowns);
+        for(int c = 0; c < num_unknowns; ++c) {
+            outer_ptr[c] = (int) outer[c];
+            next[c] = outer[c] + (upper_offsets[c + 1] - upper_offsets[c]);
+            std::copy(upper_rows.begin() + upper_offsets[c], upper_rows.begin() + upper_offsets[c + 1],
+                      inner_ptr + outer[c]);
+        }
+        outer_ptr[num_unknowns] = nnz;
+
+        for(int c = 0; c < num_unknowns; ++c)
+            for(int64_t k = upper_offsets[c]; k < upper_offsets[c + 1]; ++k)
+                if(upper_rows[k] != c)
+                    inner_ptr[next[upper_rows[k]]++] = c;
+
+        std::fill(AtWA.valuePtr(), AtWA.valuePtr() + nnz, 0.0);
+    }
+    std::vector<int64_t>().swap(upper_offsets);
+    std::vector<int>().swap(upper_rows);
+
+    // Mapping every stencil entry (i, j), i <= j, to its non-zero in the upper triangle
+    m_slot_offsets.resize(num_stencils + 1);
+    m_slot_offsets[0] = 0;
+    for(int s = 0; s < num_stencils; ++s) {
+        const int64_t n = m_col_offsets[s + 1] - m_col_offsets[s];
+        m_slot_offsets[s + 1] = m_slot_offsets[s] + n * (n + 1) / 2;
+    }
+
+    m_slots.resize(m_slot_offsets.back());
+    igl::parallel_for(num_stencils, [&](int s) {
+        const int* cols      = m_cols.data() + m_col_offsets[s];
+        const int n          = (int) (m_col_offsets[s + 1] - m_col_offsets[s]);
+        int* slots           = m_slots.data() + m_slot_offsets[s];
+        const int* outer_ptr = AtWA.outerIndexPtr();
+        const int* inner_ptr = AtWA.innerIndexPtr();
+
+        for(int i = 0; i < n; ++i) {
+            for(int j = i; j < n; ++j) {
+                if(cols[i] < 0 || cols[j] < 0) {
+                    *slots++ = -1;
+                    continue;
+                }
+
+                const int r = std::min(cols[i], cols[j]);
+                const int c = std::max(cols[i], cols[j]);
+
+                const int* col_begin = inner_ptr + outer_ptr[c];
+                const int* col_end   = inner_ptr + outer_ptr[c + 1];
+
+                *slots++ = (int) (std::lower_bound(col_begin, col_end, r) - inner_ptr);
+            }
+        }
+    }, 1000);
+
+    // The stencils are only visited again in the numeric phase
+    std::vector<int64_t>(1, 0).swap(m_col_offsets);
+    std::vector<int>().swap(m_cols);
+
+    return true;
+}
+
+void StencilPattern::copy_upper_to_lower(Eigen::SparseMatrix<double>& AtWA, bool parallel) {
+    const int n      = (int) AtWA.outerSize();
+    const int* outer = AtWA.outerIndexPtr();
+    const int* inner = AtWA.innerIndexPtr();
+    double* values   = AtWA.valuePtr();
+
+    auto lower_begin = [&](int c) {
+        return (int) (std::upper_bound(inner + outer[c], inner + outer[c + 1], c) - inner);
+    };
+
+    if(parallel) {
+        // Every column writes its own lower entries (rows > c), searching their upper
+        // counterparts in the other columns
+        igl::parallel_for(n, [&](int c) {
+            for(int k = lower_begin(c); k < outer[c + 1]; ++k) {
+                const int r = inner[k];
+                values[k] = values[std::lower_bound(inner + outer[r], inner + outer[r + 1], c) - inner];
+            }
+        }, 1000);
+    }
+    else {
+        // Transposing the upper entries column by column: the lower entries of every
+        // column are filled in increasing row order
+        std::vector<int> next(n);
+        for(int c = 0; c < n; ++c)
+            next[c] = lower_begin(c);
+
+        for(int c = 0; c < n; ++c)
+            for(int k = outer[c]; k < outer[c + 1] && inner[k] < c; ++k)
+                values[next[inner[k]]++] = values[k];
+    }
+}
+
+}
@@ -0,0 +1,247 @@
+#include <mesh_reshaping/precompute_cache.h>
+
+#include <mesh_reshaping/globals.h>
+#include <mesh_reshaping/content_hash.h>
+#include <mesh_reshaping/reshaping_data.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+namespace {
+
+// Entry file layout: header, then every cached field (see PrecomputeDiskCache::save)
+constexpr char ENTRY_MAGIC[4] = { 'R', 'S', 'P', 'C' };
+constexpr uint32_t ENTRY_VERSION = 1;
+
+struct EntryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t num_faces;
+    int32_t num_edges;
+};
+
+template<typename T>
+void write_pod(std::ostream& out, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read_pod(std::istream& in, T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return (bool) in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template<typename Scalar, int Rows, int Cols>
+void write_matrix(std::ostream& out, const Eigen::Matrix<Scalar, Rows, Cols>& M) {
+    write_pod(out, (int64_t) M.rows());
+    write_pod(out, (int64_t) M.cols());
+    out.write(reinterpret_cast<const char*>(M.data()), sizeof(Scalar) * M.size());
+}
+
+template<typename Scalar, int Rows, int Cols>
+bool read_matrix(std::istream& in, Eigen::Matrix<Scalar, Rows, Cols>& M) {
+    int64_t rows = 0, cols = 0;
+    if(!read_pod(in, rows) || !read_pod(in, cols) || rows < 0 || cols < 0)
+        return false;
+
+    M.resize(rows, cols);
+    return (bool) in.read(reinterpret_cast<char*>(M.data()), sizeof(Scalar) * M.size());
+}
+
+template<typename T>
+void write_vector(std::ostream& out, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write_pod(out, (int64_t) values.size());
+    out.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * values.size());
+}
+
+template<typename T>
+bool read_vector(std::istream& in, std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    int64_t size = 0;
+    if(!read_pod(in, size) || size < 0)
+        return false;
+
+    values.resize(size);
+    return (bool) in.read(reinterpret_cast<char*>(values.data()), sizeof(T) * values.size());
+}
+
+void write_sphericity_terms(std::ostream& out,
+                            const std::vector<reshaping::SphericityTermInfo>& terms) {
+    write_pod(out, (int64_t) terms.size());
+    for(const auto& term : terms) {
+        const int32_t vids[4] = { term.fid, term.vid_i, term.vid_j, term.vid_k };
+        write_pod(out, vids);
+        write_pod(out, term.w);
+        write_pod(out, term.ratio);
+        out.write(reinterpret_cast<const char*>(term.R.data()), sizeof(double) * 9);
+    }
+}
+
+bool read_sphericity_terms(std::istream& in,
+                           std::vector<reshaping::SphericityTermInfo>& terms) {
+    int64_t size = 0;
+    if(!read_pod(in, size) || size < 0)
+        return false;
+
+    terms.resize(size);
+    for(auto& term : terms) {
+        int32_t vids[4];
+        if(!read_pod(in, vids) || !read_pod(in, term.w) || !read_pod(in, term.ratio))
+            return false;
+
+        term.fid   = vids[0];
+        term.vid_i = vids[1];
+        term.vid_j = vids[2];
+        term.vid_k = vids[3];
+
+        if(!in.read(reinterpret_cast<char*>(term.R.data()), sizeof(double) * 9))
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+namespace reshaping {
+
+PrecomputeDiskCache::PrecomputeDiskCache(std::filesystem::path folder)
+: m_folder(std::move(folder)) {
+    std::error_code ec;
+    std::filesystem::create_directories(m_folder, ec);
+    if(ec)
+        LOGGER.warn("Could not create precompute cache folder {}: {}", m_folder.string(), ec.message());
+}
+
+std::filesystem::path PrecomputeDiskCache::entry_fn(uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".rspc";
+
+    return m_folder / name.str();
+}
+
+bool PrecomputeDiskCache::load(uint64_t key, ReshapingContext& ctx) {
+    const int num_faces = ctx.mesh.get_num_facets();
+    const int num_edges = ctx.mesh.get_num_edges();
+
+    std::ifstream in_f(entry_fn(key), std::ios::binary);
+    if(!in_f) {
+        m_num_misses++;
+        return false;
+    }
+
+    EntryHeader header;
+    bool valid = read_pod(in_f, header) &&
+                 std::equal(ENTRY_MAGIC, ENTRY_MAGIC + 4, header.magic) &&
+                 header.version   == ENTRY_VERSION &&
+                 header.key       == key &&
+                 header.num_faces == num_faces &&
+                 header.num_edges == num_edges;
+
+    valid = valid &&
+            read_pod(in_f, ctx.avg_edge_len) &&
+            read_matrix(in_f, ctx.orig_tri_N) &&
+            read_sphericity_terms(in_f, ctx.sphericity_terms_info) &&
+            read_matrix(in_f, ctx.similarity_term_edge_w) &&
+            read_vector(in_f, ctx.similarity_edges);
+
+    valid = valid &&
+            ctx.orig_tri_N.rows() == num_faces &&
+            ctx.similarity_term_edge_w.rows() == num_edges;
+
+    if(!valid) {
+        LOGGER.warn("Ignoring invalid precompute cache entry {}", entry_fn(key).string());
+        m_num_misses++;
+        return false;
+    }
+
+    m_num_hits++;
+    return true;
+}
+
+bool PrecomputeDiskCache::save(uint64_t key, const ReshapingContext& ctx) const {
+    namespace fs = std::filesystem;
+
+    const fs::path fn = entry_fn(key);
+
+    // Written to a unique temporary file first, so readers never see partial entries
+    std::ostringstream temp_name;
+    temp_name << fn.string() << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+    const fs::path temp_fn = temp_name.str();
+    {
+        std::ofstream out_f(temp_fn, std::ios::binary);
+        if(!out_f) {
+            LOGGER.warn("Could not write precompute cache entry {}", fn.string());
+            return false;
+        }
+
+        EntryHeader header;
+        std::copy(ENTRY_MAGIC, ENTRY_MAGIC + 4, header.magic);
+        header.version   = ENTRY_VERSION;
+        header.key       = key;
+        header.num_faces = ctx.mesh.get_num_facets();
+        header.num_edges = ctx.mesh.get_num_edges();
+
+        write_pod(out_f, header);
+        write_pod(out_f, ctx.avg_edge_len);
+        write_matrix(out_f, ctx.orig_tri_N);
+        write_sphericity_terms(out_f, ctx.sphericity_terms_info);
+        write_matrix(out_f, ctx.similarity_term_edge_w);
+        write_vector(out_f, ctx.similarity_edges);
+
+        if(!out_f) {
+            LOGGER.warn("Error while writing precompute cache entry {}", fn.string());
+            out_f.close();
+            fs::remove(temp_fn);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_fn, fn, ec);
+    if(ec) {
+        LOGGER.warn("Could not write precompute cache entry {}: {}", fn.string(), ec.message());
+        fs::remove(temp_fn, ec);
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t compute_precompute_cache_key(const ReshapingParams& params,
+                                      const TriMesh& mesh,
+                                      const Eigen::VectorXd& PV1,
+                                      const Eigen::VectorXd& PV2,
+                                      const StraightChains* straight_chains) {
+    uint64_t key = CONTENT_HASH_SEED;
+    key = hash_value(ENTRY_VERSION, key);
+    key = hash_matrix(mesh.get_vertices(), key);
+    key = hash_matrix(mesh.get_facets(), key);
+    key = hash_matrix(PV1, key);
+    key = hash_matrix(PV2, key);
+
+    const int num_chains = straight_chains ? straight_chains->num_chains() : -1;
+    key = hash_value(num_chains, key);
+    for(int c = 0; c < num_chains; ++c) {
+        const auto& chain = straight_chains->get_chain(c);
+        key = hash_value(chain.size(), key);
+        key = hash_bytes(chain.data(), sizeof(int) * chain.size(), key);
+    }
+
+    // Parameters of the cached pre-computation
+    const int sphericity_on = SPHERICITY_ON;
+    key = hash_value(sphericity_on, key);
+    key = hash_value(params.vertex_sol.sphericity_k_max_const, key);
+    key = hash_value(params.transf_sol.similarity_sigma, key);
+    key = hash_value(params.transf_sol.similarity_cutoff_angle, key);
+
+    return key;
+}
+
+}
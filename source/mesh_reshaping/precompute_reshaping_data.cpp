@@ -3,202 +3,313 @@
 #include <mesh_reshaping/globals.h>
 #include <mesh_reshaping/straight_chains.h>
 #include <mesh_reshaping/similarity_term.h>
+#include <mesh_reshaping/transformation_solve.h>
 
 #include <ca_essentials/meshes/compute_triangle_normal.h>
+#include <ca_essentials/core/timer.h>
+#include <ca_essentials/core/profiler.h>
 
 #include <igl/avg_edge_length.h>
 
+#include <algorithm>
+
 namespace {
 
-void init_vertices(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
-    data.orig_vertices = mesh.get_vertices();
-    data.curr_vertices = mesh.get_vertices();
+void init_vertices(reshaping::ReshapingContext& ctx) {
+    const auto& mesh = ctx.mesh;
+    ctx.orig_vertices = mesh.get_vertices();
 }
 
 // init input edge vectors (non-normalized) and lengths
-void init_edge_vectors_and_lenghts(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
+void init_edge_vectors_and_lenghts(reshaping::ReshapingContext& ctx) {
+    const auto& mesh = ctx.mesh;
     const int num_edges = mesh.get_num_edges();
 
-    data.orig_edges.resize(num_edges, 3);
-    data.orig_edge_lens.resize(num_edges);
+    ctx.orig_edges.resize(num_edges, 3);
+    ctx.orig_edge_lens.resize(num_edges);
 
     for(int e = 0; e < num_edges; ++e) {
         const auto& edge_verts = mesh.get_edge_vertices(e);
 
-        data.orig_edges.row(e) = data.orig_vertices.row(edge_verts[1]) -
-                                 data.orig_vertices.row(edge_verts[0]);
+        ctx.orig_edges.row(e) = ctx.orig_vertices.row(edge_verts[1]) -
+                                ctx.orig_vertices.row(edge_verts[0]);
 
-        data.orig_edge_lens(e) = data.orig_edges.row(e).norm();
+        ctx.orig_edge_lens(e) = ctx.orig_edges.row(e).norm();
     }
 }
 
-void init_current_and_target_edge_lenghts(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-
-    data.orig_edges.resize(num_edges, 3);
-    data.orig_edge_lens.resize(num_edges);
+void init_average_edge_length(reshaping::ReshapingContext& ctx) {
+    const auto& mesh = ctx.mesh;
 
-    for(int e = 0; e < num_edges; ++e) {
-        const auto& edge_verts = mesh.get_edge_vertices(e);
-
-        data.orig_edges.row(e) = data.orig_vertices.row(edge_verts[1]) -
-                                 data.orig_vertices.row(edge_verts[0]);
-
-        data.orig_edge_lens(e) = data.orig_edges.row(e).norm();
-    }
+    ctx.avg_edge_len = igl::avg_edge_length(mesh.get_vertices(),
+                                            mesh.get_facets());
 }
 
-void init_average_edge_length(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
-
-    data.avg_edge_len = igl::avg_edge_length(mesh.get_vertices(),
-                                             mesh.get_facets());
-}
-
-void init_triangle_normals(reshaping::ReshapingData& data) {
+void init_triangle_normals(reshaping::ReshapingContext& ctx) {
     namespace meshes = ca_essentials::meshes;
 
-    const auto& mesh = data.mesh;
-    const int num_faces = mesh.get_num_facets();
-
     // TODO: replace by IGL
-    data.orig_tri_N = meshes::compute_triangle_normal(data.mesh);
+    ctx.orig_tri_N = meshes::compute_triangle_normal(ctx.mesh);
 }
 
 // init the two adjacent face-normals for each edge
-void init_edge_adjacent_normals(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
+void init_edge_adjacent_normals(reshaping::ReshapingContext& ctx) {
+    const auto& mesh = ctx.mesh;
     const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = data.mesh.get_edge_face_adjacency();
+    const auto& adj_e2f = ctx.mesh.get_edge_face_adjacency();
 
-    data.orig_edge_adj_N.resize(num_edges);
+    ctx.orig_edge_adj_N.resize(num_edges);
     for(int e = 0; e < num_edges; ++e) {
         const auto& edge_faces = adj_e2f.at(e);
         assert(edge_faces.size() == 2);
 
         for(int i = 0; i < 2; ++i) {
             int adj_fid = edge_faces.at(i);
-            data.orig_edge_adj_N.at(e).at(i) = data.orig_tri_N.row(adj_fid);
+            ctx.orig_edge_adj_N.at(e).at(i) = ctx.orig_tri_N.row(adj_fid);
         }
     }
 }
 
-// init per-triangle current and previous transformations
-void init_triangle_transformations(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
-    const int num_faces = mesh.get_num_facets();
+void init_num_straight_pairs(reshaping::ReshapingContext& ctx) {
+    ctx.num_straight_pairs = 0;
 
-    data.curr_tri_T.resize(num_faces, Eigen::Matrix3d::Identity());
-    data.prev_tri_T.resize(num_faces, Eigen::Matrix3d::Identity());
-}
-
-// init per-edge current and target lengths
-void init_edge_current_and_target_lengths(reshaping::ReshapingData& data) {
-    data.curr_edge_lens   = data.orig_edge_lens;
-    data.target_edge_lens = data.orig_edge_lens;
-}
-
-void init_num_straight_pairs(reshaping::ReshapingData& data) {
-    data.num_straight_pairs = 0;
-
-    if(!data.straight_chains)
+    if(!ctx.straight_chains)
         return;
 
-    for(int c = 0; c < data.straight_chains->num_chains(); ++c) {
-        const auto& chain = data.straight_chains->get_chain(c);
+    for(int c = 0; c < ctx.straight_chains->num_chains(); ++c) {
+        const auto& chain = ctx.straight_chains->get_chain(c);
 
         if(chain.size() >= 3)
-            data.num_straight_pairs += (int) chain.size() - 2; 
+            ctx.num_straight_pairs += (int) chain.size() - 2; 
     }
 }
 
 void init_sphericity_terms(const reshaping::ReshapingParams& params,
-                           reshaping::ReshapingData& data) {
+                           reshaping::ReshapingContext& ctx) {
 
     reshaping::SphericityTermsParams sphericity_params;
     sphericity_params.k_max_const  = params.vertex_sol.sphericity_k_max_const;
     sphericity_params.debug_folder = params.debug_folder.string();
 
-    data.sphericity_terms_info = reshaping::compute_sphericity_terms_info(data.mesh,
-                                                                          data.PV1,
-                                                                          data.PV2,
-                                                                          sphericity_params);
+    ctx.sphericity_terms_info = reshaping::compute_sphericity_terms_info(ctx.mesh,
+                                                                         ctx.PV1,
+                                                                         ctx.PV2,
+                                                                         sphericity_params);
+
+    // Flat and cylindrical regions get zero-weight terms, which are not assembled
+    auto& terms_info = ctx.sphericity_terms_info;
+    terms_info.erase(std::remove_if(terms_info.begin(), terms_info.end(),
+                                    [](const reshaping::SphericityTermInfo& info) {
+                                        return info.w == 0.0;
+                                    }),
+                     terms_info.end());
+}
+
+// Edge indices of the sphericity terms (not stored in the disk cache, as they are
+// cheap to look up once)
+void init_sphericity_term_edges(reshaping::ReshapingContext& ctx) {
+    const auto& terms_info = ctx.sphericity_terms_info;
+
+    ctx.sphericity_term_edges.resize(terms_info.size());
+    for(size_t t = 0; t < terms_info.size(); ++t) {
+        const auto& info = terms_info.at(t);
+        ctx.sphericity_term_edges.at(t) = { ctx.mesh.get_edge_index(info.vid_i, info.vid_j),
+                                            ctx.mesh.get_edge_index(info.vid_i, info.vid_k) };
+    }
 }
 
 void init_similarity_edge_weights(const reshaping::ReshapingParams& params,
-                                  reshaping::ReshapingData& data) {
+                                  reshaping::ReshapingContext& ctx) {
 
-     reshaping::compute_similarity_term_edge_weights(data.mesh,
-                                                     data.orig_tri_N,
+     reshaping::compute_similarity_term_edge_weights(ctx.mesh,
+                                                     ctx.orig_tri_N,
                                                      params.transf_sol.similarity_sigma,
                                                      params.transf_sol.similarity_cutoff_angle,
-                                                     data.similarity_term_edge_w);
+                                                     ctx.similarity_term_edge_w);
+
+    // Edges below the cutoff angle get zero weight and are skipped
+    ctx.similarity_edges.clear();
+    for(int e = 0; e < (int) ctx.similarity_term_edge_w.size(); ++e) {
+        if(ctx.similarity_term_edge_w(e) != 0.0)
+            ctx.similarity_edges.push_back(e);
+    }
 }
 
-void init_length_based_edge_weights(reshaping::ReshapingData& data) {
-    namespace meshes = ca_essentials::meshes;
+// init per-vertex and per-triangle current values (input mesh)
+void init_current_geometry(reshaping::ReshapingState& data) {
+    const auto& mesh = data.mesh;
+    const int num_faces = mesh.get_num_facets();
+
+    data.curr_vertices = data.context->orig_vertices;
 
+    data.curr_tri_T.resize(num_faces, Eigen::Matrix3d::Identity());
+    data.prev_tri_T.resize(num_faces, Eigen::Matrix3d::Identity());
+}
+
+// init per-edge current and target lengths
+void init_edge_current_and_target_lengths(reshaping::ReshapingState& data) {
+    data.curr_edge_lens   = data.context->orig_edge_lens;
+    data.target_edge_lens = data.context->orig_edge_lens;
+}
+
+void init_length_based_edge_weights(reshaping::ReshapingState& data) {
     const auto& mesh = data.mesh;
     const int num_edges = mesh.get_num_edges();
+    const double avg_edge_len = data.context->avg_edge_len;
 
     if(data.length_based_edge_w.rows() == 0) 
         data.length_based_edge_w.resize(num_edges);
 
     for(int e = 0; e < num_edges; ++e) {
-        const auto& edge_verts = mesh.get_edge_vertices(e);
-
         double curr_len = data.curr_edge_lens(e);
-        data.length_based_edge_w(e) = std::max(1.0, pow(curr_len / data.avg_edge_len, 2.0));
+        data.length_based_edge_w(e) = std::max(1.0, pow(curr_len / avg_edge_len, 2.0));
+    }
+}
+
+void init_linear_solvers(const reshaping::ReshapingParams& params,
+                         reshaping::ReshapingState& data) {
+    data.vertex_solver = reshaping::make_linear_solver(params.vertex_sol.linear_solver);
+    data.transf_solver = reshaping::make_linear_solver(params.transf_sol.linear_solver);
+
+    data.vertex_warm_start_tol = params.vertex_sol.warm_start.tol_factor *
+                                 params.max_vertex_change_tol *
+                                 data.context->avg_edge_len;
+}
+
+void init_state(const reshaping::ReshapingParams& params,
+                reshaping::ReshapingState& data) {
+    init_current_geometry(data);
+    init_edge_current_and_target_lengths(data);
+    init_length_based_edge_weights(data);
+    init_linear_solvers(params, data);
+}
+
+// Pre-computes the geometric terms of the context (normals, sphericity and
+// similarity terms), or loads them from the on-disk cache if available
+void init_geometric_terms(const reshaping::ReshapingParams& params,
+                          reshaping::ReshapingContext& ctx,
+                          reshaping::PrecomputeDiskCache* disk_cache) {
+    ca_essentials::core::Timer timer;
+    timer.start("precompute");
+
+    uint64_t key = 0;
+    if(disk_cache) {
+        key = reshaping::compute_precompute_cache_key(params, ctx.mesh, ctx.PV1, ctx.PV2,
+                                                      ctx.straight_chains);
+
+        if(disk_cache->load(key, ctx)) {
+            LOGGER.info("Precompute cache hit: loaded in {:.2f} ms (hits {}, misses {})",
+                        timer.elapsed("precompute"), disk_cache->num_hits(), disk_cache->num_misses());
+            return;
+        }
+    }
+
+    init_average_edge_length(ctx);
+    init_triangle_normals(ctx);
+#if SPHERICITY_ON
+    init_sphericity_terms(params, ctx);
+#endif
+    init_similarity_edge_weights(params, ctx);
+
+    if(disk_cache) {
+        disk_cache->save(key, ctx);
+        LOGGER.info("Precompute cache miss: computed in {:.2f} ms (hits {}, misses {})",
+                    timer.elapsed("precompute"), disk_cache->num_hits(), disk_cache->num_misses());
     }
 }
 
+void init_transformation_solver(const reshaping::ReshapingParams& params,
+                                const std::shared_ptr<reshaping::ReshapingContext>& ctx,
+                                reshaping::TransfSolveFactorCache* cache) {
+    if(!params.transf_sol.factor_once)
+        return;
+
+    // The system matrix only depends on the context. The initial state is only
+    // needed to visit the system stencils.
+    reshaping::ReshapingState data(ctx);
+    init_state(params, data);
+
+    if(cache)
+        ctx->transf_factor = cache->get_or_compute(params.transf_sol, data);
+    else
+        ctx->transf_factor = reshaping::prefactor_transformation_system(params.transf_sol, data);
+}
+
 }
 
 namespace reshaping {
 
-std::unique_ptr<ReshapingData>
+std::shared_ptr<const ReshapingContext>
+precompute_reshaping_context(const ReshapingParams& params,
+                             const TriMesh& mesh,
+                             const Eigen::VectorXd& PV1,
+                             const Eigen::VectorXd& PV2,
+                             const StraightChains* straight_chains,
+                             TransfSolveFactorCache* transf_factor_cache,
+                             PrecomputeDiskCache* disk_cache) {
+    CA_PROFILE_SCOPE("precompute_context");
+
+    ca_essentials::core::Timer timer;
+    timer.start("precompute");
+
+    auto ctx = std::make_shared<ReshapingContext>(mesh);
+    ctx->PV1 = PV1;
+    ctx->PV2 = PV2;
+    ctx->straight_chains = straight_chains;
+
+    init_vertices(*ctx);
+    init_edge_vectors_and_lenghts(*ctx);
+    init_geometric_terms(params, *ctx, disk_cache);
+    init_sphericity_term_edges(*ctx);
+    init_edge_adjacent_normals(*ctx);
+    init_num_straight_pairs(*ctx);
+    init_transformation_solver(params, ctx, transf_factor_cache);
+
+    ctx->precompute_time = timer.elapsed("precompute");
+
+    return ctx;
+}
+
+std::unique_ptr<ReshapingState>
+make_reshaping_state(const ReshapingParams& params,
+                     std::shared_ptr<const ReshapingContext> context,
+                     const std::unordered_map<int, Eigen::Vector3d>& bc) {
+    CA_PROFILE_SCOPE("make_state");
+
+    auto data = std::make_unique<ReshapingState>(std::move(context));
+    data->bc = bc;
+
+    init_state(params, *data);
+
+    return data;
+}
+
+std::unique_ptr<ReshapingState>
 precompute_reshaping_data(const ReshapingParams& params,
                           const TriMesh& mesh,
                           const Eigen::VectorXd& PV1,
                           const Eigen::VectorXd& PV2,
-                          const StraightChains* straight_chains) {
+                          const StraightChains* straight_chains,
+                          TransfSolveFactorCache* transf_factor_cache) {
 
     const std::unordered_map<int, Eigen::Vector3d> bc;
-    return precompute_reshaping_data(params, mesh, PV1, PV2, bc, straight_chains);
+    return precompute_reshaping_data(params, mesh, PV1, PV2, bc, straight_chains,
+                                     transf_factor_cache);
 }
 
-std::unique_ptr<ReshapingData>
+std::unique_ptr<ReshapingState>
 precompute_reshaping_data(const ReshapingParams& params,
                           const TriMesh& mesh,
                           const Eigen::VectorXd& PV1,
                           const Eigen::VectorXd& PV2,
                           const std::unordered_map<int, Eigen::Vector3d>& bc,
-                          const StraightChains* straight_chains) {
+                          const StraightChains* straight_chains,
+                          TransfSolveFactorCache* transf_factor_cache) {
 
-    auto data = std::make_unique<ReshapingData>(mesh);
-    data->PV1 = PV1;
-    data->PV2 = PV2;
-    data->straight_chains = straight_chains;
-    data->bc = bc;
+    auto context = precompute_reshaping_context(params, mesh, PV1, PV2, straight_chains,
+                                                transf_factor_cache);
 
-    init_vertices(*data);
-    init_edge_vectors_and_lenghts(*data);
-    init_average_edge_length(*data);
-    init_triangle_normals(*data);
-    init_edge_adjacent_normals(*data);
-    init_triangle_transformations(*data);
-    init_edge_current_and_target_lengths(*data);
-    init_num_straight_pairs(*data);
-#if SPHERICITY_ON
-    init_sphericity_terms(params, *data);
-#endif
-    init_similarity_edge_weights(params, *data);
-    init_length_based_edge_weights(*data);
-
-    return data;
+    return make_reshaping_state(params, std::move(context), bc);
 }
 
 }
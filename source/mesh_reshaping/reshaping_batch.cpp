@@ -0,0 +1,240 @@
+#include <mesh_reshaping/reshaping_batch.h>
+
+#include <mesh_reshaping/precompute_reshaping_data.h>
+#include <mesh_reshaping/reshaping_tool.h>
+#include <mesh_reshaping/vertex_solve.h>
+#include <mesh_reshaping/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+
+namespace {
+
+// Runs task(i) for every i in [0, num_tasks) on a pool of num_threads workers,
+// each one pulling the next pending task
+template<typename Task>
+void run_on_thread_pool(int num_tasks, int num_threads, const Task& task) {
+    std::atomic<int> next_task(0);
+
+    auto worker = [&]() {
+        for(int i = next_task++; i < num_tasks; i = next_task++)
+            task(i);
+    };
+
+    std::vector<std::thread> workers;
+    for(int t = 1; t < num_threads; ++t)
+        workers.emplace_back(worker);
+
+    // The calling thread works as well
+    worker();
+
+    for(auto& w : workers)
+        w.join();
+}
+
+// Maximum number of edits whose first vertex solve is performed together. Bounds
+// the right-hand side (and solution) storage of a single multi-column solve.
+constexpr int MAX_EDITS_PER_SHARED_SOLVE = 32;
+
+// Minimum number of edits of a continuation chain. Only the first edit of a chain
+// is cold-started, so sweep groups are only split into a few long chains.
+constexpr int MIN_EDITS_PER_CONTINUATION_CHAIN = 8;
+
+// Groups the edits constraining the same vertices
+std::vector<std::vector<int>> group_edits_by_constrained_vertices(const std::vector<reshaping::EditConstraints>& edits) {
+    // <key: sorted constrained vertices, value: edits>
+    std::map<std::vector<int>, std::vector<int>> groups;
+    for(int i = 0; i < (int) edits.size(); ++i) {
+        std::vector<int> vids;
+        for(const auto& [vid, pos] : edits.at(i))
+            vids.push_back(vid);
+        std::sort(vids.begin(), vids.end());
+
+        groups[vids].push_back(i);
+    }
+
+    std::vector<std::vector<int>> edit_groups;
+    for(auto& [vids, group] : groups)
+        edit_groups.push_back(std::move(group));
+
+    return edit_groups;
+}
+
+// Squared distance between the targets of two edits constraining the same vertices
+double edit_distance(const reshaping::EditConstraints& a,
+                     const reshaping::EditConstraints& b) {
+    double dist = 0.0;
+    for(const auto& [vid, pos] : a)
+        dist += (pos - b.at(vid)).squaredNorm();
+
+    return dist;
+}
+
+// Orders the edits of a group along their sweep: starting from the edit closest to
+// the input mesh, the next edit is always the nearest remaining one
+void order_edits_along_sweep(const std::vector<reshaping::EditConstraints>& edits,
+                             const Eigen::MatrixXd& orig_V,
+                             std::vector<int>& group) {
+    auto rest_distance = [&](int i) {
+        double dist = 0.0;
+        for(const auto& [vid, pos] : edits.at(i))
+            dist += (pos - orig_V.row(vid).transpose()).squaredNorm();
+
+        return dist;
+    };
+
+    auto first = std::min_element(group.begin(), group.end(), [&](int i, int j) {
+        return rest_distance(i) < rest_distance(j);
+    });
+    std::iter_swap(group.begin(), first);
+
+    for(auto itr = group.begin() + 1; itr != group.end(); ++itr) {
+        const auto& prev_edit = edits.at(*(itr - 1));
+
+        auto next = std::min_element(itr, group.end(), [&](int i, int j) {
+            return edit_distance(prev_edit, edits.at(i)) < edit_distance(prev_edit, edits.at(j));
+        });
+        std::iter_swap(itr, next);
+    }
+}
+
+// Splits every group into consecutive units of (almost) equal size, each solved by
+// a single worker, so that all the workers are kept busy. Units hold at least
+// min_unit_size edits (unless the group is smaller) and at most max_unit_size.
+std::vector<std::vector<int>> split_into_units(const std::vector<std::vector<int>>& groups,
+                                               int num_threads,
+                                               int min_unit_size,
+                                               int max_unit_size) {
+    std::vector<std::vector<int>> units;
+    for(const auto& group : groups) {
+        const int group_size = (int) group.size();
+
+        int num_units = std::min(num_threads, std::max(group_size / min_unit_size, 1));
+        num_units = std::max(num_units, (group_size + max_unit_size - 1) / max_unit_size);
+        const int unit_size = std::max((group_size + num_units - 1) / num_units, 1);
+
+        for(int first = 0; first < group_size; first += unit_size) {
+            const int last = std::min(first + unit_size, group_size);
+            units.emplace_back(group.begin() + first, group.begin() + last);
+        }
+    }
+
+    return units;
+}
+
+}
+
+namespace reshaping {
+
+int reshaping_solve_batch(const ReshapingParams& params,
+                          const std::shared_ptr<const ReshapingContext>& context,
+                          const std::vector<EditConstraints>& edits,
+                          const BatchParams& batch_params,
+                          const BatchEditCallback& on_edit_solved) {
+    const int num_edits = (int) edits.size();
+
+    int num_threads = batch_params.num_threads;
+    if(num_threads <= 0)
+        num_threads = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    num_threads = std::min(num_threads, std::max(num_edits, 1));
+
+    // Continuation starts every edit (but the first of each unit) from its predecessor.
+    // Otherwise, the units' first vertex solves are shared instead. Iterative backends
+    // start from the current vertices, so only direct ones benefit from that.
+    const bool continuation      = batch_params.continuation;
+    const bool share_first_solve = !continuation &&
+                                   params.vertex_sol.linear_solver.type != LinearSolverType::CONJUGATE_GRADIENT;
+
+    std::vector<std::vector<int>> units;
+    if(continuation || share_first_solve) {
+        auto groups = group_edits_by_constrained_vertices(edits);
+        if(continuation) {
+            for(auto& group : groups)
+                order_edits_along_sweep(edits, context->orig_vertices, group);
+        }
+
+        if(continuation) {
+            // Groups run in parallel, so they only share the remaining threads
+            const int threads_per_group = std::max(num_threads / (int) groups.size(), 1);
+            units = split_into_units(groups, threads_per_group, MIN_EDITS_PER_CONTINUATION_CHAIN, num_edits);
+            if(units.size() > groups.size())
+                LOGGER.warn("{} sweep groups split into {} continuation chains to use {} threads "
+                            "(the first edit of each chain is cold-started)",
+                            groups.size(), units.size(), num_threads);
+        }
+        else
+            units = split_into_units(groups, num_threads, 1, MAX_EDITS_PER_SHARED_SOLVE);
+    }
+    else {
+        for(int i = 0; i < num_edits; ++i)
+            units.push_back({ i });
+    }
+    num_threads = std::min(num_threads, std::max((int) units.size(), 1));
+
+    LOGGER.info("Solving {} edit operations on {} threads", num_edits, num_threads);
+
+    std::atomic<int> num_solved(0);
+    std::atomic<int> num_shared_solves(0);
+    std::atomic<int> num_warm_starts(0);
+    run_on_thread_pool((int) units.size(), num_threads, [&](int u) {
+        const std::vector<int>& unit = units.at(u);
+
+        // Solving the first vertex solve of the whole unit at once
+        std::vector<Eigen::MatrixXd> initial_V;
+        if(share_first_solve && unit.size() > 1) {
+            std::vector<EditConstraints> unit_edits;
+            for(int i : unit)
+                unit_edits.push_back(edits.at(i));
+
+            auto workspace = make_reshaping_state(params, context, unit_edits.front());
+            if(solve_initial_vertices_for_edits(params.vertex_sol, *workspace, unit_edits, initial_V))
+                num_shared_solves++;
+            else
+                initial_V.clear();
+        }
+
+        // Last solved edit of the unit (continuation source)
+        std::unique_ptr<ReshapingState> prev_data;
+
+        for(int k = 0; k < (int) unit.size(); ++k) {
+            const int i = unit.at(k);
+
+            auto data = make_reshaping_state(params, context, edits.at(i));
+            if(!initial_V.empty())
+                data->initial_vertex_sol = std::move(initial_V.at(k));
+
+            if(continuation && prev_data) {
+                warm_start_from_solution(*prev_data, *data);
+                num_warm_starts++;
+            }
+
+            Eigen::MatrixXd V = reshaping_solve(params, *data);
+            if(V.rows() != data->mesh.get_num_vertices()) {
+                LOGGER.error("Error while solving edit operation {}", i);
+                prev_data.reset();
+                continue;
+            }
+
+            num_solved++;
+            if(on_edit_solved)
+                on_edit_solved(i, *data);
+
+            if(continuation)
+                prev_data = std::move(data);
+        }
+    });
+
+    if(num_shared_solves > 0)
+        LOGGER.info("{} shared first vertex solves for edits constraining the same vertices",
+                    num_shared_solves.load());
+
+    if(num_warm_starts > 0)
+        LOGGER.info("{} edit operations warm-started from the solution of a neighbor edit",
+                    num_warm_starts.load());
+
+    return num_solved;
+}
+
+}
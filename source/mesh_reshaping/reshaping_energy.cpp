@@ -5,14 +5,27 @@
 #include <mesh_reshaping/vertex_solve_energy.h>
 #include <mesh_reshaping/transformation_solve_energy.h>
 
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/timer.h>
+
 namespace reshaping {
 
 ReshapingEnergy compute_reshaping_energy(const ReshapingParams& params,
-                                         const ReshapingData& data,
+                                         const ReshapingState& data,
                                          const Eigen::MatrixXd& V) {
+    CA_PROFILE_SCOPE("energy");
+
+    ca_essentials::core::Timer timer;
+
     ReshapingEnergy energy;
-    energy.vertex_sol = compute_vertex_solve_energy(params.vertex_sol, data, V);
-    energy.transf_sol = compute_transf_solve_energy(params.transf_sol, data, V);
+
+    timer.start("vertex_sol");
+    energy.vertex_sol = compute_vertex_solve_energy(params.vertex_sol, data, V, params.parallel_energy);
+    energy.vertex_sol_time = timer.elapsed("vertex_sol");
+
+    timer.start("transf_sol");
+    energy.transf_sol = compute_transf_solve_energy(params.transf_sol, data, params.parallel_energy);
+    energy.transf_sol_time = timer.elapsed("transf_sol");
 
     energy.total_cost = energy.vertex_sol.total_cost +
                         energy.transf_sol.total_cost;
@@ -9,11 +9,14 @@
 #include <mesh_reshaping/length_based_edge_weight.h>
 #include <mesh_reshaping/compute_max_vertex_change.h>
 #include <mesh_reshaping/handle_error_distribution.h>
+#include <mesh_reshaping/anderson_acceleration.h>
 
 #include <ca_essentials/meshes/compute_triangle_normal.h>
 #include <ca_essentials/meshes/debug_utils.h>
 #include <ca_essentials/core/timer.h>
+#include <ca_essentials/core/profiler.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
@@ -21,25 +24,54 @@
 
 namespace {
 
+// Solves the vertex positions of the current iteration. The solution replaces
+// data.curr_vertices and the vertices the iteration started from are returned
+// in start_V.
 void solve_for_vertex_positions(const reshaping::VertexSolveParams& params,
-                                reshaping::ReshapingData& data) {
+                                reshaping::ReshapingState& data,
+                                Eigen::MatrixXd& start_V) {
+    CA_PROFILE_SCOPE("vertex_solve");
+
+    Eigen::MatrixXd V;
+
+    // First solve already computed (see reshaping_solve_batch)
+    if(data.iter == 0 && data.initial_vertex_sol.rows() > 0) {
+        V = std::move(data.initial_vertex_sol);
+        data.initial_vertex_sol.resize(0, 0);
+        data.last_vertex_sol_succ = true;
+        data.iter_vertex_sys_stats.emplace_back();
+    }
+    else {
+        V.resize(data.curr_vertices.rows(), 3);
+
+        reshaping::LinearSystemStats stats;
+        bool solve_succ = reshaping::solve_for_vertices(params,
+                                                        data,
+                                                        V,
+                                                        &stats);
+        data.last_vertex_sol_succ = solve_succ;
+        data.iter_vertex_sys_stats.push_back(stats);
+    }
 
-    bool solve_succ = reshaping::solve_for_vertices(params,
-                                                    data,
-                                                    data.curr_vertices);
-    data.last_vertex_sol_succ = solve_succ;
+    start_V = std::move(data.curr_vertices);
+    data.curr_vertices = std::move(V);
 }
 
 void solve_for_transformations(const reshaping::TransfSolveParams& params,
-                              reshaping::ReshapingData& data) {
+                              reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("transf_solve");
 
+    reshaping::LinearSystemStats stats;
     bool solve_succ = reshaping::solve_for_transformations(params,
                                                            data,
-                                                           data.curr_tri_T);
+                                                           data.curr_tri_T,
+                                                           &stats);
     data.last_transf_sol_succ = solve_succ;
+    data.iter_transf_sys_stats.push_back(stats);
 }
 
-void update_current_edge_lengths(reshaping::ReshapingData& data) {
+void update_current_edge_lengths(reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("update_current_edge_lengths");
     const auto& mesh = data.mesh;
     const int num_edges = mesh.get_num_edges();
 
@@ -52,69 +84,120 @@ void update_current_edge_lengths(reshaping::ReshapingData& data) {
     }
 }
 
-void update_target_edge_lenghts(reshaping::ReshapingData& data) {
-    const auto& mesh = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    for(int e = 0; e < num_edges; ++e) {
-        const auto& edge_verts = mesh.get_edge_vertices(e);
+// Energy decrease since the last evaluated iteration (see
+// ReshapingParams::compute_energy_every_n_iters)
+double compute_total_energy_delta(const reshaping::ReshapingState& data) {
+    const auto& energies = data.iter_energy_costs;
+    for(int i = (int) energies.size() - 2; i >= 0; --i) {
+        if(energies.at(i).evaluated)
+            return energies.at(i).total_cost - energies.back().total_cost;
+    }
 
-        int fid_0 = adj_e2f.at(e).at(0);
-        int fid_1 = adj_e2f.at(e).at(1);
+    return 0.0;
+}
 
-        const Eigen::Vector3d& orig_E = (data.orig_vertices.row(edge_verts[1]) -
-                                         data.orig_vertices.row(edge_verts[0]));
+// Whether the energy of the current iteration has to be evaluated: every n
+// iterations, on accelerated iterations (which are rejected based on it), and
+// whenever a non-energy termination criterion is reached (see update_convergence)
+bool is_energy_iteration(const reshaping::ReshapingParams& params,
+                         const reshaping::ReshapingState& data,
+                         double max_vertex_change,
+                         bool accelerated) {
+    if(accelerated || data.iter % std::max(params.compute_energy_every_n_iters, 1) == 0)
+        return true;
+
+    const double vertex_change_tol = params.max_vertex_change_tol * data.context->avg_edge_len;
+    const bool max_vertex_change_reached = max_vertex_change < vertex_change_tol;
+    const bool max_iter_reached = data.iter >= (params.max_iters - 1);
+
+    return data.iter > 1 && (max_vertex_change_reached || max_iter_reached);
+}
 
-        const Eigen::Matrix3d& T0 = data.curr_tri_T.at(fid_0);
-        const Eigen::Matrix3d& T1 = data.curr_tri_T.at(fid_1);
+// Keeps the solution of the current iteration according to the history policy.
+// The previous one is kept as well until the current iteration is accepted
+// (see prune_vertex_history).
+void record_vertex_solution(const reshaping::ReshapingParams& params,
+                            reshaping::ReshapingState& data) {
+    if(params.iter_history == reshaping::IterationHistory::NONE)
+        return;
 
-        const Eigen::Vector3d T0_E = T0 * orig_E;
-        const Eigen::Vector3d T1_E = T1 * orig_E;
-        data.target_edge_lens(e) = (T0_E.norm() + T1_E.norm()) * 0.5;
-    }
+    data.iter_vertex_sol.push_back(data.curr_vertices);
+    data.iter_vertex_sol_iters.push_back(data.iter);
 }
 
-double compute_total_energy_delta(const reshaping::ReshapingData& data) {
-    auto num_energies = data.iter_energy_costs.size();
-    if(num_energies <= 1)
-        return 0.0;
-    else {
-        auto num_energies = data.iter_energy_costs.size();
-        return data.iter_energy_costs.at(num_energies - 2).total_cost -
-               data.iter_energy_costs.at(num_energies - 1).total_cost;
+// Drops the solution of the previous iteration unless the history policy keeps it
+void prune_vertex_history(const reshaping::ReshapingParams& params,
+                          reshaping::ReshapingState& data) {
+    using reshaping::IterationHistory;
+
+    const int num_sols = (int) data.iter_vertex_sol.size();
+    if(num_sols < 2 || params.iter_history == IterationHistory::FULL)
+        return;
+
+    const int prev_iter = data.iter_vertex_sol_iters.at(num_sols - 2);
+    if(prev_iter != data.iter - 1)
+        return;
+
+    const bool keep = params.iter_history == IterationHistory::EVERY_N &&
+                      prev_iter % std::max(params.history_every_n_iters, 1) == 0;
+    if(!keep) {
+        data.iter_vertex_sol.erase(data.iter_vertex_sol.end() - 2);
+        data.iter_vertex_sol_iters.erase(data.iter_vertex_sol_iters.end() - 2);
     }
 }
 
 void compute_iteration_info(const reshaping::ReshapingParams& params,
-                            reshaping::ReshapingData& data) {
+                            reshaping::ReshapingState& data,
+                            const Eigen::MatrixXd& start_V,
+                            bool accelerated) {
+    CA_PROFILE_SCOPE("iteration_info");
+
+    // Maximum vertex change (against the vertices the iteration started from if
+    // the previous solution is not kept)
+    {
+        const bool has_prev_sol = !data.iter_vertex_sol_iters.empty() &&
+                                  data.iter_vertex_sol_iters.back() == data.iter - 1;
+
+        const Eigen::MatrixXd& prev_V = data.iter == 0 ? data.context->orig_vertices :
+                                        has_prev_sol   ? data.iter_vertex_sol.back()
+                                                       : start_V;
+
+        double max_vertex_change = reshaping::compute_max_vertex_change(prev_V, data.curr_vertices);
+        data.iter_max_vertex_change.push_back(max_vertex_change);
+    }
+
     // New vertices
-    data.iter_vertex_sol.push_back(data.curr_vertices);
+    record_vertex_solution(params, data);
 
-    // Energy costs
-    reshaping::ReshapingEnergy energy = reshaping::compute_reshaping_energy(params,
-                                                                            data,
-                                                                            data.curr_vertices);
+    // Energy costs (those of the last evaluated iteration if not evaluated)
+    reshaping::ReshapingEnergy energy;
+    if(is_energy_iteration(params, data, data.iter_max_vertex_change.back(), accelerated)) {
+        energy = reshaping::compute_reshaping_energy(params, data, data.curr_vertices);
+    }
+    else {
+        energy = data.iter_energy_costs.back();
+        energy.evaluated = false;
+        energy.vertex_sol_time = 0.0;
+        energy.transf_sol_time = 0.0;
+    }
     data.iter_energy_costs.push_back(energy);
 
     // Compute energy delta
-    double energy_delta = compute_total_energy_delta(data);
+    double energy_delta = energy.evaluated ? compute_total_energy_delta(data) : 0.0;
     data.iter_energy_delta.push_back(energy_delta);
 
-    // Maximum vertex change
-    {
-        const Eigen::MatrixXd& prev_V = data.iter == 0 ? data.orig_vertices
-                                                       : data.iter_vertex_sol.at(data.iter - 1);
-
-        double max_vertex_change = reshaping::compute_max_vertex_change(prev_V, data.curr_vertices);
-        data.iter_max_vertex_change.push_back(max_vertex_change);
+    if(energy.evaluated) {
+        LOGGER.info("iter {:3}: energy {:.8}   energy_delta {:.8}   max_vertex_change {:.8}",
+                    data.iter,
+                    energy.total_cost,
+                    energy_delta,
+                    data.iter_max_vertex_change.back());
+    }
+    else {
+        LOGGER.info("iter {:3}: energy (not evaluated)   max_vertex_change {:.8}",
+                    data.iter,
+                    data.iter_max_vertex_change.back());
     }
-
-    LOGGER.info("iter {:3}: energy {:.8}   energy_delta {:.8}   max_vertex_change {:.8}",
-                data.iter,
-                energy.total_cost,
-                energy_delta,
-                data.iter_max_vertex_change.back());
 
     //LOGGER.info("iter {:3}: Transf. {:.8}   Vertex {:.8}   Total {:.8}   Delta {:.8}   Max. Change {:.8}",
     //            data.iter,
@@ -125,7 +208,8 @@ void compute_iteration_info(const reshaping::ReshapingParams& params,
     //            data.iter_max_vertex_change.back());
 }
 
-void update_current_tri_normals(reshaping::ReshapingData& data) {
+void update_current_tri_normals(reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("update_current_tri_normals");
     namespace meshes = ca_essentials::meshes;
 
     const auto& mesh = data.mesh;
@@ -133,15 +217,17 @@ void update_current_tri_normals(reshaping::ReshapingData& data) {
                                                       mesh.get_facets());
 }
 
-void update_length_based_edge_weights(reshaping::ReshapingData& data) {
+void update_length_based_edge_weights(reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("update_length_based_edge_weights");
     reshaping::compute_length_based_edge_weights(data.mesh,
-                                                 data.avg_edge_len,
+                                                 data.context->avg_edge_len,
                                                  data.curr_edge_lens,
                                                  data.length_based_edge_w);
 }
 
 void update_convergence(const reshaping::ReshapingParams& params,
-                        reshaping::ReshapingData& data) {
+                        reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("convergence");
     const auto& mesh = data.mesh;
     const int num_edges = mesh.get_num_edges();
 
@@ -152,16 +238,19 @@ void update_convergence(const reshaping::ReshapingParams& params,
     double energy_delta      = data.iter_energy_delta.back();
     double max_vertex_change = data.iter_max_vertex_change.back();
 
+    // Energy-based criteria are only checked on evaluated iterations
+    const bool energy_evaluated = iter_info.evaluated;
+
     // checking if max. vertex change criterion was reached
-    double vertex_change_tol = params.max_vertex_change_tol * data.avg_edge_len;
+    double vertex_change_tol = params.max_vertex_change_tol * data.context->avg_edge_len;
     bool max_vertex_change_reached = max_vertex_change < vertex_change_tol;
 
     // checking if last energy delta is small enough to stop
     const double delta_tol = params.min_delta_tol / num_edges;
-    bool energy_delta_reached = energy_delta < delta_tol;
+    bool energy_delta_reached = energy_evaluated && energy_delta < delta_tol;
 
     // determines whether the negative energy delta criterion was reached
-    bool neg_delta_reached = data.iter > 1 && energy_delta <= 0.0;
+    bool neg_delta_reached = energy_evaluated && data.iter > 1 && energy_delta <= 0.0;
 
     // determines whether the max. number of iterations criterion was reached
     bool max_iter_reached = data.iter >= (params.max_iters - 1);
@@ -190,9 +279,12 @@ void update_convergence(const reshaping::ReshapingParams& params,
     }
 }
 
-void update_best_solution(reshaping::ReshapingData& data) {
+void update_best_solution(reshaping::ReshapingState& data) {
     // Only updates if energy gets improved
-    if(data.iter == 0 || data.iter_energy_delta.back() > 0.0) {
+    if(!data.iter_energy_costs.back().evaluated) {
+        LOGGER.debug("Best solution was NOT updated (energy not evaluated)");
+    }
+    else if(data.iter == 0 || data.iter_energy_delta.back() > 0.0) {
         LOGGER.debug("Best solution was updated with delta energy = {:.10f}",
                      data.iter_energy_delta.back());
 
@@ -205,24 +297,117 @@ void update_best_solution(reshaping::ReshapingData& data) {
     }
 }
 
-void update_final_solution(reshaping::ReshapingData& data) {
+// Combined (vertices, transformations) iteration state used by Anderson acceleration
+Eigen::VectorXd pack_iteration_state(const reshaping::ReshapingState& data) {
+    const int num_coords = (int) data.curr_vertices.size();
+    const int num_tris   = (int) data.curr_tri_T.size();
+
+    Eigen::VectorXd x(num_coords + num_tris * 9);
+    x.head(num_coords) = Eigen::Map<const Eigen::VectorXd>(data.curr_vertices.data(), num_coords);
+    for(int t = 0; t < num_tris; ++t)
+        x.segment<9>(num_coords + t * 9) = Eigen::Map<const Eigen::Matrix<double, 9, 1>>(data.curr_tri_T.at(t).data());
+
+    return x;
+}
+
+// Sets the iteration state and updates the quantities derived from it
+void unpack_iteration_state(const Eigen::VectorXd& x,
+                            reshaping::ReshapingState& data) {
+    const int num_coords = (int) data.curr_vertices.size();
+    const int num_tris   = (int) data.curr_tri_T.size();
+
+    Eigen::Map<Eigen::VectorXd>(data.curr_vertices.data(), num_coords) = x.head(num_coords);
+    for(int t = 0; t < num_tris; ++t)
+        Eigen::Map<Eigen::Matrix<double, 9, 1>>(data.curr_tri_T.at(t).data()) = x.segment<9>(num_coords + t * 9);
+
+    update_current_edge_lengths(data);
+    update_current_tri_normals(data);
+    update_length_based_edge_weights(data);
+    reshaping::update_target_edge_lengths(data);
+}
+
+// Removes the info of the last iteration (see compute_iteration_info)
+void discard_iteration_info(reshaping::ReshapingState& data) {
+    if(!data.iter_vertex_sol_iters.empty() && data.iter_vertex_sol_iters.back() == data.iter) {
+        data.iter_vertex_sol.pop_back();
+        data.iter_vertex_sol_iters.pop_back();
+    }
+    data.iter_energy_costs.pop_back();
+    data.iter_energy_delta.pop_back();
+    data.iter_max_vertex_change.pop_back();
+    data.iter_vertex_sys_stats.pop_back();
+}
+
+// Exports the kept iteration solutions to params.debug_folder
+void save_iteration_solutions(const reshaping::ReshapingParams& params,
+                              const reshaping::ReshapingState& data) {
+    const int export_freq = std::max(params.export_objs_every_n_iter, 1);
+    const Eigen::MatrixXi& F = data.mesh.get_facets();
+
+    for(size_t i = 0; i < data.iter_vertex_sol.size(); ++i) {
+        const int iter = data.iter_vertex_sol_iters.at(i);
+        if(iter < 10 || (iter + 1) % export_freq == 0)
+            reshaping::save_optimization_iter_solution(data.iter_vertex_sol.at(i), F, iter,
+                                                       params.debug_folder.string());
+    }
+}
+
+void update_final_solution(reshaping::ReshapingState& data) {
     LOGGER.debug("Setting stage best solution from iteration {}", data.best_sol_iter);
     data.curr_vertices = data.best_sol;
 }
 
 Eigen::MatrixXd compute_reshaping_solution(const reshaping::ReshapingParams& params,
-                                           reshaping::ReshapingData& data) {
+                                           reshaping::ReshapingState& data) {
+    CA_PROFILE_SCOPE("reshaping_solve");
+
     ca_essentials::core::Timer timer;
     timer.start("reshaping");
 
+    const bool anderson_on = params.anderson.is_active;
+    reshaping::AndersonAcceleration anderson;
+    if(anderson_on)
+        anderson.init(params.anderson.history_size, pack_iteration_state(data));
+
+    // Plain (non-accelerated) state of the last iteration, restored if the
+    // accelerated one is rejected
+    Eigen::VectorXd plain_state;
+    bool accelerated = false;
+
+    // Vertices each iteration starts from
+    Eigen::MatrixXd start_V;
+
     // Iterate until convergence
     do {
+        CA_PROFILE_SCOPE("iteration");
         timer.start("iter");
 
-        solve_for_vertex_positions(params.vertex_sol, data);
+        solve_for_vertex_positions(params.vertex_sol, data, start_V);
         update_current_edge_lengths(data);
 
-        compute_iteration_info(params, data);
+        compute_iteration_info(params, data, start_V, accelerated);
+
+        // Safeguard: an accelerated step increasing the energy is rejected and the
+        // iteration is performed again from the plain state
+        if(accelerated && data.iter_energy_delta.back() <= 0.0) {
+            LOGGER.debug("Iter {}: accelerated step rejected (energy delta {:.10f}). Restarting",
+                         data.iter, data.iter_energy_delta.back());
+
+            discard_iteration_info(data);
+            unpack_iteration_state(plain_state, data);
+            anderson.reset(plain_state);
+
+            accelerated = false;
+            data.num_anderson_restarts++;
+            data.avg_iter_time += timer.elapsed("iter");
+            continue;
+        }
+
+        data.iter_accelerated.push_back(accelerated);
+        if(accelerated)
+            data.num_accelerated_iters++;
+
+        prune_vertex_history(params, data);
 
         update_convergence(params, data);
         update_best_solution(data);
@@ -232,18 +417,26 @@ Eigen::MatrixXd compute_reshaping_solution(const reshaping::ReshapingParams& par
             update_length_based_edge_weights(data);
 
             solve_for_transformations(params.transf_sol, data);
-            update_target_edge_lenghts(data);
+            reshaping::update_target_edge_lengths(data);
+
+            if(anderson_on) {
+                CA_PROFILE_SCOPE("anderson");
+                timer.start("anderson");
+
+                plain_state = pack_iteration_state(data);
+                const Eigen::VectorXd& x = anderson.compute(plain_state);
+
+                accelerated = anderson.history_length() > 0;
+                if(accelerated)
+                    unpack_iteration_state(x, data);
+
+                data.anderson_time += timer.elapsed("anderson");
+            }
         }
 
         double iter_duration = timer.elapsed("iter");
         data.avg_iter_time += iter_duration;
 
-        // Save output mesh for the current iteration
-        //if(data().iter < 10 ||
-        //   ((data().iter + 1) % m_params->output_objs_every_n_iter == 0))
-        //    save_optimization_iter_solution(curr_vertices(), m_trimesh->mesh->get_facets(),
-        //                                    (int) m_curr_stage, data().iter, m_params->debug_folder.string());
-
         LOGGER.debug("Iter {}: elapsed {:.2f} s", data.iter, iter_duration / 1000.0);
 
         if(data.termination_type.has_converged())
@@ -256,8 +449,12 @@ Eigen::MatrixXd compute_reshaping_solution(const reshaping::ReshapingParams& par
 
     LOGGER.info("Optimization terminated: {}", data.termination_type.to_string());
 
+    if(params.iter_history == reshaping::IterationHistory::FULL && !params.debug_folder.empty())
+        save_iteration_solutions(params, data);
+
     if(params.handle_error_distrib_enabled) {
         LOGGER.info("Performing handle-error distribution...");
+        CA_PROFILE_SCOPE("handle_error_distribution");
         reshaping::perform_handle_error_distribution(params, data, data.curr_vertices);
     }
 
@@ -272,12 +469,12 @@ Eigen::MatrixXd compute_reshaping_solution(const reshaping::ReshapingParams& par
 namespace reshaping {
 
 Eigen::MatrixXd reshaping_solve(const ReshapingParams& params,
-                                ReshapingData& data) {
+                                ReshapingState& data) {
     const auto& mesh = data.mesh;
 
 #if SPHERICITY_ON
     const int num_faces = mesh.get_num_facets();
-    if(data.PV1.rows() != num_faces || data.PV2.rows() != num_faces) {
+    if(data.context->PV1.rows() != num_faces || data.context->PV2.rows() != num_faces) {
         LOGGER.error("Face curvature values were not provided." 
                      "3DReshapingTool cannot be used without this information when sphericity is enabled.");
         return Eigen::MatrixXd();
@@ -294,4 +491,45 @@ Eigen::MatrixXd reshaping_solve(const ReshapingParams& params,
     return outV;
 }
 
+void warm_start_from_solution(const ReshapingState& src,
+                              ReshapingState& data) {
+    // Handle-error distribution is not part of the iterations, so the best iterate
+    // (consistent with the transformations) is used instead of the final vertices
+    data.curr_vertices = src.best_sol.rows() > 0 ? src.best_sol : src.curr_vertices;
+    data.curr_tri_T    = src.curr_tri_T;
+    data.prev_tri_T    = src.curr_tri_T;
+
+    update_current_edge_lengths(data);
+    update_current_tri_normals(data);
+    update_length_based_edge_weights(data);
+    update_target_edge_lengths(data);
+
+    data.warm_start_ref_iters = src.warm_start_ref_iters >= 0 ? src.warm_start_ref_iters
+                                                              : src.iter + 1;
+}
+
+void update_target_edge_lengths(ReshapingState& data) {
+    CA_PROFILE_SCOPE("update_target_edge_lengths");
+    const auto& mesh = data.mesh;
+    const int num_edges = mesh.get_num_edges();
+    const auto& adj_e2f = mesh.get_edge_face_adjacency();
+
+    for(int e = 0; e < num_edges; ++e) {
+        const auto& edge_verts = mesh.get_edge_vertices(e);
+
+        int fid_0 = adj_e2f.at(e).at(0);
+        int fid_1 = adj_e2f.at(e).at(1);
+
+        const Eigen::Vector3d& orig_E = (data.context->orig_vertices.row(edge_verts[1]) -
+                                         data.context->orig_vertices.row(edge_verts[0]));
+
+        const Eigen::Matrix3d& T0 = data.curr_tri_T.at(fid_0);
+        const Eigen::Matrix3d& T1 = data.curr_tri_T.at(fid_1);
+
+        const Eigen::Vector3d T0_E = T0 * orig_E;
+        const Eigen::Vector3d T1_E = T1 * orig_E;
+        data.target_edge_lens(e) = (T0_E.norm() + T1_E.norm()) * 0.5;
+    }
+}
+
 }
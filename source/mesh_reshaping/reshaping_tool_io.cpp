@@ -4,6 +4,8 @@
 #include <mesh_reshaping/globals.h>
 
 #include <ca_essentials/core/logger.h>
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/memory_usage.h>
 #include <ca_essentials/meshes/save_trimesh.h>
 #include <ca_essentials/meshes/debug_utils.h>
 
@@ -15,6 +17,27 @@
 #include <fstream>
 #include <iomanip>
 
+namespace {
+
+// Adds the sizes and timings of a solved system to iter_json, with keys prefixed by
+// the solve name (vs or ts)
+void add_system_stats_to_json(const reshaping::LinearSystemStats& stats,
+                              const std::string& prefix,
+                              nlohmann::json& iter_json) {
+    iter_json[prefix + "_assembly_time"]      = stats.assembly_time;
+    iter_json[prefix + "_normal_matrix_time"] = stats.normal_matrix_time;
+    iter_json[prefix + "_factorize_time"]     = stats.factorize_time;
+    iter_json[prefix + "_solve_time"]         = stats.solve_time;
+    iter_json[prefix + "_rows"]               = stats.rows;
+    iter_json[prefix + "_unknowns"]           = stats.unknowns;
+    iter_json[prefix + "_nnz_stencils"]       = stats.nnz_stencils;
+    iter_json[prefix + "_nnz_AtWA"]           = stats.nnz_AtWA;
+    iter_json[prefix + "_nnz_factor"]         = stats.nnz_factor;
+    iter_json[prefix + "_fill_in"]            = stats.fill_in();
+}
+
+}
+
 namespace reshaping {
 
 bool save_mesh(const Eigen::MatrixXd& V,
@@ -24,6 +47,7 @@ bool save_mesh(const Eigen::MatrixXd& V,
                const std::string& suffix) {
     namespace meshes = ca_essentials::meshes;
     namespace fs = std::filesystem;
+    CA_PROFILE_SCOPE("io/save_mesh");
     
     auto fn = fs::path(out_dir) / (res_name + "_" + suffix + ".obj");
     return meshes::save_trimesh(fn.string(), V, F);
@@ -35,6 +59,7 @@ bool save_mesh(const TriMesh& mesh,
                const std::string& suffix) {
     namespace meshes = ca_essentials::meshes;
     namespace fs = std::filesystem;
+    CA_PROFILE_SCOPE("io/save_mesh");
     
     auto fn = fs::path(out_dir) / (res_name + "_" + suffix + ".obj");
     return meshes::save_trimesh(fn.string(), mesh);
@@ -48,6 +73,7 @@ bool save_edit_operation_to_obj(const reshaping::EditOperation& edit_op,
                                 const double zero_tol) {
     namespace meshes = ca_essentials::meshes;
     namespace fs = std::filesystem;
+    CA_PROFILE_SCOPE("io/save_edit_operation");
 
     const double bbox_diag = igl::bounding_box_diagonal(V);
 
@@ -89,19 +115,20 @@ bool save_optimization_iter_solution(const Eigen::MatrixXd& V,
 }
 
 bool save_optimization_info_to_json(const ca_essentials::meshes::TriMesh& mesh,
-                                    const reshaping::ReshapingData& opt_data,
+                                    const reshaping::ReshapingState& opt_data,
                                     const reshaping::ReshapingParams& opt_params,
                                     const std::string& out_dir,
                                     const std::string& res_name) {
     namespace core = ca_essentials::core;
     namespace fs = std::filesystem;
     using json = nlohmann::json;
+    CA_PROFILE_SCOPE("io/save_optimization_info");
 
     json opt_json = {};
 
-    const int num_edges = (int) opt_data.orig_edges.rows();
-    const int num_straight_pairs = opt_data.num_straight_pairs;
-    const int num_sphericity_pairs = (int) opt_data.sphericity_terms_info.size();
+    const int num_edges = (int) opt_data.orig_edges().rows();
+    const int num_straight_pairs = opt_data.context->num_straight_pairs;
+    const int num_sphericity_pairs = (int) opt_data.context->sphericity_terms_info.size();
 
     int num_iters = (int) opt_data.iter_energy_costs.size();
     const auto& final_iter = opt_data.iter_energy_costs.back();
@@ -112,6 +139,8 @@ bool save_optimization_info_to_json(const ca_essentials::meshes::TriMesh& mesh,
     opt_json["num_iters"]            = num_iters;
     opt_json["avg_iter_time"]        = opt_data.avg_iter_time;
     opt_json["total_time"]           = opt_data.total_time;
+    opt_json["precompute_time"]      = opt_data.context->precompute_time;
+    opt_json["peak_rss_mb"]          = core::get_peak_resident_memory() / (1024.0 * 1024.0);
     opt_json["num_straight_pairs"]   = num_straight_pairs;
     opt_json["num_sphericity_pairs"] = num_sphericity_pairs;
     opt_json["termination_type"]     = opt_data.termination_type.to_string();
@@ -151,7 +180,7 @@ bool save_optimization_info_to_json(const ca_essentials::meshes::TriMesh& mesh,
             const auto& vs_costs = iter.vertex_sol; 
             const auto& ts_costs = iter.transf_sol; 
 
-            stage_json.push_back({
+            json iter_json = {
                 {"vs_energy"             , vs_costs.total_cost},
                 {"vs_normal_energy"      , vs_costs.normal_cost},
                 {"vs_edge_energy"        , vs_costs.edge_cost},
@@ -170,18 +199,53 @@ bool save_optimization_info_to_json(const ca_essentials::meshes::TriMesh& mesh,
                 {"total_energy"          , iter.total_cost},
                 {"delta_energy"          , opt_data.iter_energy_delta.at(i)},
                 {"max_vertex_change"     , opt_data.iter_max_vertex_change.at(i)},
-            });
+                {"accelerated"           , opt_data.iter_accelerated.at(i)},
+                {"energy_evaluated"      , iter.evaluated},
+                {"vs_energy_time"        , iter.vertex_sol_time},
+                {"ts_energy_time"        , iter.transf_sol_time},
+            };
+
+            // Solved systems (the last iteration has no transformation solve)
+            if(i < (int) opt_data.iter_vertex_sys_stats.size())
+                add_system_stats_to_json(opt_data.iter_vertex_sys_stats.at(i), "vs", iter_json);
+            if(i < (int) opt_data.iter_transf_sys_stats.size())
+                add_system_stats_to_json(opt_data.iter_transf_sys_stats.at(i), "ts", iter_json);
+
+            stage_json.push_back(iter_json);
         }
 
         opt_json["per_iter"].push_back(stage_json);
     }
 
+    // Anderson acceleration info
+    opt_json["anderson"] = {
+        {"enabled"              , opt_params.anderson.is_active},
+        {"history_size"         , opt_params.anderson.history_size},
+        {"num_iters"            , num_iters},
+        {"num_accelerated_iters", opt_data.num_accelerated_iters},
+        {"num_restarts"         , opt_data.num_anderson_restarts},
+        {"total_time"           , opt_data.total_time},
+        {"acceleration_time"    , opt_data.anderson_time},
+        {"final_energy"         , final_iter.total_cost},
+    };
+
+    // Continuation info. Iterations saved are estimated against the cold-started
+    // solve of the sweep
+    const bool warm_started = opt_data.warm_start_ref_iters >= 0;
+    opt_json["warm_start"] = {
+        {"enabled"    , warm_started},
+        {"ref_iters"  , warm_started ? opt_data.warm_start_ref_iters : num_iters},
+        {"iters_saved", warm_started ? opt_data.warm_start_ref_iters - num_iters : 0},
+    };
+
     // Optimization params
     opt_json["opt_params"] = {};
     opt_json["opt_params"]["bc_weight"] = opt_params.vertex_sol.bc_weight;
     opt_json["opt_params"]["max_vertex_change_tol"] = opt_params.max_vertex_change_tol;
     opt_json["opt_params"]["delta_energy_tol"] = opt_params.min_delta_tol;
-    opt_json["opt_params"]["avg_edge_len"] = opt_data.avg_edge_len;
+    opt_json["opt_params"]["energy_every_n_iters"] = opt_params.compute_energy_every_n_iters;
+    opt_json["opt_params"]["iter_history"] = static_cast<int>(opt_params.iter_history);
+    opt_json["opt_params"]["avg_edge_len"] = opt_data.context->avg_edge_len;
 
     const auto& vs_params = opt_params.vertex_sol;
     opt_json["opt_params"]["vs_straight_weight"] = vs_params.straightness_weight;
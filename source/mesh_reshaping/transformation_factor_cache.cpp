@@ -0,0 +1,80 @@
+#include <mesh_reshaping/transformation_factor_cache.h>
+
+#include <mesh_reshaping/content_hash.h>
+#include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/transformation_solve.h>
+
+namespace reshaping {
+
+uint64_t compute_transf_factor_key(const ReshapingContext& ctx) {
+    uint64_t key = CONTENT_HASH_SEED;
+    key = hash_matrix(ctx.orig_vertices,  key);
+    key = hash_matrix(ctx.mesh.get_facets(), key);
+    key = hash_matrix(ctx.PV1, key);
+    key = hash_matrix(ctx.PV2, key);
+
+    // Terms of the system matrix depending on the reshaping parameters
+    // (e.g., VertexSolveParams::sphericity_k_max_const or SPHERICITY_ON)
+    key = hash_value(ctx.sphericity_terms_info.size(), key);
+    for(const SphericityTermInfo& term : ctx.sphericity_terms_info) {
+        const int vids[4] = { term.fid, term.vid_i, term.vid_j, term.vid_k };
+        key = hash_bytes(vids, sizeof(vids), key);
+        key = hash_value(term.w, key);
+        key = hash_matrix(term.R, key);
+    }
+    key = hash_matrix(ctx.similarity_term_edge_w, key);
+
+    return key;
+}
+
+std::shared_ptr<const TransfSolveFactor>
+TransfSolveFactorCache::get_or_compute(const TransfSolveParams& params,
+                                       const ReshapingState& data) {
+    uint64_t key = compute_transf_factor_key(*data.context);
+
+    const LinearSolverParams& solver_params = params.linear_solver;
+    const int solver_options[2] = { (int) solver_params.type, (int) solver_params.ordering };
+    key = hash_bytes(solver_options, sizeof(solver_options), key);
+    key = hash_bytes(&solver_params.cg_tolerance, sizeof(double), key);
+    key = hash_bytes(&solver_params.cg_max_iters, sizeof(int), key);
+
+    std::promise<std::shared_ptr<const TransfSolveFactor>> promise;
+    FactorFuture cached_factor;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const auto itr = m_factors.find(key);
+        if(itr != m_factors.end())
+            cached_factor = itr->second;
+        else
+            m_factors.emplace(key, promise.get_future().share());
+    }
+
+    // Waits (without holding the lock) if the factor is still being computed
+    if(cached_factor.valid())
+        return cached_factor.get();
+
+    // Factorization is performed outside the lock so that other meshes are not blocked
+    std::shared_ptr<const TransfSolveFactor> factor = prefactor_transformation_system(params, data);
+    promise.set_value(factor);
+
+    // Failed factorizations are not cached so they can be retried
+    if(!factor) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_factors.erase(key);
+    }
+
+    return factor;
+}
+
+size_t TransfSolveFactorCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_factors.size();
+}
+
+void TransfSolveFactorCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_factors.clear();
+}
+
+}
@@ -1,8 +1,13 @@
 #include <mesh_reshaping/vertex_solve.h>
+#include <mesh_reshaping/transformation_solve.h>
 #include <mesh_reshaping/solve_utils.h>
+#include <mesh_reshaping/normal_equations.h>
 #include <mesh_reshaping/types.h>
 #include <mesh_reshaping/globals.h>
 
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/timer.h>
+
 #include <Eigen/Core>
 
 #include <vector>
@@ -13,7 +18,7 @@ int matrix_to_sys_idx(int tid, int T_row, int T_col) {
     return reshaping::matrix_to_sys_idx(tid, T_row, T_col);
 }
 
-Eigen::Vector2i system_size(const reshaping::ReshapingData& data) {
+Eigen::Vector2i system_size(const reshaping::ReshapingState& data) {
     const int num_edges = data.mesh.get_num_edges();
     const int num_triangles = data.mesh.get_num_facets();
 
@@ -23,15 +28,15 @@ Eigen::Vector2i system_size(const reshaping::ReshapingData& data) {
     // Connect term
     num_rows += num_edges * 3;
 
-    // Similarity term
-    num_rows += num_edges * 3;
+    // Similarity term (non-zero weight edges only)
+    num_rows += (int) data.context->similarity_edges.size() * 3;
 
     // Transform term
     num_rows += num_edges * 3 * 2;
 
     // Sphericity term
 #if SPHERICITY_ON
-    num_rows += (int) data.sphericity_terms_info.size() * 3;
+    num_rows += (int) data.context->sphericity_terms_info.size() * 3;
 #endif
 
     // Normal term
@@ -43,472 +48,404 @@ Eigen::Vector2i system_size(const reshaping::ReshapingData& data) {
     return Eigen::Vector2i(num_rows, num_cols);
 }
 
-void compute_connect_entries(const reshaping::TransfSolveParams& params,
-                             const reshaping::ReshapingData& data,
-                             reshaping::TripletsVec& triplets,
-                             Eigen::VectorXd& b,
-                             Eigen::VectorXd& w,
-                             int& curr_row) {
+// Visits the connect and similarity stencils. Both terms couple the same row of the
+// two transformations adjacent to an edge, so they share one 6x6 block per edge and row.
+// Similarity rows are only added for edges in data.context->similarity_edges (non-zero weight).
+template<typename ForEach, typename Visitor>
+void visit_edge_pair_stencils(const reshaping::TransfSolveParams& params,
+                              const reshaping::ReshapingState& data,
+                              int& stencil_idx,
+                              ForEach&& for_each,
+                              Visitor&& visit) {
+    using Vector6d = Eigen::Matrix<double, 6, 1>;
+
     const auto& mesh    = data.mesh;
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    for(int e = 0; e < num_edges; ++e) {
+    const int first_idx = stencil_idx;
+    stencil_idx += num_edges * 3;
+
+    for_each(num_edges, [&](int e) {
         const int tid0 = adj_e2f.at(e).at(0);
         const int tid1 = adj_e2f.at(e).at(1);
 
-        const Eigen::Vector3d E = data.orig_edges.row(e).normalized();
-        const double w_e = 1.0;
-
-        //   ||                        ||2
-        //   || T_i e^0_ij - T_j e^0_ij||
-        //   ||                        ||
-        // 
-        //  ||                                                                               ||2
-        //  || [T_i^00 E^x + T_i^01 E^y + T_i^02 E^z - T_j^00 E^x - T_j^01 E^y - T_j^02 E^z] ||
-        //  || [T_i^10 E^x + T_i^11 E^y + T_i^12 E^z - T_j^10 E^x - T_j^11 E^y - T_j^12 E^z] ||
-        //  || [T_i^20 E^x + T_i^21 E^y + T_i^22 E^z - T_j^20 E^x - T_j^21 E^y - T_j^22 E^z] ||
-        //  ||                                                                               ||   
-
-        // First row entries
-        //  [T_i^00 E^x + T_i^01 E^y + T_i^02 E^z - T_j^00 E^x - T_j^01 E^y - T_j^02 E^z] 
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 2), E.z());
+        // Connect term: T_i e^0_ij - T_j e^0_ij
+        const Eigen::Vector3d E_connect = data.orig_edges().row(e).normalized();
 
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 2), -E.z());
+        // Similarity term: T_i e^0_kl/l^0_kl - T_j e^0_kl/l^0_kl
+        const bool similarity_on = data.context->similarity_term_edge_w(e) != 0.0;
+        const double w_similarity = data.context->similarity_term_edge_w(e) * params.similarity_weight;
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.connect_weight;
-            curr_row++;
+        Eigen::Vector3d E_similarity = Eigen::Vector3d::Zero();
+        if(similarity_on) {
+            const Eigen::Vector3d& vk = data.context->orig_vertices.row(mesh.vertex_opposite_to_edge(e, tid0));
+            const Eigen::Vector3d& vl = data.context->orig_vertices.row(mesh.vertex_opposite_to_edge(e, tid1));
+            E_similarity = (vk - vl).normalized();
         }
 
-        // Second row entries
-        // [T_i^10 E^x + T_i^11 E^y + T_i^12 E^z - T_j^10 E^x - T_j^11 E^y - T_j^12 E^z]
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 2), E.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 2), -E.z());
-
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.connect_weight;
-            curr_row++;
-        }
+        for(int r = 0; r < 3; ++r) {
+            // Unknowns: [T_i^r0, T_i^r1, T_i^r2, T_j^r0, T_j^r1, T_j^r2]
+            reshaping::LocalStencil<6> stencil;
+            for(int c = 0; c < 3; ++c) {
+                stencil.cols[c    ] = matrix_to_sys_idx(tid0, r, c);
+                stencil.cols[c + 3] = matrix_to_sys_idx(tid1, r, c);
+            }
 
-        // Third row entries
-        // [T_i^20 E^x + T_i^21 E^y + T_i^22 E^z - T_j^20 E^x - T_j^21 E^y - T_j^22 E^z]
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 2), E.z());
+            Vector6d a;
+            a << E_connect, -E_connect;
+            stencil.add_row(a, 0.0, params.connect_weight);
 
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 2), -E.z());
+            if(similarity_on) {
+                a << E_similarity, -E_similarity;
+                stencil.add_row(a, 0.0, w_similarity);
+            }
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.connect_weight;
-            curr_row++;
+            visit(first_idx + e * 3 + r, stencil);
         }
-    }
+    });
 }
 
+// Visits the transform and normal stencils: one 9x9 block per edge and adjacent face
+template<typename ForEach, typename Visitor>
+void visit_edge_face_stencils(const reshaping::TransfSolveParams& params,
+                              const reshaping::ReshapingState& data,
+                              int& stencil_idx,
+                              ForEach&& for_each,
+                              Visitor&& visit) {
+    using Vector9d = Eigen::Matrix<double, 9, 1>;
 
-void compute_similarity_entries(const reshaping::TransfSolveParams& params,
-                                const reshaping::ReshapingData& data,
-                                reshaping::TripletsVec& triplets,
-                                Eigen::VectorXd& b,
-                                Eigen::VectorXd& w,
-                                int& curr_row) {
     const auto& mesh    = data.mesh;
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    for(int i = 0; i < num_edges; ++i) {
-        const int tid0 = adj_e2f.at(i).at(0);
-        const int tid1 = adj_e2f.at(i).at(1);
-
-        int vid_k = mesh.vertex_opposite_to_edge(i, tid0);
-        int vid_l = mesh.vertex_opposite_to_edge(i, tid1);
-
-        const Eigen::Vector3d& vk = data.orig_vertices.row(vid_k);
-        const Eigen::Vector3d& vl = data.orig_vertices.row(vid_l);
-        const Eigen::Vector3d E   = (vk - vl).normalized();
-
-        const double w_e = data.similarity_term_edge_w(i);
-
-        //   ||                                      ||2
-        //   || T_i e^0_kl/l^0_kl - T_j e^0_kl/l^0_kl||
-        //   ||                                      ||
-        // 
-        //  ||                                                                               ||2
-        //  || [T_i^00 E^x + T_i^01 E^y + T_i^02 E^z - T_j^00 E^x - T_j^01 E^y - T_j^02 E^z] ||
-        //  || [T_i^10 E^x + T_i^11 E^y + T_i^12 E^z - T_j^10 E^x - T_j^11 E^y - T_j^12 E^z] ||
-        //  || [T_i^20 E^x + T_i^21 E^y + T_i^22 E^z - T_j^20 E^x - T_j^21 E^y - T_j^22 E^z] ||
-        //  ||                                                                               ||   
-        //
-        // where E = e^0_kl/l^0_kl
-
-        // First row entries
-        //  [T_i^00 E^x + T_i^01 E^y + T_i^02 E^z - T_j^00 E^x - T_j^01 E^y - T_j^02 E^z] 
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 0, 2), E.z());
+    const double w_ij = 1.0 / data.context->avg_edge_len;
 
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 0, 2), -E.z());
+    const int first_idx = stencil_idx;
+    stencil_idx += num_edges * 2;
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.similarity_weight;
-            curr_row++;
-        }
+    for_each(num_edges, [&](int e) {
+        std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
 
-        // Second row entries
-        // [T_i^10 E^x + T_i^11 E^y + T_i^12 E^z - T_j^10 E^x - T_j^11 E^y - T_j^12 E^z]
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 1, 2), E.z());
+        const Eigen::Vector3d& curr_v0  = data.curr_vertices.row(edge_vids[0]);
+        const Eigen::Vector3d& curr_v1  = data.curr_vertices.row(edge_vids[1]);
+        const Eigen::Vector3d curr_edge = curr_v1 - curr_v0;
 
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 1, 2), -E.z());
+        const Eigen::Vector3d& orig_edge = data.orig_edges().row(e);
+        const Eigen::Vector3d E          = orig_edge.normalized();
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.similarity_weight;
-            curr_row++;
-        }
+        for(int f = 0; f < 2; ++f) {
+            const int fid = adj_e2f.at(e).at(f);
+            const Eigen::Vector3d& N = data.orig_tri_N().row(fid);
 
-        // Third row entries
-        // [T_i^20 E^x + T_i^21 E^y + T_i^22 E^z - T_j^20 E^x - T_j^21 E^y - T_j^22 E^z]
-        {
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 0), E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 1), E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid0, 2, 2), E.z());
+            reshaping::LocalStencil<9> stencil;
+            for(int k = 0; k < 9; ++k)
+                stencil.cols[k] = matrix_to_sys_idx(fid, k / 3, k % 3);
+
+            // Transform term: T_i e^0_ij = e_ij
+            for(int r = 0; r < 3; ++r) {
+                Vector9d a = Vector9d::Zero();
+                a.segment<3>(3 * r) = orig_edge;
+                stencil.add_row(a, curr_edge(r), w_ij);
+            }
 
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 0), -E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 1), -E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid1, 2, 2), -E.z());
+            // Normal term: (T_i e^0_ij) . n_i = 0
+            Vector9d a;
+            for(int r = 0; r < 3; ++r)
+                a.segment<3>(3 * r) = N(r) * E;
+            stencil.add_row(a, 0.0, params.normal_weight);
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_e * params.similarity_weight;
-            curr_row++;
+            visit(first_idx + e * 2 + f, stencil);
         }
-    }
+    });
 }
 
+// Visits one 9x9 stencil per sphericity term: [T E_ij] - [s R T E_ik]
+template<typename ForEach, typename Visitor>
+void visit_sphericity_stencils(const reshaping::TransfSolveParams& params,
+                               const reshaping::ReshapingState& data,
+                               int& stencil_idx,
+                               ForEach&& for_each,
+                               Visitor&& visit) {
+    using Vector9d = Eigen::Matrix<double, 9, 1>;
+
+    const int num_terms = (int) data.context->sphericity_terms_info.size();
+    const int first_idx = stencil_idx;
+    stencil_idx += num_terms;
+
+    for_each(num_terms, [&](int t) {
+        const auto& info = data.context->sphericity_terms_info.at(t);
+        const int fid = info.fid;
+        const Eigen::Matrix3d& R = info.R;
 
-void compute_transform_entries(const reshaping::TransfSolveParams& params,
-                               const reshaping::ReshapingData& data,
-                               reshaping::TripletsVec& triplets,
-                               Eigen::VectorXd& b,
-                               Eigen::VectorXd& w,
-                               int& curr_row) {
-    const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    /*
-     * |                   |^2  |                   |^2
-     * | e_ij - T_i e^0_ij |  + | e_ij - T_j e^0_ij |  
-     * |                   |    |                   |  
-     */
-    for(int e = 0; e < num_edges; ++e) {
-        std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
+        const Eigen::Vector3d Eij = (data.context->orig_vertices.row(info.vid_j) -
+                                     data.context->orig_vertices.row(info.vid_i)).normalized();
 
-        const Eigen::Vector3d& curr_v0  = data.curr_vertices.row(edge_vids[0]);
-        const Eigen::Vector3d& curr_v1  = data.curr_vertices.row(edge_vids[1]);
-        const Eigen::Vector3d curr_edge = curr_v1 - curr_v0;
+        const Eigen::Vector3d Eik = (data.context->orig_vertices.row(info.vid_k) -
+                                     data.context->orig_vertices.row(info.vid_i)).normalized();
 
-        const Eigen::Vector3d& orig_edge = data.orig_edges.row(e);
+        reshaping::LocalStencil<9> stencil;
+        for(int k = 0; k < 9; ++k)
+            stencil.cols[k] = matrix_to_sys_idx(fid, k / 3, k % 3);
 
-        for(int f = 0; f < 2; ++f) {
-            const int fid = adj_e2f.at(e).at(f);
+        for(int d = 0; d < 3; ++d) {
+            Vector9d a = Vector9d::Zero();
+            a.segment<3>(3 * d) += Eij;
 
-            double w_ij = 1.0 / data.avg_edge_len;
+            for(int c = 0; c < 3; ++c)
+                a.segment<3>(3 * c) -= R(d, c) * Eik;
 
-            // x-component 
-            // T^00_i E^0_x + T^01_i E^0_y + T^02 E^0_z = E_x
-            {
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 0), orig_edge.x());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 1), orig_edge.y());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 2), orig_edge.z());
+            stencil.add_row(a, 0.0, params.sphericity_term_weight * info.w);
+        }
 
-                b(curr_row) = curr_edge.x();
-                w(curr_row) = w_ij;
-                curr_row++;
-            }
+        visit(first_idx + t, stencil);
+    });
+}
 
-            // y-component 
-            // T^10_i E^0_x + T^11_i E^0_y + T^12 E^0_z = E_y
-            {
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 0), orig_edge.x());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 1), orig_edge.y());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 2), orig_edge.z());
+// Visits one 1x1 stencil per transformation entry (T_i = I)
+template<typename ForEach, typename Visitor>
+void visit_regularizer_stencils(const reshaping::TransfSolveParams& params,
+                                const reshaping::ReshapingState& data,
+                                int& stencil_idx,
+                                ForEach&& for_each,
+                                Visitor&& visit) {
+    const int num_tris = data.mesh.get_num_facets();
+    const Eigen::Matrix<double, 1, 1> a = Eigen::Matrix<double, 1, 1>::Ones();
 
-                b(curr_row) = curr_edge.y();
-                w(curr_row) = w_ij;
-                curr_row++;
-            }
+    const int first_idx = stencil_idx;
+    stencil_idx += num_tris * 9;
 
-            // z-component 
-            // T^20_i E^0_x + T^21_i E^0_y + T^22 E^0_z = E_z
-            {
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 0), orig_edge.x());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 1), orig_edge.y());
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 2), orig_edge.z());
+    for_each(num_tris, [&](int t) {
+        for(int i = 0; i < 3; ++i) {
+            for(int j = 0; j < 3; ++j) {
+                reshaping::LocalStencil<1> stencil;
+                stencil.cols = { matrix_to_sys_idx(t, i, j) };
+                stencil.add_row(a, i == j ? 1.0 : 0.0, params.regularizer_weight);
 
-                b(curr_row) = curr_edge.z();
-                w(curr_row) = w_ij;
-                curr_row++;
+                visit(first_idx + matrix_to_sys_idx(t, i, j), stencil);
             }
         }
+    });
+}
+
+template<typename ForEach, typename Visitor>
+void visit_transformation_solve_stencils(const reshaping::TransfSolveParams& params,
+                                         const reshaping::ReshapingState& data,
+                                         ForEach&& for_each,
+                                         Visitor&& visit) {
+    int stencil_idx = 0;
+    visit_edge_pair_stencils  (params, data, stencil_idx, for_each, visit);
+    visit_edge_face_stencils  (params, data, stencil_idx, for_each, visit);
+#if SPHERICITY_ON
+    visit_sphericity_stencils (params, data, stencil_idx, for_each, visit);
+#endif
+    visit_regularizer_stencils(params, data, stencil_idx, for_each, visit);
+}
+
+// Assembles the normal equations (AtWA, AtWb) of the transformation solve. The
+// pattern is built when empty and reused otherwise.
+void assemble_transformation_solve_system(const reshaping::TransfSolveParams& params,
+                                          const reshaping::ReshapingState& data,
+                                          reshaping::StencilPattern& pattern,
+                                          Eigen::SparseMatrix<double>& AtWA,
+                                          Eigen::VectorXd& AtWb,
+                                          reshaping::LinearSystemStats* stats = nullptr) {
+    CA_PROFILE_SCOPE("transf_solve/assembly");
+
+    ca_essentials::core::Timer timer;
+    timer.start("assembly");
+
+    const Eigen::Vector2i sys_size = system_size(data);
+
+    const double normal_matrix_time = reshaping::assemble_normal_equations(sys_size.y(),
+                                         [&](auto&& for_each, auto&& visit) {
+                                             visit_transformation_solve_stencils(params, data, for_each, visit);
+                                         },
+                                         pattern,
+                                         AtWA,
+                                         AtWb,
+                                         params.parallel_assembly,
+                                         "transf_solve/normal_matrix");
+
+    if(stats) {
+        stats->assembly_time      = timer.elapsed("assembly");
+        stats->normal_matrix_time = normal_matrix_time;
+        stats->rows               = sys_size.x();
+        stats->unknowns           = sys_size.y();
+        stats->nnz_stencils       = pattern.num_entries();
+        stats->nnz_AtWA           = AtWA.nonZeros();
     }
 }
 
-void compute_normal_entries(const reshaping::TransfSolveParams& params,
-                            const reshaping::ReshapingData& data,
-                            reshaping::TripletsVec& triplets,
-                            Eigen::VectorXd& b,
-                            Eigen::VectorXd& w,
-                            int& curr_row) {
+// Accumulates At * W * b for the transform term rows directly. These are the
+// only rows (besides the regularizer ones) with non-zero right-hand side.
+void compute_transform_rhs_entries(const reshaping::ReshapingState& data,
+                                   Eigen::VectorXd& AtWb) {
     const auto& mesh    = data.mesh;
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
+    const double w_ij = 1.0 / data.context->avg_edge_len;
+
     for(int e = 0; e < num_edges; ++e) {
-        const Eigen::Vector3d E = data.orig_edges.row(e).normalized();
+        std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
 
-        const double w_e = 1.0;
+        const Eigen::Vector3d& curr_v0  = data.curr_vertices.row(edge_vids[0]);
+        const Eigen::Vector3d& curr_v1  = data.curr_vertices.row(edge_vids[1]);
+        const Eigen::Vector3d curr_edge = curr_v1 - curr_v0;
 
-        /*
-         * ((T_i e^0_ij) . n_i)^2 + ((T_j e^0_ij) . n_j)^2
-         */
+        const Eigen::Vector3d& orig_edge = data.orig_edges().row(e);
+
+        // Row (fid, r) has entries E^0_c at T^rc_i and right-hand side E_r
         for(int f = 0; f < 2; ++f) {
             const int fid = adj_e2f.at(e).at(f);
-            const int tid = fid;
-            const Eigen::Vector3d& N = data.orig_tri_N.row(fid);
-
-            // ( 
-            //      n^x E_x T^{00} + n^x E_y T^{01} + n^x E_z T^{02} +
-            //      n^y E_x T^{10} + n^y E_y T^{11} + n^y E_z T^{12} +
-            //      n^z E_x T^{20} + n^z E_y T^{21} + n^z E_z T^{22} +
-            // )^2
-
-            // n^x E_x T^{00} + n^x E_y T^{01} + n^x E_z T^{02} +
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 0, 0), N.x() * E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 0, 1), N.x() * E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 0, 2), N.x() * E.z());
-
-            // n^y E_x T^{10} + n^y E_y T^{11} + n^y E_z T^{12} +
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 1, 0), N.y() * E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 1, 1), N.y() * E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 1, 2), N.y() * E.z());
-
-            // n^z E_x T^{20} + n^z E_y T^{21} + n^z E_z T^{22} +
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 2, 0), N.z() * E.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 2, 1), N.z() * E.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(tid, 2, 2), N.z() * E.z());
-
-            b(curr_row) = 0.0;
-            w(curr_row) = params.normal_weight * w_e;
-            curr_row++;
+
+            for(int r = 0; r < 3; ++r)
+                for(int c = 0; c < 3; ++c)
+                    AtWb(matrix_to_sys_idx(fid, r, c)) += w_ij * orig_edge(c) * curr_edge(r);
         }
     }
 }
 
-void compute_sphericity_entries(const reshaping::TransfSolveParams& params,
-                                const reshaping::ReshapingData& data,
-                                reshaping::TripletsVec& triplets,
-                                Eigen::VectorXd& b,
-                                Eigen::VectorXd& w,
-                                int& curr_row) {
-
-    for(const auto& info : data.sphericity_terms_info) {
-        const int fid            = info.fid;
-        const int vid_i          = info.vid_i;
-        const int vid_j          = info.vid_j;
-        const int vid_k          = info.vid_k;
-        const double face_weight = info.w;
-        const Eigen::Matrix3d& R = info.R;
-
-        const Eigen::Vector3d Eij = (data.orig_vertices.row(vid_j) -
-                                     data.orig_vertices.row(vid_i)).normalized();
+// Accumulates At * W * b for the regularizer term rows (T_i = I)
+void compute_regularizer_rhs_entries(const reshaping::TransfSolveParams& params,
+                                     const reshaping::ReshapingState& data,
+                                     Eigen::VectorXd& AtWb) {
+    const int num_tris = data.mesh.get_num_facets();
 
-        const Eigen::Vector3d Eik = (data.orig_vertices.row(vid_k) -
-                                     data.orig_vertices.row(vid_i)).normalized();
+    for(int t = 0; t < num_tris; ++t)
+        for(int i = 0; i < 3; ++i)
+            AtWb(matrix_to_sys_idx(t, i, i)) += params.regularizer_weight;
+}
 
-        // x-component equations
-        // [T E_ij]_x - [s R T E_ik]_x
-        {
-            // E_ij_x
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 0), Eij.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 1), Eij.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 2), Eij.z());
-
-            // [s R T E_ik]_x
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 0), -R(0, 0) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 1), -R(0, 0) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 2), -R(0, 0) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 0), -R(0, 1) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 1), -R(0, 1) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 2), -R(0, 1) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 0), -R(0, 2) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 1), -R(0, 2) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 2), -R(0, 2) * Eik.z());
-
-            b(curr_row) = 0.0;
-            w(curr_row) = params.sphericity_term_weight * face_weight;
-            curr_row++;
-        }
+// Computes the right-hand side of the normal equations (At * W * b) without
+// assembling the system matrix
+void assemble_transformation_solve_rhs(const reshaping::TransfSolveParams& params,
+                                       const reshaping::ReshapingState& data,
+                                       Eigen::VectorXd& AtWb) {
+    CA_PROFILE_SCOPE("transf_solve/assembly_rhs");
 
-        // y-component equations
-        // [T E_ij]_y - [s R T E_ik]_y
-        {
-            // E_ij_y
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 0), Eij.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 1), Eij.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 2), Eij.z());
-
-            // [s R T E_ik]_y
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 0), -R(1, 0) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 1), -R(1, 0) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 2), -R(1, 0) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 0), -R(1, 1) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 1), -R(1, 1) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 2), -R(1, 1) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 0), -R(1, 2) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 1), -R(1, 2) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 2), -R(1, 2) * Eik.z());
-
-            b(curr_row) = 0.0;
-            w(curr_row) = params.sphericity_term_weight * face_weight;
-            curr_row++;
-        }
+    Eigen::Vector2i sys_size = system_size(data);
 
-        // z-component equations
-        // [T E_ij]_z - [s R T E_ik]_z
-        {
-            // E_ij_y
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 0), Eij.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 1), Eij.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 2), Eij.z());
-
-            // [s R T E_ik]_y
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 0), -R(2, 0) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 1), -R(2, 0) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 0, 2), -R(2, 0) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 0), -R(2, 1) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 1), -R(2, 1) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 1, 2), -R(2, 1) * Eik.z());
-
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 0), -R(2, 2) * Eik.x());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 1), -R(2, 2) * Eik.y());
-            triplets.emplace_back(curr_row, matrix_to_sys_idx(fid, 2, 2), -R(2, 2) * Eik.z());
-
-            b(curr_row) = 0.0;
-            w(curr_row) = params.sphericity_term_weight * face_weight;
-            curr_row++;
-        }
-    }
+    AtWb.setZero(sys_size.y());
+    compute_transform_rhs_entries  (data, AtWb);
+    compute_regularizer_rhs_entries(params, data, AtWb);
 }
 
-void compute_regularizer_entries(const reshaping::TransfSolveParams& params,
-                                 const reshaping::ReshapingData& data,
-                                 reshaping::TripletsVec& triplets,
-                                 Eigen::VectorXd& b,
-                                 Eigen::VectorXd& w,
-                                 int& curr_row) {
-    const int num_tris = data.mesh.get_num_facets();
+}
 
-    for(int t = 0; t < num_tris; ++t) {
-        for(int i = 0; i < 3; ++i) {
-            for(int j = 0; j < 3; ++j) {
-                triplets.emplace_back(curr_row, matrix_to_sys_idx(t, i, j),  1.0);
+namespace reshaping {
 
-                b(curr_row) = i == j ? 1.0 : 0.0;
-                w(curr_row) = params.regularizer_weight;
-                curr_row++;
-            }
-        }
-    }
-}
+std::shared_ptr<const TransfSolveFactor>
+prefactor_transformation_system(const TransfSolveParams& params,
+                                const ReshapingState& data) {
+    auto factor = std::make_shared<TransfSolveFactor>();
 
-void assemble_transformation_solve_system(const reshaping::TransfSolveParams& params,
-                                          const reshaping::ReshapingData& data,
-                                          Eigen::SparseMatrix<double>& A,
-                                          Eigen::VectorXd& b,
-                                          Eigen::VectorXd& w) {
+    StencilPattern pattern;
+    Eigen::SparseMatrix<double> AtWA;
+    Eigen::VectorXd AtWb;
+    assemble_transformation_solve_system(params, data, pattern, AtWA, AtWb, &factor->sys_stats);
 
-    Eigen::Vector2i sys_size = system_size(data);
+    factor->solver = make_linear_solver(params.linear_solver);
 
-    reshaping::TripletsVec all_triplets;
-    b.resize(sys_size.x());
-    w.resize(sys_size.x());
-    A.resize((Eigen::Index) sys_size.x(), (Eigen::Index) sys_size.y());
+    ca_essentials::core::Timer timer;
+    timer.start("factorize");
 
-    int curr_row = 0;
-    compute_connect_entries   (params, data, all_triplets, b, w, curr_row);
-    compute_similarity_entries(params, data, all_triplets, b, w, curr_row);
-    compute_transform_entries (params, data, all_triplets, b, w, curr_row);
-    compute_normal_entries    (params, data, all_triplets, b, w, curr_row);
-#if SPHERICITY_ON
-    compute_sphericity_entries (params, data, all_triplets, b, w, curr_row);
-#endif
-    compute_regularizer_entries(params, data, all_triplets, b, w, curr_row);
+    bool decomposition_succ = factor->solver->analyze_pattern(AtWA) &&
+                              factor->solver->factorize(AtWA);
+    if(!decomposition_succ) {
+        LOGGER.error("Error while pre-factorizing the transformation solver system ({})",
+                     factor->solver->name());
+        return nullptr;
+    }
+    factor->sys_stats.factorize_time = timer.elapsed("factorize");
+    factor->sys_stats.nnz_factor     = factor->solver->factor_nonzeros();
 
-    A.setFromTriplets(all_triplets.begin(), all_triplets.end());
+    return factor;
 }
 
-}
+bool solve_for_transformations(const TransfSolveParams& params,
+                               ReshapingState& data,
+                               std::vector<Eigen::Matrix3d>& out_T,
+                               LinearSystemStats* stats) {
+    ca_essentials::core::Timer timer;
+
+    bool decomposition_succ = true;
+    double factorize_time = 0.0;
+    Eigen::VectorXd AtWb;
+
+    const bool use_prefactored = params.factor_once && data.context->transf_factor;
+    const LinearSolverBackend& solver = use_prefactored ? *data.context->transf_factor->solver
+                                                        : *data.transf_solver;
+    if(use_prefactored) {
+        // System matrix was factorized during precomputation
+        timer.start("assembly");
+        assemble_transformation_solve_rhs(params, data, AtWb);
+
+        if(stats) {
+            *stats = data.context->transf_factor->sys_stats;
+            stats->assembly_time      = timer.elapsed("assembly");
+            stats->normal_matrix_time = 0.0;
+            stats->factorize_time     = 0.0;
+        }
+    }
+    else {
+        const bool pattern_changed = data.transf_sys_pattern.empty();
+        assemble_transformation_solve_system(params, data,
+                                             data.transf_sys_pattern,
+                                             data.transf_AtWA,
+                                             AtWb,
+                                             stats);
+        const Eigen::SparseMatrix<double>& AtWA = data.transf_AtWA;
+
+        timer.start("factorize");
+        bool needs_prefactorization = data.iter == 0 || pattern_changed;
+        if(needs_prefactorization) {
+            CA_PROFILE_SCOPE("transf_solve/analyze_pattern");
+            data.transf_solver->analyze_pattern(AtWA);
+        }
 
-namespace reshaping {
+        // Check whether the decomposition has failed
+        {
+            CA_PROFILE_SCOPE("transf_solve/factorize");
+            decomposition_succ = data.transf_solver->factorize(AtWA);
+        }
+        factorize_time = timer.elapsed("factorize");
+        if(!decomposition_succ) {
+            LOGGER.error("Error while performing the decomposition in the transformation solver ({})",
+                         solver.name());
+            assert(false);
+        }
+    }
 
-bool solve_for_transformations(const TransfSolveParams& params,
-                               ReshapingData& data,
-                               std::vector<Eigen::Matrix3d>& out_T) {
-    Eigen::SparseMatrix<double> A;
-    Eigen::VectorXd b;
-    Eigen::VectorXd w;
-    assemble_transformation_solve_system(params, data, A, b, w);
-
-    const Eigen::Transpose<Eigen::SparseMatrix<double>> At = A.transpose();
-    const Eigen::DiagonalWrapper<const Eigen::VectorXd> W  = w.asDiagonal();
-    Eigen::SparseMatrix<double> AtWA = At * W * A;
-    Eigen::VectorXd AtWb             = At * W * b;
-
-    bool needs_prefactorization = data.iter == 0;
-    if(needs_prefactorization)
-        data.transf_solver.analyzePattern(AtWA);
-
-    data.transf_solver.factorize(AtWA);
-
-    // Check whether the decomposition has failed
-    bool decomposition_succ = data.transf_solver.info() == Eigen::Success;
-    if(!decomposition_succ) {
-        LOGGER.error("Error while performing Cholesky decomposition in the transformation solver ({})",
-                                      data.transf_solver.info());
-        assert(false);
+    const int num_tris = data.mesh.get_num_facets();
+
+    // Iterative solvers start from the current transformations
+    Eigen::VectorXd sol;
+    if(solver.is_iterative()) {
+        sol.resize(num_tris * 9);
+        for(int t = 0; t < num_tris; ++t)
+            for(int r = 0; r < 3; r++)
+                for(int c = 0; c < 3; c++)
+                    sol(matrix_to_sys_idx(t, r, c)) = data.curr_tri_T.at(t)(r, c);
     }
 
     // Computing solution
-    Eigen::VectorXd sol = data.transf_solver.solve(AtWb);
+    bool solution_succ = false;
+    {
+        CA_PROFILE_SCOPE("transf_solve/solve");
+        timer.start("solve");
+        solution_succ = solver.solve(AtWb, sol);
+    }
+
+    if(stats) {
+        if(!use_prefactored) {
+            stats->factorize_time = factorize_time;
+            stats->nnz_factor     = solver.factor_nonzeros();
+        }
+        stats->solve_time = timer.elapsed("solve");
+    }
 
-    const int num_tris = data.mesh.get_num_facets();
     for(int t = 0; t < num_tris; ++t) {
         // Retreiving each matrix's value
         for(int r = 0; r < 3; r++)
@@ -516,13 +453,56 @@ bool solve_for_transformations(const TransfSolveParams& params,
                 out_T.at(t)(r, c) = sol(matrix_to_sys_idx(t, r, c));
     }
 
-    bool solution_succ = data.vertex_solver.info() == Eigen::Success;
     if(!solution_succ) {
-        LOGGER.error("Error while performing Cholesky::solve in the Transformation-solver");
+        LOGGER.error("Error while performing {}::solve in the Transformation-solver", solver.name());
         assert(false); // TODO: use release-compatible assert
     }
 
     return decomposition_succ && solution_succ;
 }
 
-}
\ No newline at end of file
+void assemble_transformation_solve_normal_equations(const TransfSolveParams& params,
+                                                    ReshapingState& data,
+                                                    Eigen::VectorXd& AtWb,
+                                                    LinearSystemStats* stats) {
+    assemble_transformation_solve_system(params, data,
+                                         data.transf_sys_pattern,
+                                         data.transf_AtWA,
+                                         AtWb,
+                                         stats);
+}
+
+double evaluate_transformation_solve_stencils(const TransfSolveParams& params,
+                                              const ReshapingState& data,
+                                              TransfSolveTerms terms) {
+    double sum = 0.0;
+    auto accumulate = [&](int, const auto& stencil) {
+        sum += stencil.K.trace() + stencil.f.sum();
+    };
+
+    int stencil_idx = 0;
+    const SerialForEach for_each;
+    switch(terms) {
+        case TransfSolveTerms::EdgePairs:
+            visit_edge_pair_stencils(params, data, stencil_idx, for_each, accumulate);
+            break;
+        case TransfSolveTerms::EdgeFaces:
+            visit_edge_face_stencils(params, data, stencil_idx, for_each, accumulate);
+            break;
+        case TransfSolveTerms::Sphericity:
+#if SPHERICITY_ON
+            visit_sphericity_stencils(params, data, stencil_idx, for_each, accumulate);
+#endif
+            break;
+        case TransfSolveTerms::Regularizer:
+            visit_regularizer_stencils(params, data, stencil_idx, for_each, accumulate);
+            break;
+        case TransfSolveTerms::All:
+            visit_transformation_solve_stencils(params, data, for_each, accumulate);
+            break;
+    }
+
+    return sum;
+}
+
+}
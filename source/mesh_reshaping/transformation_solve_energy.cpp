@@ -1,139 +1,76 @@
 #include <mesh_reshaping/transformation_solve_energy.h>
 
 #include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/blocked_sum.h>
 #include <mesh_reshaping/types.h>
 
 namespace {
-double compute_transform_term_cost(const reshaping::ReshapingData& data,
-                                   const Eigen::MatrixXd& V) {
-    const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    double cost = 0.0;
-    for(int e = 0; e < num_edges; ++e) {
-        std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
-
-        const Eigen::Vector3d E = data.orig_edges.row(e).normalized();
-
-        const double w_e = 1.0;
-
-        /*
-         * ((T_i e^0_ij) . n_i)^2 + ((T_j e^0_ij) . n_j)^2
-         */
-        for(int f = 0; f < 2; ++f) {
-            const int fid = adj_e2f.at(e).at(f);
-            const Eigen::Matrix3d& Ti = data.curr_tri_T.at(fid);
-            const Eigen::Vector3d& N  = data.orig_tri_N.row(fid);
-
-            cost += w_e * pow((Ti * E).dot(N), 2.0);
-        }
-    }
 
-    return cost;
-}
-
-double compute_connect_term_cost(const reshaping::ReshapingData& data,
-                                 const Eigen::MatrixXd& V) {
+// Normal and connect term costs, evaluated in a single pass over the edges.
+// Returns (normal_cost, connect_cost).
+Eigen::Vector2d compute_edge_terms_costs(const reshaping::ReshapingState& data,
+                                         bool parallel) {
     const auto& mesh    = data.mesh;
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    double cost = 0.0;
-
-    // ||                        ||2
-    // || T_i e^0_ij - T_j e^0_ij||
-    // ||                        ||
-    for(int e = 0; e < num_edges; ++e) {
+    return reshaping::blocked_sum<2>(num_edges, [&](int e, Eigen::Vector2d& costs) {
         const int tid0 = adj_e2f.at(e).at(0);
         const int tid1 = adj_e2f.at(e).at(1);
 
         const Eigen::Matrix3d& T0 = data.curr_tri_T.at(tid0);
         const Eigen::Matrix3d& T1 = data.curr_tri_T.at(tid1);
 
-        const Eigen::Vector3d E = data.orig_edges.row(e).normalized();
-
-        double edge_cost = (T0 * E - T1 * E).squaredNorm();
-
-        cost += edge_cost;
-    }
-
-    return cost;
-}
-
-double compute_normal_term_cost(const reshaping::ReshapingData& data,
-                                const Eigen::MatrixXd& V) {
-    const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    double cost = 0.0;
-    for(int e = 0; e < num_edges; ++e) {
-        std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
-
-        const Eigen::Vector3d E = data.orig_edges.row(e).normalized();
-
-        const double w_e = 1.0;
+        const Eigen::Vector3d E    = data.orig_edges().row(e).normalized();
+        const Eigen::Vector3d T0_E = T0 * E;
+        const Eigen::Vector3d T1_E = T1 * E;
 
         /*
          * ((T_i e^0_ij) . n_i)^2 + ((T_j e^0_ij) . n_j)^2
          */
-        for(int f = 0; f < 2; ++f) {
-            const int fid = adj_e2f.at(e).at(f);
-            const Eigen::Matrix3d& Ti = data.curr_tri_T.at(fid);
-            const Eigen::Vector3d& N  = data.orig_tri_N.row(fid);
-
-            cost += w_e * pow((Ti * E).dot(N), 2.0);
-        }
-    }
-
-    return cost;
+        const Eigen::Vector3d& N0 = data.orig_tri_N().row(tid0);
+        const Eigen::Vector3d& N1 = data.orig_tri_N().row(tid1);
+        costs(0) += pow(T0_E.dot(N0), 2.0);
+        costs(0) += pow(T1_E.dot(N1), 2.0);
+
+        // ||                        ||2
+        // || T_i e^0_ij - T_j e^0_ij||
+        // ||                        ||
+        costs(1) += (T0_E - T1_E).squaredNorm();
+    }, parallel);
 }
 
-double compute_sphericity_term_cost(const reshaping::ReshapingData& data,
-                                    const Eigen::MatrixXd& V) {
-    const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    double cost = 0.0;
-
-    if(data.sphericity_terms_info.size() == 0)
-        return cost;
-
-    for(const auto& info : data.sphericity_terms_info) {
-        const int fid            = info.fid;
-        const int vid_i          = info.vid_i;
-        const int vid_j          = info.vid_j;
-        const int vid_k          = info.vid_k;
-        const double face_weight = info.w;
-        const Eigen::Matrix3d& R = info.R;
+double compute_sphericity_term_cost(const reshaping::ReshapingState& data,
+                                    bool parallel) {
+    const auto& terms_info = data.context->sphericity_terms_info;
 
-        const Eigen::Vector3d Eij = (data.orig_vertices.row(vid_j) -
-                                     data.orig_vertices.row(vid_i)).normalized();
+    return reshaping::blocked_sum<1>((int) terms_info.size(), [&](int t, Eigen::Matrix<double, 1, 1>& cost) {
+        const auto& info = terms_info[t];
 
-        const Eigen::Vector3d Eik = (data.orig_vertices.row(vid_k) -
-                                     data.orig_vertices.row(vid_i)).normalized();
+        const Eigen::Vector3d Eij = (data.context->orig_vertices.row(info.vid_j) -
+                                     data.context->orig_vertices.row(info.vid_i)).normalized();
 
-        const Eigen::Matrix3d& T = data.curr_tri_T.at(fid);
+        const Eigen::Vector3d Eik = (data.context->orig_vertices.row(info.vid_k) -
+                                     data.context->orig_vertices.row(info.vid_i)).normalized();
 
-        cost += face_weight * (T * Eij - R * T * Eik).squaredNorm();
-    }
+        const Eigen::Matrix3d& T = data.curr_tri_T.at(info.fid);
 
-    return cost;
+        cost(0) += info.w * (T * Eij - info.R * T * Eik).squaredNorm();
+    }, parallel)(0);
 }
 
-double compute_similarity_term_cost(const reshaping::ReshapingData& data,
-                                    const Eigen::MatrixXd& V) {
+double compute_similarity_term_cost(const reshaping::ReshapingState& data,
+                                    bool parallel) {
     const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
+    const auto& similarity_edges = data.context->similarity_edges;
 
     // ||                                        ||2
     // || T_i e^0_kl/l^0_kl  - T_j e^0_kl/l^0_kl ||
     // ||                                        ||
-    double cost = 0.0;
-    for(int e = 0; e < num_edges; ++e) {
+    return reshaping::blocked_sum<1>((int) similarity_edges.size(), [&](int i, Eigen::Matrix<double, 1, 1>& cost) {
+        const int e = similarity_edges[i];
+
         const int tid0 = adj_e2f.at(e).at(0);
         const int tid1 = adj_e2f.at(e).at(1);
 
@@ -143,35 +80,23 @@ double compute_similarity_term_cost(const reshaping::ReshapingData& data,
         int vid_k = mesh.vertex_opposite_to_edge(e, tid0);
         int vid_l = mesh.vertex_opposite_to_edge(e, tid1);
 
-        const Eigen::Vector3d& vk = data.orig_vertices.row(vid_k);
-        const Eigen::Vector3d& vl = data.orig_vertices.row(vid_l);
+        const Eigen::Vector3d& vk = data.context->orig_vertices.row(vid_k);
+        const Eigen::Vector3d& vl = data.context->orig_vertices.row(vid_l);
         const Eigen::Vector3d E   = (vk - vl).normalized();
 
-        const double w_e = data.similarity_term_edge_w(e);
-        double edge_cost = w_e * (T0 * E - T1 * E).squaredNorm();
-
-        cost += edge_cost;
-    }
-
-    return cost;
+        const double w_e = data.context->similarity_term_edge_w(e);
+        cost(0) += w_e * (T0 * E - T1 * E).squaredNorm();
+    }, parallel)(0);
 }
 
-double compute_regularizer_term_cost(const reshaping::ReshapingData& data,
-                                     const Eigen::MatrixXd& V) {
-    const auto& mesh    = data.mesh;
-    const int num_tris  = mesh.get_num_facets();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
+double compute_regularizer_term_cost(const reshaping::ReshapingState& data,
+                                     bool parallel) {
+    const int num_tris = (int) data.curr_tri_T.size();
     const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
 
-    double cost = 0.0;
-    for(int t = 0; t < num_tris; ++t) {
-        const Eigen::Matrix3d& T = data.curr_tri_T.at(t);
-
-        cost += (T - I).squaredNorm();
-    }
-
-    return cost;
+    return reshaping::blocked_sum<1>(num_tris, [&](int t, Eigen::Matrix<double, 1, 1>& cost) {
+        cost(0) += (data.curr_tri_T[t] - I).squaredNorm();
+    }, parallel)(0);
 }
 
 }
@@ -179,15 +104,19 @@ double compute_regularizer_term_cost(const reshaping::ReshapingData& data,
 namespace reshaping {
 
 TransfSolveEnergy compute_transf_solve_energy(const TransfSolveParams& params,
-                                              const ReshapingData& data,
-                                              const Eigen::MatrixXd& V) {
+                                              const ReshapingState& data,
+                                              bool parallel) {
     TransfSolveEnergy energy;
-    energy.transform_cost   = compute_transform_term_cost(data, V);
-    energy.connect_cost     = compute_connect_term_cost(data, V);
-    energy.normal_cost      = compute_normal_term_cost(data, V);
-    energy.sphericity_cost  = compute_sphericity_term_cost(data, V);
-    energy.similarity_cost  = compute_similarity_term_cost(data, V);
-    energy.regularizer_cost = compute_regularizer_term_cost(data, V);
+
+    // The transform cost is evaluated as ((T_i e^0_ij) . n_i)^2, the same as the
+    // normal cost, so both share a single evaluation
+    const Eigen::Vector2d edge_costs = compute_edge_terms_costs(data, parallel);
+    energy.normal_cost      = edge_costs(0);
+    energy.transform_cost   = edge_costs(0);
+    energy.connect_cost     = edge_costs(1);
+    energy.sphericity_cost  = compute_sphericity_term_cost(data, parallel);
+    energy.similarity_cost  = compute_similarity_term_cost(data, parallel);
+    energy.regularizer_cost = compute_regularizer_term_cost(data, parallel);
 
     energy.total_cost = energy.transform_cost  +
                         energy.connect_cost    +
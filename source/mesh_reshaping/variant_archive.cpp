@@ -0,0 +1,566 @@
+#include <mesh_reshaping/variant_archive.h>
+
+#include <mesh_reshaping/globals.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#ifdef RESHAPING_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+constexpr char ARCHIVE_MAGIC[4] = { 'R', 'S', 'V', 'A' };
+constexpr uint32_t ARCHIVE_VERSION = 1;
+
+// Written as is: an archive saved on a machine with another byte order is rejected
+constexpr uint32_t ARCHIVE_BYTE_ORDER = 0x01020304;
+
+constexpr int MIN_QUANTIZATION_BITS = 1;
+constexpr int MAX_QUANTIZATION_BITS = 30;
+
+enum VariantEncoding : uint32_t {
+    // Quantized coordinates bit-packed (quantization_bits each), column-major
+    ENCODING_PACKED = 0,
+
+    // Zigzag deltas of the quantized coordinates along the spatial order of the rest
+    // vertices (see spatial_order), split into byte planes and deflated
+    ENCODING_DEFLATE = 1
+};
+
+// Followed by the rest vertices (double, num_vertices x 3) and facets (int32,
+// num_faces x 3), both column-major. index_offset is 0 until the archive is closed.
+struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t reserved;
+    int64_t num_vertices;
+    int64_t num_faces;
+    int64_t index_offset;
+    int64_t num_variants;
+};
+
+// Followed by payload_size bytes of encoded coordinates
+struct VariantHeader {
+    uint32_t quantization_bits;
+    uint32_t encoding;
+    double disp_min[3];
+    double disp_step[3];
+    int64_t payload_size;
+
+    // Size of the decoded payload (byte planes) of ENCODING_DEFLATE
+    int64_t raw_size;
+};
+
+// Every index entry is the record offset and size (int64), the label length
+// (uint32) and the label characters
+
+template<typename T>
+void append_bytes(std::vector<char>& buffer, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+bool read_value(std::ifstream& in_f, T& value) {
+    return (bool) in_f.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+inline uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline int32_t zigzag_decode(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+// Bytes of every zigzag delta of quantization_bits-bit values
+inline int delta_num_bytes(int quantization_bits) {
+    return (quantization_bits + 1 + 7) / 8;
+}
+
+void pack_bits(const std::vector<uint32_t>& values, int num_bits, std::vector<char>& payload) {
+    payload.assign(((int64_t) values.size() * num_bits + 7) / 8, 0);
+
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    size_t pos = 0;
+    for(uint32_t value : values) {
+        acc |= (uint64_t) value << acc_bits;
+        acc_bits += num_bits;
+        while(acc_bits >= 8) {
+            payload[pos++] = (char) (acc & 0xFF);
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+    if(acc_bits > 0)
+        payload[pos] = (char) (acc & 0xFF);
+}
+
+bool unpack_bits(const std::vector<char>& payload, int num_bits, std::vector<uint32_t>& values) {
+    if((int64_t) payload.size() != ((int64_t) values.size() * num_bits + 7) / 8)
+        return false;
+
+    const uint64_t mask = ((uint64_t) 1 << num_bits) - 1;
+
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    size_t pos = 0;
+    for(auto& value : values) {
+        while(acc_bits < num_bits) {
+            acc |= (uint64_t) (uint8_t) payload[pos++] << acc_bits;
+            acc_bits += 8;
+        }
+        value = (uint32_t) (acc & mask);
+        acc >>= num_bits;
+        acc_bits -= num_bits;
+    }
+
+    return true;
+}
+
+// Spreads the 21 lower bits of v, 3 bits apart
+inline uint64_t spread_bits(uint64_t v) {
+    v &= 0x1FFFFF;
+    v = (v | v << 32) & 0x1F00000000FFFF;
+    v = (v | v << 16) & 0x1F0000FF0000FF;
+    v = (v | v << 8)  & 0x100F00F00F00F00F;
+    v = (v | v << 4)  & 0x10C30C30C30C30C3;
+    v = (v | v << 2)  & 0x1249249249249249;
+    return v;
+}
+
+// Vertices sorted along a Morton curve of their rest positions. Displacements of
+// nearby vertices are similar, so their deltas along this order are small. It only
+// depends on the rest mesh, so it is not stored.
+std::vector<int64_t> spatial_order(const Eigen::MatrixXd& rest_V) {
+    const int64_t num_rows = rest_V.rows();
+
+    std::vector<int64_t> order(num_rows);
+    for(int64_t i = 0; i < num_rows; ++i)
+        order[i] = i;
+
+    if(num_rows == 0)
+        return order;
+
+    const Eigen::RowVector3d min_p = rest_V.colwise().minCoeff();
+    const double extent = std::max((rest_V.colwise().maxCoeff() - min_p).maxCoeff(), 1e-300);
+    const double scale = (double) 0x1FFFFF / extent;
+
+    std::vector<uint64_t> codes(num_rows);
+    for(int64_t i = 0; i < num_rows; ++i) {
+        uint64_t code = 0;
+        for(int j = 0; j < 3; ++j)
+            code |= spread_bits((uint64_t) ((rest_V(i, j) - min_p(j)) * scale)) << j;
+        codes[i] = code;
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&codes](int64_t a, int64_t b) { return codes[a] < codes[b]; });
+
+    return order;
+}
+
+// Zigzag deltas along order in every column (num_rows values each), as byte planes
+void delta_to_byte_planes(const std::vector<uint32_t>& values, const std::vector<int64_t>& order,
+                          int num_bytes, std::vector<char>& planes) {
+    const int64_t num_rows = (int64_t) order.size();
+    const int64_t num_values = (int64_t) values.size();
+    planes.resize(num_values * num_bytes);
+
+    for(int64_t i = 0; i < num_values; ++i) {
+        const int64_t col = i / num_rows * num_rows;
+        const int64_t k   = i - col;
+
+        const int32_t prev = k == 0 ? 0 : (int32_t) values[col + order[k - 1]];
+        const uint32_t delta = zigzag_encode((int32_t) values[col + order[k]] - prev);
+
+        for(int b = 0; b < num_bytes; ++b)
+            planes[b * num_values + i] = (char) ((delta >> (8 * b)) & 0xFF);
+    }
+}
+
+void byte_planes_to_values(const std::vector<char>& planes, const std::vector<int64_t>& order,
+                           int num_bytes, std::vector<uint32_t>& values) {
+    const int64_t num_rows = (int64_t) order.size();
+    const int64_t num_values = (int64_t) values.size();
+
+    for(int64_t i = 0; i < num_values; ++i) {
+        uint32_t delta = 0;
+        for(int b = 0; b < num_bytes; ++b)
+            delta |= (uint32_t) (uint8_t) planes[b * num_values + i] << (8 * b);
+
+        const int64_t col = i / num_rows * num_rows;
+        const int64_t k   = i - col;
+
+        const int32_t prev = k == 0 ? 0 : (int32_t) values[col + order[k - 1]];
+        values[col + order[k]] = (uint32_t) (prev + zigzag_decode(delta));
+    }
+}
+
+#ifdef RESHAPING_WITH_ZLIB
+bool deflate_bytes(const std::vector<char>& src, std::vector<char>& dst) {
+    uLongf dst_size = compressBound((uLong) src.size());
+    dst.resize(dst_size);
+
+    int ret = compress2(reinterpret_cast<Bytef*>(dst.data()), &dst_size,
+                        reinterpret_cast<const Bytef*>(src.data()), (uLong) src.size(),
+                        Z_DEFAULT_COMPRESSION);
+    if(ret != Z_OK)
+        return false;
+
+    dst.resize(dst_size);
+    return true;
+}
+
+bool inflate_bytes(const std::vector<char>& src, int64_t raw_size, std::vector<char>& dst) {
+    dst.resize(raw_size);
+
+    uLongf dst_size = (uLongf) raw_size;
+    int ret = uncompress(reinterpret_cast<Bytef*>(dst.data()), &dst_size,
+                         reinterpret_cast<const Bytef*>(src.data()), (uLong) src.size());
+
+    return ret == Z_OK && (int64_t) dst_size == raw_size;
+}
+#endif
+
+// Quantizes the displacements V - rest_V and encodes them into a variant record.
+// Deflated coordinates are only kept if smaller than the packed ones.
+bool encode_variant(const Eigen::MatrixXd& rest_V,
+                    [[maybe_unused]] const std::vector<int64_t>& order,
+                    const Eigen::MatrixXd& V,
+                    const reshaping::VariantArchiveParams& params,
+                    std::vector<char>& record) {
+    const int64_t num_rows = rest_V.rows();
+    const int bits = params.quantization_bits;
+    const double max_q = (double) (((uint64_t) 1 << bits) - 1);
+
+    const Eigen::MatrixXd D = V - rest_V;
+    if(!D.allFinite())
+        return false;
+
+    VariantHeader header;
+    header.quantization_bits = (uint32_t) bits;
+    header.encoding = ENCODING_PACKED;
+
+    std::vector<uint32_t> values(num_rows * 3);
+    for(int j = 0; j < 3; ++j) {
+        const double min_d = num_rows > 0 ? D.col(j).minCoeff() : 0.0;
+        const double max_d = num_rows > 0 ? D.col(j).maxCoeff() : 0.0;
+        const double step  = (max_d - min_d) / max_q;
+
+        header.disp_min[j]  = min_d;
+        header.disp_step[j] = step;
+
+        for(int64_t i = 0; i < num_rows; ++i) {
+            const double q = step > 0.0 ? std::round((D(i, j) - min_d) / step) : 0.0;
+            values[j * num_rows + i] = (uint32_t) std::clamp(q, 0.0, max_q);
+        }
+    }
+
+    std::vector<char> payload;
+    pack_bits(values, bits, payload);
+    header.raw_size = 0;
+
+#ifdef RESHAPING_WITH_ZLIB
+    if(params.entropy_coding) {
+        std::vector<char> planes, deflated;
+        delta_to_byte_planes(values, order, delta_num_bytes(bits), planes);
+
+        if(deflate_bytes(planes, deflated) && deflated.size() < payload.size()) {
+            header.encoding = ENCODING_DEFLATE;
+            header.raw_size = (int64_t) planes.size();
+            payload.swap(deflated);
+        }
+    }
+#endif
+    header.payload_size = (int64_t) payload.size();
+
+    record.clear();
+    append_bytes(record, header);
+    record.insert(record.end(), payload.begin(), payload.end());
+
+    return true;
+}
+
+}
+
+namespace reshaping {
+
+VariantArchiveWriter::~VariantArchiveWriter() {
+    close();
+}
+
+std::unique_ptr<VariantArchiveWriter>
+VariantArchiveWriter::create(const std::string& fn,
+                             const Eigen::MatrixXd& rest_V,
+                             const Eigen::MatrixXi& F,
+                             const VariantArchiveParams& params) {
+    if(rest_V.cols() != 3 || F.cols() != 3) {
+        LOGGER.error("Variant archives only store triangle meshes in 3D");
+        return nullptr;
+    }
+
+    if(params.quantization_bits < MIN_QUANTIZATION_BITS || params.quantization_bits > MAX_QUANTIZATION_BITS) {
+        LOGGER.error("Invalid number of quantization bits {} (expected {} to {})",
+                     params.quantization_bits, MIN_QUANTIZATION_BITS, MAX_QUANTIZATION_BITS);
+        return nullptr;
+    }
+
+    std::unique_ptr<VariantArchiveWriter> writer(new VariantArchiveWriter());
+    writer->m_params = params;
+    writer->m_rest_V = rest_V;
+
+#ifndef RESHAPING_WITH_ZLIB
+    if(params.entropy_coding) {
+        LOGGER.warn("Built without zlib: variants of {} are not entropy coded", fn);
+        writer->m_params.entropy_coding = false;
+    }
+#endif
+
+    if(writer->m_params.entropy_coding)
+        writer->m_order = spatial_order(rest_V);
+
+    writer->m_file.open(fn, std::ios::binary | std::ios::trunc);
+    if(!writer->m_file) {
+        LOGGER.error("Could not create variant archive {}", fn);
+        return nullptr;
+    }
+
+    ArchiveHeader header;
+    std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version      = ARCHIVE_VERSION;
+    header.byte_order   = ARCHIVE_BYTE_ORDER;
+    header.reserved     = 0;
+    header.num_vertices = rest_V.rows();
+    header.num_faces    = F.rows();
+    header.index_offset = 0;
+    header.num_variants = 0;
+
+    const Eigen::Matrix<int32_t, Eigen::Dynamic, Eigen::Dynamic> F32 = F.cast<int32_t>();
+
+    writer->m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer->m_file.write(reinterpret_cast<const char*>(rest_V.data()), rest_V.size() * sizeof(double));
+    writer->m_file.write(reinterpret_cast<const char*>(F32.data()), F32.size() * sizeof(int32_t));
+    if(!writer->m_file) {
+        LOGGER.error("Error while writing variant archive {}", fn);
+        return nullptr;
+    }
+
+    writer->m_end = (int64_t) writer->m_file.tellp();
+    return writer;
+}
+
+bool VariantArchiveWriter::add_variant(const std::string& label, const Eigen::MatrixXd& V) {
+    if(V.rows() != m_rest_V.rows() || V.cols() != 3) {
+        LOGGER.error("Variant {} does not have the vertices of the archived mesh", label);
+        return false;
+    }
+
+    // Encoding is done outside the lock
+    std::vector<char> record;
+    if(!encode_variant(m_rest_V, m_order, V, m_params, record)) {
+        LOGGER.error("Error while encoding variant {}", label);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(!m_file.is_open())
+        return false;
+
+    if(m_label_to_entry.count(label) > 0) {
+        LOGGER.error("Variant {} is already in the archive", label);
+        return false;
+    }
+
+    m_file.seekp(m_end);
+    m_file.write(record.data(), (std::streamsize) record.size());
+    if(!m_file)
+        return false;
+
+    m_label_to_entry[label] = (int) m_entries.size();
+    m_entries.push_back({ label, m_end, (int64_t) record.size() });
+    m_end += (int64_t) record.size();
+
+    return true;
+}
+
+bool VariantArchiveWriter::close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(!m_file.is_open())
+        return true;
+
+    std::vector<char> index;
+    for(const auto& entry : m_entries) {
+        append_bytes(index, entry.offset);
+        append_bytes(index, entry.size);
+        append_bytes(index, (uint32_t) entry.label.size());
+        index.insert(index.end(), entry.label.begin(), entry.label.end());
+    }
+
+    m_file.seekp(m_end);
+    m_file.write(index.data(), (std::streamsize) index.size());
+
+    // Patching the index location (the archive is only valid from now on)
+    const int64_t num_variants = (int64_t) m_entries.size();
+    m_file.seekp(offsetof(ArchiveHeader, index_offset));
+    m_file.write(reinterpret_cast<const char*>(&m_end), sizeof(m_end));
+    m_file.write(reinterpret_cast<const char*>(&num_variants), sizeof(num_variants));
+
+    const bool succ = (bool) m_file;
+    m_file.close();
+
+    if(!succ)
+        LOGGER.error("Error while writing the variant archive index");
+
+    return succ;
+}
+
+int VariantArchiveWriter::num_variants() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int) m_entries.size();
+}
+
+std::unique_ptr<VariantArchive> VariantArchive::open(const std::string& fn) {
+    std::ifstream in_f(fn, std::ios::binary | std::ios::ate);
+    if(!in_f) {
+        LOGGER.error("Could not open variant archive {}", fn);
+        return nullptr;
+    }
+
+    const int64_t file_size = (int64_t) in_f.tellg();
+    in_f.seekg(0);
+
+    ArchiveHeader header;
+    if(!read_value(in_f, header) ||
+       std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+       header.version != ARCHIVE_VERSION ||
+       header.byte_order != ARCHIVE_BYTE_ORDER) {
+        LOGGER.error("Invalid variant archive {}", fn);
+        return nullptr;
+    }
+
+    const int64_t topology_end = (int64_t) sizeof(header) +
+                                 header.num_vertices * 3 * (int64_t) sizeof(double) +
+                                 header.num_faces * 3 * (int64_t) sizeof(int32_t);
+    if(header.num_vertices < 0 || header.num_faces < 0 || header.num_variants < 0 ||
+       header.index_offset < topology_end || header.index_offset > file_size) {
+        LOGGER.error("Variant archive {} is truncated or was not closed", fn);
+        return nullptr;
+    }
+
+    std::unique_ptr<VariantArchive> archive(new VariantArchive());
+    archive->m_fn = fn;
+
+    Eigen::Matrix<int32_t, Eigen::Dynamic, Eigen::Dynamic> F32(header.num_faces, 3);
+    archive->m_rest_V.resize(header.num_vertices, 3);
+    in_f.read(reinterpret_cast<char*>(archive->m_rest_V.data()), archive->m_rest_V.size() * sizeof(double));
+    in_f.read(reinterpret_cast<char*>(F32.data()), F32.size() * sizeof(int32_t));
+    archive->m_F = F32.cast<int>();
+    archive->m_order = spatial_order(archive->m_rest_V);
+
+    in_f.seekg(header.index_offset);
+    for(int64_t i = 0; i < header.num_variants; ++i) {
+        VariantArchiveEntry entry;
+        uint32_t label_len = 0;
+        if(!read_value(in_f, entry.offset) || !read_value(in_f, entry.size) || !read_value(in_f, label_len))
+            break;
+
+        entry.label.resize(label_len);
+        if(!in_f.read(entry.label.data(), label_len))
+            break;
+
+        if(entry.offset < topology_end || entry.size < (int64_t) sizeof(VariantHeader) ||
+           entry.offset + entry.size > header.index_offset)
+            break;
+
+        archive->m_label_to_entry[entry.label] = (int) archive->m_entries.size();
+        archive->m_entries.push_back(std::move(entry));
+    }
+
+    if(!in_f || (int64_t) archive->m_entries.size() != header.num_variants) {
+        LOGGER.error("Invalid variant archive index in {}", fn);
+        return nullptr;
+    }
+
+    return archive;
+}
+
+int VariantArchive::find(const std::string& label) const {
+    auto itr = m_label_to_entry.find(label);
+    return itr != m_label_to_entry.end() ? itr->second : -1;
+}
+
+bool VariantArchive::load_variant(int i, Eigen::MatrixXd& V) const {
+    if(i < 0 || i >= num_variants())
+        return false;
+
+    const VariantArchiveEntry& entry = m_entries.at(i);
+
+    // Every call has its own stream, so variants can be loaded concurrently
+    std::ifstream in_f(m_fn, std::ios::binary);
+    in_f.seekg(entry.offset);
+
+    VariantHeader header;
+    if(!read_value(in_f, header) ||
+       header.payload_size != entry.size - (int64_t) sizeof(VariantHeader) ||
+       header.quantization_bits < MIN_QUANTIZATION_BITS ||
+       header.quantization_bits > MAX_QUANTIZATION_BITS) {
+        LOGGER.error("Invalid record of variant {}", entry.label);
+        return false;
+    }
+
+    std::vector<char> payload(header.payload_size);
+    if(!in_f.read(payload.data(), header.payload_size))
+        return false;
+
+    const int64_t num_rows = m_rest_V.rows();
+    const int bits = (int) header.quantization_bits;
+
+    std::vector<uint32_t> values(num_rows * 3);
+    if(header.encoding == ENCODING_PACKED) {
+        if(!unpack_bits(payload, bits, values))
+            return false;
+    }
+    else if(header.encoding == ENCODING_DEFLATE) {
+#ifdef RESHAPING_WITH_ZLIB
+        const int num_bytes = delta_num_bytes(bits);
+        if(header.raw_size != (int64_t) values.size() * num_bytes)
+            return false;
+
+        std::vector<char> planes;
+        if(!inflate_bytes(payload, header.raw_size, planes)) {
+            LOGGER.error("Error while decompressing variant {}", entry.label);
+            return false;
+        }
+        byte_planes_to_values(planes, m_order, num_bytes, values);
+#else
+        LOGGER.error("Built without zlib: cannot decode variant {}", entry.label);
+        return false;
+#endif
+    }
+    else {
+        LOGGER.error("Unknown encoding of variant {}", entry.label);
+        return false;
+    }
+
+    V.resize(num_rows, 3);
+    for(int j = 0; j < 3; ++j)
+        for(int64_t r = 0; r < num_rows; ++r)
+            V(r, j) = m_rest_V(r, j) + header.disp_min[j] + header.disp_step[j] * values[j * num_rows + r];
+
+    return true;
+}
+
+bool VariantArchive::load_variant(const std::string& label, Eigen::MatrixXd& V) const {
+    return load_variant(find(label), V);
+}
+
+}
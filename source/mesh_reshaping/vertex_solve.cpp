@@ -1,14 +1,19 @@
 #include <mesh_reshaping/vertex_solve.h>
 #include <mesh_reshaping/solve_utils.h>
+#include <mesh_reshaping/normal_equations.h>
 #include <mesh_reshaping/globals.h>
 
+#include <ca_essentials/core/profiler.h>
+#include <ca_essentials/core/timer.h>
+
 #include <Eigen/Core>
 
+#include <algorithm>
 #include <vector>
 
 namespace {
 
-Eigen::Vector2i system_size(const reshaping::ReshapingData& data,
+Eigen::Vector2i system_size(const reshaping::ReshapingState& data,
                             const bool handle_error_distrib_on) {
     const int num_verts = data.mesh.get_num_vertices();
     const int num_edges = data.mesh.get_num_edges();
@@ -23,11 +28,11 @@ Eigen::Vector2i system_size(const reshaping::ReshapingData& data,
     num_rows += num_edges * 2;
 
     // Straightness term
-    num_rows += data.num_straight_pairs * 3;
+    num_rows += data.context->num_straight_pairs * 3;
 
     // Sphericity term
 #if SPHERICITY_ON
-    num_rows += (int) data.sphericity_terms_info.size() * 3;
+    num_rows += (int) data.context->sphericity_terms_info.size() * 3;
 #endif
 
     // Regularizer term
@@ -46,490 +51,785 @@ Eigen::Vector2i system_size(const reshaping::ReshapingData& data,
     return Eigen::Vector2i(num_rows, num_cols);
 }
 
-void compute_edge_term_entries(const reshaping::VertexSolveParams& params,
-                               const reshaping::ReshapingData& data,
-                               reshaping::TripletsVec& triplets,
-                               Eigen::VectorXd& b,
-                               Eigen::VectorXd& w,
-                               int& curr_row) {
-
+// Visits the local stencils of the edge, normal and regularizer terms. The three
+// terms only involve the two edge end points, so they share one 6x6 block per edge.
+template<typename ForEach, typename Visitor>
+void visit_edge_stencils(const reshaping::VertexSolveParams& params,
+                         const reshaping::ReshapingState& data,
+                         int& stencil_idx,
+                         ForEach&& for_each,
+                         Visitor&& visit) {
     using VERTEX_COMP = reshaping::VERTEX_COMP;
+    using Vector6d    = Eigen::Matrix<double, 6, 1>;
 
     const auto& mesh    = data.mesh;
     const int num_verts = mesh.get_num_vertices();
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    /*
-     * |                                    |^2  |                                    |^2
-     * | T^-1_i e_ij/l^0_ij - e^0_ij/l^0_ij |  + | T^-1_j e_ij/l^0_ij - e^0_ij/l^0_ij | 
-     * |                                    |    |                                    |
-     */
-    for(int e = 0; e < num_edges; ++e) {
+    const double regularizer_w = params.regularizer_weight *
+                                 (1.0 / data.context->avg_edge_len);
+
+    const int first_idx = stencil_idx;
+    stencil_idx += num_edges;
+
+    for_each(num_edges, [&](int e) {
         const std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
         const int vid0 = edge_vids.at(0);
         const int vid1 = edge_vids.at(1);
 
-        const Eigen::Vector3d& E = data.orig_edges.row(e);
-        const double orig_len    = data.orig_edge_lens(e);
-        const double target_len  = data.target_edge_lens(e);
-
-        const double den = orig_len;
+        // Unknowns: [vid1.x, vid0.x, vid1.y, vid0.y, vid1.z, vid0.z]
+        reshaping::LocalStencil<6> stencil;
+        for(int d = 0; d < 3; ++d) {
+            stencil.cols[2 * d    ] = vertex_to_sys_idx(vid1, (VERTEX_COMP) d, num_verts);
+            stencil.cols[2 * d + 1] = vertex_to_sys_idx(vid0, (VERTEX_COMP) d, num_verts);
+        }
 
-        const double w_ij = data.length_based_edge_w(e);
+        const Eigen::Vector3d& E = data.orig_edges().row(e);
+        const double orig_len    = data.orig_edge_lens()(e);
+        const double target_len  = data.target_edge_lens(e);
+        const double w_ij        = data.length_based_edge_w(e);
 
+        // Edge term: T^-1_i e_ij/l^0_ij - e^0_ij/l^0_ij (same for T_j)
         for(int f = 0; f < 2; ++f) {
             const int fid = adj_e2f.at(e).at(f);
-
-            const Eigen::Matrix3d& T = data.curr_tri_T.at(fid);
-            const Eigen::Matrix3d T_inv = T.inverse();
-
-            {
-                // terms for x-component
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::X, num_verts),  T_inv(0, 0) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::X, num_verts), -T_inv(0, 0) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Y, num_verts),  T_inv(0, 1) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Y, num_verts), -T_inv(0, 1) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Z, num_verts),  T_inv(0, 2) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Z, num_verts), -T_inv(0, 2) / den);
-
-                b(curr_row) = E.x() / orig_len;
-                w(curr_row) = w_ij;
-                curr_row++;
+            const Eigen::Matrix3d T_inv = data.curr_tri_T.at(fid).inverse();
+
+            for(int r = 0; r < 3; ++r) {
+                Vector6d a;
+                for(int d = 0; d < 3; ++d) {
+                    a(2 * d    ) =  T_inv(r, d) / orig_len;
+                    a(2 * d + 1) = -T_inv(r, d) / orig_len;
+                }
+                stencil.add_row(a, E(r) / orig_len, w_ij);
             }
+        }
 
-            {
-                // terms for y-component
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::X, num_verts),  T_inv(1, 0) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::X, num_verts), -T_inv(1, 0) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Y, num_verts),  T_inv(1, 1) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Y, num_verts), -T_inv(1, 1) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Z, num_verts),  T_inv(1, 2) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Z, num_verts), -T_inv(1, 2) / den);
+        // Normal term: n^i . e_ij / l_ij (same for n^j)
+        const double w_normal = params.normal_weight * w_ij *
+                                (orig_len / data.context->avg_edge_len);
+        for(int adj_tid : adj_e2f.at(e)) {
+            const Eigen::Vector3d& n = data.orig_tri_N().row(adj_tid);
 
-                b(curr_row) = E.y() / orig_len;
-                w(curr_row) = w_ij;
-                curr_row++;
+            Vector6d a;
+            for(int d = 0; d < 3; ++d) {
+                a(2 * d    ) =  n(d) / target_len;
+                a(2 * d + 1) = -n(d) / target_len;
             }
+            stencil.add_row(a, 0.0, w_normal);
+        }
 
-            {
-                // terms for z-component
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::X, num_verts),  T_inv(2, 0) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::X, num_verts), -T_inv(2, 0) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Y, num_verts),  T_inv(2, 1) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Y, num_verts), -T_inv(2, 1) / den);
-
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Z, num_verts),  T_inv(2, 2) / den);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Z, num_verts), -T_inv(2, 2) / den);
-
-                b(curr_row) = E.z() / orig_len;
-                w(curr_row) = w_ij;
-                curr_row++;
-            }
+        // Regularizer term: e_ij - e^0_ij
+        for(int d = 0; d < 3; ++d) {
+            Vector6d a = Vector6d::Zero();
+            a(2 * d    ) =  1.0;
+            a(2 * d + 1) = -1.0;
+            stencil.add_row(a, E(d), regularizer_w);
         }
-    }
-}
 
-void compute_normal_entries(const reshaping::VertexSolveParams& params,
-                            const reshaping::ReshapingData& data,
-                            reshaping::TripletsVec& triplets,
-                            Eigen::VectorXd& b,
-                            Eigen::VectorXd& w,
-                            int& curr_row) {
+        visit(first_idx + e, stencil);
+    });
+}
 
+// Visits one 3x3 stencil per straight triplet and vertex component
+template<typename ForEach, typename Visitor>
+void visit_straightness_stencils(const reshaping::VertexSolveParams& params,
+                                 const reshaping::ReshapingState& data,
+                                 int& stencil_idx,
+                                 ForEach&& for_each,
+                                 Visitor&& visit) {
     using VERTEX_COMP = reshaping::VERTEX_COMP;
 
-    const auto& mesh    = data.mesh;
+    const auto& mesh = data.mesh;
+    const auto& straight_chains = data.context->straight_chains;
     const int num_verts = mesh.get_num_vertices();
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    /*
-     *      weight * (l^0_ij / L_avg) (n^i . e_(ij) / l_ij)^2 ... same for n^j
-     */
-    double normal_weight = params.normal_weight;
-    for(int e = 0; e < num_edges; ++e) {
-        const std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
-        const int vid0 = edge_vids.at(0);
-        const int vid1 = edge_vids.at(1);
+    if(data.context->num_straight_pairs == 0)
+        return;
 
-        const double orig_len = data.orig_edge_lens(e);
-        const double target_len = data.target_edge_lens(e);
+    // Index of the first stencil of each chain
+    const int num_chains = straight_chains->num_chains();
+    std::vector<int> chain_first_idx(num_chains + 1, stencil_idx);
+    for(int c = 0; c < num_chains; ++c) {
+        const int chain_size = (int) straight_chains->get_chain(c).size();
+        chain_first_idx[c + 1] = chain_first_idx[c] + std::max(chain_size - 2, 0) * 3;
+    }
+    stencil_idx = chain_first_idx.back();
 
-        const auto& adj_faces = adj_e2f.at(e);
-        assert(adj_faces.size() == 2 && "Non-manifold edge was found!");
+    for_each(num_chains, [&](int c) {
+        const auto& chain = straight_chains->get_chain(c);
 
-        const double w_ij = normal_weight *
-                            data.length_based_edge_w(e) *
-                            (orig_len / data.avg_edge_len);
+        if(chain.size() < 3)
+            return;
 
-        for(int adj_tid : adj_faces) {
-            const Eigen::Vector3d& n = data.orig_tri_N.row(adj_tid);
+        int idx = chain_first_idx[c];
+        for(int i = 1; i < chain.size() - 1; ++i) {
+            int vj = chain.at(i - 1);
+            int vi = chain.at(i    );
+            int vk = chain.at(i + 1);
 
-            // n^x_{ij} l^0/l_ij * e^x_{ij}
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::X, num_verts),  n.x() / target_len);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::X, num_verts), -n.x() / target_len);
+            double inv_l_ij = 1.0 / data.target_edge_lens(mesh.get_edge_index(vi, vj));
+            double inv_l_ki = 1.0 / data.target_edge_lens(mesh.get_edge_index(vk, vi));
 
-            // n^y_{ij} l^0/l_ij * e^y_{ij}
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Y, num_verts),  n.y() / target_len);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Y, num_verts), -n.y() / target_len);
+            const Eigen::Vector3d a(inv_l_ij, -inv_l_ij - inv_l_ki, inv_l_ki);
 
-            // n^z_{ij} l^0/l_ij * e^z_{ij}
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Z, num_verts),  n.z() / target_len);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Z, num_verts), -n.z() / target_len);
+            for(int d = 0; d < 3; ++d) {
+                reshaping::LocalStencil<3> stencil;
+                stencil.cols = { vertex_to_sys_idx(vj, (VERTEX_COMP) d, num_verts),
+                                 vertex_to_sys_idx(vi, (VERTEX_COMP) d, num_verts),
+                                 vertex_to_sys_idx(vk, (VERTEX_COMP) d, num_verts) };
+                stencil.add_row(a, 0.0, params.straightness_weight);
 
-            b(curr_row) = 0.0;
-            w(curr_row) = w_ij;
-            curr_row++;
+                visit(idx++, stencil);
+            }
         }
-    }
+    });
 }
 
-void compute_straightness_entries(const reshaping::VertexSolveParams& params,
-                                  const reshaping::ReshapingData& data,
-                                  reshaping::TripletsVec& triplets,
-                                  Eigen::VectorXd& b,
-                                  Eigen::VectorXd& w,
-                                  int& curr_row) {
-
+// Visits one 9x9 stencil per sphericity term over [v_j, v_i, v_k]
+template<typename ForEach, typename Visitor>
+void visit_sphericity_stencils(const reshaping::VertexSolveParams& params,
+                               const reshaping::ReshapingState& data,
+                               int& stencil_idx,
+                               ForEach&& for_each,
+                               Visitor&& visit) {
     using VERTEX_COMP = reshaping::VERTEX_COMP;
+    using Vector9d    = Eigen::Matrix<double, 9, 1>;
 
-    const auto& mesh = data.mesh;
-    const auto& straight_chains = data.straight_chains;
+    const auto& mesh    = data.mesh;
     const int num_verts = mesh.get_num_vertices();
 
-    if(data.num_straight_pairs == 0)
-        return;
+    const int num_terms = (int) data.context->sphericity_terms_info.size();
+    const int first_idx = stencil_idx;
+    stencil_idx += num_terms;
 
-    for(int c = 0; c < straight_chains->num_chains(); ++c) {
-        const auto& chain = straight_chains->get_chain(c);
+    for_each(num_terms, [&](int t) {
+        const auto& info = data.context->sphericity_terms_info.at(t);
+        const int vi = info.vid_i;
+        const int vj = info.vid_j;
+        const int vk = info.vid_k;
+        const Eigen::Matrix3d& R = info.R;
 
-        if(chain.size() < 3)
-            continue;
+        const auto& term_edges  = data.context->sphericity_term_edges.at(t);
+        const double inv_len_ij = 1.0 / data.orig_edge_lens()(term_edges[0]);
+        const double inv_len_ik = 1.0 / data.orig_edge_lens()(term_edges[1]);
 
-        for(int i = 1; i < chain.size() - 1; ++i) {
-            int vj = chain.at(i - 1);
-            int vi = chain.at(i    );
-            int vk = chain.at(i + 1);
+        reshaping::LocalStencil<9> stencil;
+        for(int d = 0; d < 3; ++d) {
+            stencil.cols[d    ] = vertex_to_sys_idx(vj, (VERTEX_COMP) d, num_verts);
+            stencil.cols[d + 3] = vertex_to_sys_idx(vi, (VERTEX_COMP) d, num_verts);
+            stencil.cols[d + 6] = vertex_to_sys_idx(vk, (VERTEX_COMP) d, num_verts);
+        }
 
-            int eid_ij = mesh.get_edge_index(vi, vj);
-            int eid_ki = mesh.get_edge_index(vk, vi);
+        // [E_ij]_d - [s R E_ik]_d
+        for(int d = 0; d < 3; ++d) {
+            Vector9d a = Vector9d::Zero();
+            a(d    ) =  inv_len_ij;
+            a(d + 3) = -inv_len_ij;
 
-            double l_ij = data.target_edge_lens(eid_ij);
-            double l_ki = data.target_edge_lens(eid_ki);
+            for(int c = 0; c < 3; ++c) {
+                a(c + 6) -= inv_len_ik * R(d, c);
+                a(c + 3) += inv_len_ik * R(d, c);
+            }
 
-            double inv_l_ij = 1.0 / l_ij;
-            double inv_l_ki = 1.0 / l_ki;
+            stencil.add_row(a, 0.0, info.w * params.sphericity_weight);
+        }
 
-            double w_ijk = params.straightness_weight;
+        visit(first_idx + t, stencil);
+    });
+}
 
-            // x-component
-            {
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::X, num_verts),  inv_l_ij);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts), -inv_l_ij);
+// Visits one 1x1 stencil per constrained vertex component (serially, since
+// constraints are not stored contiguously)
+template<typename Visitor>
+void visit_bc_stencils(const reshaping::VertexSolveParams& params,
+                       const reshaping::ReshapingState& data,
+                       int& stencil_idx,
+                       Visitor&& visit) {
+    using VERTEX_COMP = reshaping::VERTEX_COMP;
 
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts), -inv_l_ki);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::X, num_verts),  inv_l_ki);
+    const int num_verts = data.mesh.get_num_vertices();
+    const Eigen::Matrix<double, 1, 1> a = Eigen::Matrix<double, 1, 1>::Ones();
 
-                b(curr_row) = 0.0;
-                w(curr_row) = w_ijk;
-                curr_row++;
-            }
+    const bool handle_error_distrib_on = params.handle_error_distrib.is_active;
 
-            // y-component
-            {
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::Y, num_verts),  inv_l_ij);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts), -inv_l_ij);
+    double bc_weight = params.bc_weight;
+    if(handle_error_distrib_on)
+        bc_weight = params.handle_error_distrib.weakened_hc_weight;
 
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts), -inv_l_ki);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Y, num_verts),  inv_l_ki);
+    // Vertices held exactly are eliminated from the system instead
+    const bool hold_bc       = !params.exact_constraints || handle_error_distrib_on;
+    const bool hold_off_zone = !params.exact_constraints && handle_error_distrib_on;
 
-                b(curr_row) = 0.0;
-                w(curr_row) = w_ijk;
-                curr_row++;
-            }
+    if(hold_bc) {
+        for(const auto& [vid, pos] : data.bc) {
+            for(int d = 0; d < 3; ++d) {
+                reshaping::LocalStencil<1> stencil;
+                stencil.cols = { vertex_to_sys_idx(vid, (VERTEX_COMP) d, num_verts) };
+                stencil.add_row(a, pos(d), bc_weight);
 
-            // z-component
-            {
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::Z, num_verts),  inv_l_ij);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts), -inv_l_ij);
+                visit(stencil_idx++, stencil);
+            }
+        }
+    }
 
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts), -inv_l_ki);
-                triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Z, num_verts),  inv_l_ki);
+    // Hold every vertex off-ring (including boundary)
+    if(hold_off_zone) {
+        for(int vid : data.handle_error_dist_out_verts) {
+            for(int d = 0; d < 3; ++d) {
+                reshaping::LocalStencil<1> stencil;
+                stencil.cols = { vertex_to_sys_idx(vid, (VERTEX_COMP) d, num_verts) };
+                stencil.add_row(a, data.curr_vertices(vid, d),
+                                params.handle_error_distrib.off_zone_hc_weight);
 
-                b(curr_row) = 0.0;
-                w(curr_row) = w_ijk;
-                curr_row++;
+                visit(stencil_idx++, stencil);
             }
         }
     }
 }
 
-void compute_sphericity_entries(const reshaping::VertexSolveParams& params,
-                                const reshaping::ReshapingData& data,
-                                reshaping::TripletsVec& triplets,
-                                Eigen::VectorXd& b,
-                                Eigen::VectorXd& w,
-                                int& curr_row) {
-    using VERTEX_COMP = reshaping::VERTEX_COMP;
-
-    const auto& mesh    = data.mesh;
-    const int num_verts = mesh.get_num_vertices();
-
-    for(const auto& info : data.sphericity_terms_info) {
-        const int vi  = info.vid_i;
-        const int vj  = info.vid_j;
-        const int vk  = info.vid_k;
-        const double face_weight = info.w;
-        const Eigen::Matrix3d& R = info.R;
-
-        int eid_ij = mesh.get_edge_index(vi, vj);
-        int eid_ik = mesh.get_edge_index(vi, vk);
+template<typename ForEach, typename Visitor>
+void visit_vertex_solve_stencils(const reshaping::VertexSolveParams& params,
+                                 const reshaping::ReshapingState& data,
+                                 ForEach&& for_each,
+                                 Visitor&& visit) {
+    int stencil_idx = 0;
+    visit_edge_stencils        (params, data, stencil_idx, for_each, visit);
+    visit_straightness_stencils(params, data, stencil_idx, for_each, visit);
+#if SPHERICITY_ON
+    visit_sphericity_stencils  (params, data, stencil_idx, for_each, visit);
+#endif
+    visit_bc_stencils          (params, data, stencil_idx, visit);
+}
 
-        const double orig_len_ij = data.orig_edge_lens(eid_ij);
-        const double orig_len_ik = data.orig_edge_lens(eid_ik);
+// Eliminates the vertices held exactly (see VertexSolveParams::exact_constraints):
+// bc vertices, or off-zone vertices during handle-error distribution.
+//
+// Outputs the column of every unknown in the reduced system (-1 if eliminated;
+// empty if nothing is eliminated) and the values of the eliminated unknowns.
+// Free vertices keep the component-major layout of the full system.
+// Returns the number of reduced unknowns.
+int compute_reduced_system_columns(const reshaping::VertexSolveParams& params,
+                                   const reshaping::ReshapingState& data,
+                                   std::vector<int>& sys_cols,
+                                   Eigen::VectorXd& fixed_values) {
+    using VERTEX_COMP = reshaping::VERTEX_COMP;
 
-        // x-component equations
-        // [E_ij]_x - [s R E_ik]_x
-        {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::X, num_verts),  1.0 / orig_len_ij);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts), -1.0 / orig_len_ij);
+    const int num_verts = data.mesh.get_num_vertices();
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::X, num_verts), -(1.0 / orig_len_ik) * R(0, 0));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts),  (1.0 / orig_len_ik) * R(0, 0));
+    std::vector<bool> is_fixed(num_verts, false);
+    Eigen::MatrixXd fixed_V = Eigen::MatrixXd::Zero(num_verts, 3);
+    if(params.handle_error_distrib.is_active) {
+        for(int vid : data.handle_error_dist_out_verts) {
+            is_fixed[vid] = true;
+            fixed_V.row(vid) = data.curr_vertices.row(vid);
+        }
+    }
+    else {
+        for(const auto& [vid, pos] : data.bc) {
+            is_fixed[vid] = true;
+            fixed_V.row(vid) = pos.transpose();
+        }
+    }
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Y, num_verts), -(1.0 / orig_len_ik) * R(0, 1));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts),  (1.0 / orig_len_ik) * R(0, 1));
+    std::vector<int> free_idx(num_verts, -1);
+    int num_free = 0;
+    for(int v = 0; v < num_verts; ++v)
+        if(!is_fixed[v])
+            free_idx[v] = num_free++;
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Z, num_verts), -(1.0 / orig_len_ik) * R(0, 2));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts),  (1.0 / orig_len_ik) * R(0, 2));
+    sys_cols.clear();
+    if(num_free == num_verts)
+        return num_verts * 3;
 
-            b(curr_row) = 0.0;
-            w(curr_row) = face_weight * params.sphericity_weight;
-            curr_row++;
+    sys_cols.resize(num_verts * 3);
+    for(int v = 0; v < num_verts; ++v) {
+        for(int d = 0; d < 3; ++d) {
+            const int col = free_idx[v] < 0 ? -1
+                                            : vertex_to_sys_idx(free_idx[v], (VERTEX_COMP) d, num_free);
+            sys_cols[vertex_to_sys_idx(v, (VERTEX_COMP) d, num_verts)] = col;
         }
+    }
+    fixed_values = Eigen::Map<const Eigen::VectorXd>(fixed_V.data(), fixed_V.size());
 
-        // y-component equations
-        // [E_ij]_y - [s R E_ik]_y
-        {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::Y, num_verts),  1.0 / orig_len_ij);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts), -1.0 / orig_len_ij);
-
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::X, num_verts), -(1.0 / orig_len_ik) * R(1, 0));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts),  (1.0 / orig_len_ik) * R(1, 0));
+    return num_free * 3;
+}
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Y, num_verts), -(1.0 / orig_len_ik) * R(1, 1));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts),  (1.0 / orig_len_ik) * R(1, 1));
+// Maps a stencil to the reduced system, moving the eliminated unknowns to its right-hand side
+template<int N>
+reshaping::LocalStencil<N> eliminate_fixed_unknowns(const reshaping::LocalStencil<N>& stencil,
+                                                    const std::vector<int>& sys_cols,
+                                                    const Eigen::VectorXd& fixed_values) {
+    reshaping::LocalStencil<N> reduced = stencil;
+    for(int j = 0; j < N; ++j) {
+        const int col = stencil.cols[j];
+
+        reduced.cols[j] = sys_cols[col];
+        if(reduced.cols[j] < 0)
+            reduced.f -= stencil.K.col(j) * fixed_values(col);
+    }
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Z, num_verts), -(1.0 / orig_len_ik) * R(1, 2));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts),  (1.0 / orig_len_ik) * R(1, 2));
+    return reduced;
+}
 
-            b(curr_row) = 0.0;
-            w(curr_row) = face_weight * params.sphericity_weight;
-            curr_row++;
-        }
+// Restricts a vector of vertex-solve unknowns to the reduced system
+Eigen::VectorXd to_reduced_system(const Eigen::VectorXd& x,
+                                  const std::vector<int>& sys_cols,
+                                  int num_unknowns) {
+    if(sys_cols.empty())
+        return x;
 
-        // z-component equations
-        // [E_ij]_z - [s R E_ik]_z
-        {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vj, VERTEX_COMP::Z, num_verts),  1.0 / orig_len_ij);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts), -1.0 / orig_len_ij);
+    Eigen::VectorXd reduced_x(num_unknowns);
+    for(int i = 0; i < (int) sys_cols.size(); ++i)
+        if(sys_cols[i] >= 0)
+            reduced_x(sys_cols[i]) = x(i);
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::X, num_verts), -(1.0 / orig_len_ik) * R(2, 0));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::X, num_verts),  (1.0 / orig_len_ik) * R(2, 0));
-
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Y, num_verts), -(1.0 / orig_len_ik) * R(2, 1));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Y, num_verts),  (1.0 / orig_len_ik) * R(2, 1));
+    return reduced_x;
+}
 
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vk, VERTEX_COMP::Z, num_verts), -(1.0 / orig_len_ik) * R(2, 2));
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vi, VERTEX_COMP::Z, num_verts),  (1.0 / orig_len_ik) * R(2, 2));
+// Maximum per-vertex norm of a vector of vertex-solve unknowns
+double max_vertex_norm(const Eigen::VectorXd& x) {
+    const int num_verts = (int) x.size() / 3;
 
-            b(curr_row) = 0.0;
-            w(curr_row) = face_weight * params.sphericity_weight;
-            curr_row++;
-        }
+    double max_sq_norm = 0.0;
+    for(int v = 0; v < num_verts; ++v) {
+        const double sq_norm = x(num_verts * 0 + v) * x(num_verts * 0 + v) +
+                               x(num_verts * 1 + v) * x(num_verts * 1 + v) +
+                               x(num_verts * 2 + v) * x(num_verts * 2 + v);
+        max_sq_norm = std::max(max_sq_norm, sq_norm);
     }
+
+    return sqrt(max_sq_norm);
 }
 
-void compute_bc_entries(const reshaping::VertexSolveParams& params,
-                        const reshaping::ReshapingData& data,
-                        reshaping::TripletsVec& triplets,
-                        Eigen::VectorXd& b,
-                        Eigen::VectorXd& w,
-                        int& curr_row) {
-    using VERTEX_COMP = reshaping::VERTEX_COMP;
+// Conjugate gradient preconditioned with the factorization of a previous system.
+// The preconditioner approximates AtWA^-1, so the preconditioned residual estimates
+// the error of x: CG stops once its maximum vertex norm is below tol.
+//
+// Returns the number of CG iterations, or -1 if it has not converged.
+int solve_with_lagged_factor(const Eigen::SparseMatrix<double>& AtWA,
+                             const Eigen::VectorXd& AtWb,
+                             const reshaping::LinearSolverBackend& preconditioner,
+                             double tol,
+                             int max_iters,
+                             Eigen::VectorXd& x) {
+    Eigen::VectorXd r = AtWb - AtWA * x;
+    Eigen::VectorXd z;
+    if(!preconditioner.solve(r, z))
+        return -1;
+
+    if(max_vertex_norm(z) < tol)
+        return 0;
+
+    Eigen::VectorXd p = z;
+    Eigen::VectorXd Ap(x.size());
+    double rz = r.dot(z);
+
+    for(int k = 1; k <= max_iters; ++k) {
+        Ap.noalias() = AtWA * p;
+        const double alpha = rz / p.dot(Ap);
+
+        x += alpha * p;
+        r -= alpha * Ap;
+
+        if(!preconditioner.solve(r, z))
+            return -1;
+
+        if(max_vertex_norm(z) < tol)
+            return k;
+
+        const double rz_new = r.dot(z);
+        p = z + (rz_new / rz) * p;
+        rz = rz_new;
+    }
 
-    const int num_verts = data.mesh.get_num_vertices();
+    return -1;
+}
 
-    double bc_weight = params.bc_weight;
-    if(params.handle_error_distrib.is_active)
-        bc_weight = params.handle_error_distrib.weakened_hc_weight;
+// Assembles the vertex-solve normal equations of the current state into
+// data.vertex_AtWA and AtWb. The pattern is rebuilt whenever the constraint rows
+// or the eliminated unknowns change (pattern_changed is set in that case).
+//
+// Outputs the values of the eliminated unknowns (see compute_reduced_system_columns)
+// and returns the number of unknowns of the assembled system. Its sizes and
+// assembly timings are written to stats, if given.
+int assemble_vertex_solve_system(const reshaping::VertexSolveParams& params,
+                                 reshaping::ReshapingState& data,
+                                 Eigen::VectorXd& AtWb,
+                                 Eigen::VectorXd& fixed_values,
+                                 bool& pattern_changed,
+                                 reshaping::LinearSystemStats* stats = nullptr) {
+    CA_PROFILE_SCOPE("vertex_solve/assembly");
+
+    ca_essentials::core::Timer timer;
+    timer.start("assembly");
+
+    const Eigen::Vector2i sys_size = system_size(data, params.handle_error_distrib.is_active);
+
+    std::vector<int> sys_cols;
+    int num_rows     = sys_size.x();
+    int num_unknowns = sys_size.y();
+    if(params.exact_constraints) {
+        num_unknowns = compute_reduced_system_columns(params, data, sys_cols, fixed_values);
+
+        // The rows holding the eliminated vertices are dropped (see visit_bc_stencils)
+        const bool handle_error_distrib_on = params.handle_error_distrib.is_active;
+        num_rows -= 3 * (int) (handle_error_distrib_on ? data.handle_error_dist_out_verts.size()
+                                                       : data.bc.size());
+    }
 
-    for(const auto& [vid, pos] : data.bc) {
-        for(int d = 0; d < 3; ++d) {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid, (VERTEX_COMP) d, num_verts), 1.0);
+    // Stencils (and thus the system pattern) only change with the constraint rows
+    // and the eliminated unknowns
+    if(!params.reuse_system_pattern ||
+       data.vertex_sys_size != sys_size ||
+       data.vertex_sys_cols != sys_cols) {
+        data.vertex_sys_pattern.clear();
+        data.vertex_sys_size = sys_size;
+        data.vertex_sys_cols = std::move(sys_cols);
+    }
+    pattern_changed = data.vertex_sys_pattern.empty();
+    const std::vector<int>& reduced_cols = data.vertex_sys_cols;
+
+    const double normal_matrix_time = reshaping::assemble_normal_equations(num_unknowns,
+                                         [&](auto&& for_each, auto&& visit) {
+                                             if(reduced_cols.empty()) {
+                                                 visit_vertex_solve_stencils(params, data, for_each, visit);
+                                                 return;
+                                             }
+
+                                             visit_vertex_solve_stencils(params, data, for_each,
+                                                 [&](int idx, const auto& stencil) {
+                                                     visit(idx, eliminate_fixed_unknowns(stencil,
+                                                                                         reduced_cols,
+                                                                                         fixed_values));
+                                                 });
+                                         },
+                                         data.vertex_sys_pattern,
+                                         data.vertex_AtWA,
+                                         AtWb,
+                                         params.parallel_assembly,
+                                         "vertex_solve/normal_matrix");
+
+    if(stats) {
+        stats->assembly_time      = timer.elapsed("assembly");
+        stats->normal_matrix_time = normal_matrix_time;
+        stats->rows               = num_rows;
+        stats->unknowns           = num_unknowns;
+        stats->nnz_stencils       = data.vertex_sys_pattern.num_entries();
+        stats->nnz_AtWA           = data.vertex_AtWA.nonZeros();
+    }
 
-            b(curr_row) = pos(d);
-            w(curr_row) = bc_weight;
+    return num_unknowns;
+}
 
-            curr_row++;
-        }
-    }
+// Right-hand side of the bc stencils alone (see visit_bc_stencils), mapped to the
+// (possibly reduced) vertex-solve system
+Eigen::VectorXd assemble_bc_rhs(const reshaping::VertexSolveParams& params,
+                                const reshaping::ReshapingState& data,
+                                const std::vector<int>& reduced_cols,
+                                int num_unknowns) {
+    Eigen::VectorXd rhs = Eigen::VectorXd::Zero(num_unknowns);
+
+    int stencil_idx = 0;
+    visit_bc_stencils(params, data, stencil_idx, [&](int, const auto& stencil) {
+        const int col = reduced_cols.empty() ? stencil.cols[0] : reduced_cols[stencil.cols[0]];
+        if(col >= 0)
+            rhs(col) += stencil.f(0);
+    });
+
+    return rhs;
+}
 
-    // Hold every vertex off-ring (including boundary)
-    if(params.handle_error_distrib.is_active) {
-        for(int vid : data.handle_error_dist_out_verts) {
-            const Eigen::Vector3d& v = data.curr_vertices.row(vid);
+// Coupling C between the reduced unknowns (rows) and the eliminated ones (columns,
+// indexed as in the full system): eliminating the unknowns subtracts C * fixed_values
+// from the right-hand side (see eliminate_fixed_unknowns)
+Eigen::SparseMatrix<double> assemble_elimination_coupling(const reshaping::VertexSolveParams& params,
+                                                          const reshaping::ReshapingState& data,
+                                                          const std::vector<int>& reduced_cols,
+                                                          int num_unknowns) {
+    std::vector<Eigen::Triplet<double>> triplets;
+    visit_vertex_solve_stencils(params, data, reshaping::SerialForEach(),
+        [&](int, const auto& stencil) {
+            const int N = (int) stencil.cols.size();
+            for(int j = 0; j < N; ++j) {
+                if(reduced_cols[stencil.cols[j]] >= 0)
+                    continue;
+
+                for(int i = 0; i < N; ++i) {
+                    const int row = reduced_cols[stencil.cols[i]];
+                    if(row >= 0)
+                        triplets.emplace_back(row, stencil.cols[j], stencil.K(i, j));
+                }
+            }
+        });
 
-            for(int d = 0; d < 3; ++d) {
-                triplets.emplace_back(curr_row,
-                                      vertex_to_sys_idx(vid, (VERTEX_COMP) d, num_verts),
-                                      1.0);
+    Eigen::SparseMatrix<double> C(num_unknowns, (int) reduced_cols.size());
+    C.setFromTriplets(triplets.begin(), triplets.end());
+    return C;
+}
 
-                b(curr_row) = v(d);
-                w(curr_row) = params.handle_error_distrib.off_zone_hc_weight;
+// Converts a solution of the (possibly reduced) vertex-solve system to vertex positions
+void system_solution_to_vertices(const Eigen::VectorXd& sol,
+                                 const std::vector<int>& reduced_cols,
+                                 const Eigen::VectorXd& fixed_values,
+                                 Eigen::MatrixXd& outV) {
+    // Restoring the eliminated unknowns
+    Eigen::VectorXd full_sol;
+    if(!reduced_cols.empty()) {
+        full_sol = fixed_values;
+        for(int i = 0; i < (int) reduced_cols.size(); ++i)
+            if(reduced_cols[i] >= 0)
+                full_sol(i) = sol(reduced_cols[i]);
+    }
+    const Eigen::VectorXd& x = reduced_cols.empty() ? sol : full_sol;
 
-                curr_row++;
-            }
-        }
+    const int num_verts = (int) x.size() / 3;
+    for(int v = 0; v < num_verts; ++v) {
+        outV.row(v) << x(num_verts * 0 + v),
+                       x(num_verts * 1 + v),
+                       x(num_verts * 2 + v);
     }
 }
 
+}
 
-void compute_regularizer_entries(const reshaping::VertexSolveParams& params,
-                                 const reshaping::ReshapingData& data,
-                                 reshaping::TripletsVec& triplets,
-                                 Eigen::VectorXd& b,
-                                 Eigen::VectorXd& w,
-                                 int& curr_row) {
-    using VERTEX_COMP = reshaping::VERTEX_COMP;
+namespace reshaping {
 
-    const auto& mesh    = data.mesh;
-    const int num_verts = mesh.get_num_vertices();
-    const int num_edges = mesh.get_num_edges();
-    const double weight = params.regularizer_weight *
-                          (1.0 / data.avg_edge_len);
+bool solve_for_vertices(const VertexSolveParams& params,
+                        ReshapingState& data,
+                        Eigen::MatrixXd& outV,
+                        LinearSystemStats* stats) {
+    ca_essentials::core::Timer timer;
+
+    Eigen::VectorXd AtWb;
+    Eigen::VectorXd fixed_values;
+    bool pattern_changed = false;
+    const int num_unknowns = assemble_vertex_solve_system(params, data, AtWb, fixed_values,
+                                                          pattern_changed, stats);
+    const std::vector<int>& reduced_cols = data.vertex_sys_cols;
+    const Eigen::SparseMatrix<double>& AtWA = data.vertex_AtWA;
+
+    LinearSolverBackend& solver = *data.vertex_solver;
+
+    bool needs_prefactorization = data.iter == 0 || pattern_changed;
+    if(needs_prefactorization)
+        data.vertex_factor_iter = -1;
+
+    const VertexWarmStartParams& warm_start = params.warm_start;
+    const bool reuse_factor = warm_start.is_active &&
+                              !solver.is_iterative() &&
+                              data.vertex_factor_iter >= 0 &&
+                              (warm_start.refactor_every_n_iters <= 0 ||
+                               data.iter - data.vertex_factor_iter < warm_start.refactor_every_n_iters);
+
+    // Iterative solvers (and the warm-started solve) start from the current vertex positions
+    Eigen::VectorXd initial_guess;
+    if(solver.is_iterative() || reuse_factor) {
+        const Eigen::Map<const Eigen::VectorXd> curr_x(data.curr_vertices.data(), data.curr_vertices.size());
+        initial_guess = to_reduced_system(curr_x, reduced_cols, num_unknowns);
+    }
 
-    for(int eid = 0; eid < num_edges; ++eid) {
-        const auto edge_vids = mesh.get_edge_vertices(eid);
+    Eigen::VectorXd sol = initial_guess;
+
+    bool solved = false;
+    double solve_time = 0.0;
+    if(reuse_factor) {
+        CA_PROFILE_SCOPE("vertex_solve/warm_start_cg");
+        timer.start("warm_start");
+
+        int cg_iters = solve_with_lagged_factor(AtWA, AtWb, solver,
+                                                data.vertex_warm_start_tol,
+                                                warm_start.max_cg_iters,
+                                                sol);
+        solved = cg_iters >= 0;
+        solve_time += timer.elapsed("warm_start");
+
+        if(solved)
+            LOGGER.debug("Warm-started vertex solve converged after {} CG iterations", cg_iters);
+        else {
+            LOGGER.debug("Warm-started vertex solve has not converged. Factorizing the system");
+            sol = initial_guess;
+        }
+    }
 
-        const int vid0 = edge_vids.at(0);
-        const int vid1 = edge_vids.at(1);
+    bool decomposition_succ = true;
+    bool solution_succ = true;
+    double factorize_time = 0.0;
+    if(!solved) {
+        timer.start("factorize");
 
-        const Eigen::Vector3d& orig_E = data.orig_edges.row(eid);
+        if(needs_prefactorization) {
+            CA_PROFILE_SCOPE("vertex_solve/analyze_pattern");
+            solver.analyze_pattern(AtWA);
+        }
 
-        // x-component
+        // Check whether the decomposition has failed
         {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::X, num_verts),  1.0);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::X, num_verts), -1.0);
+            CA_PROFILE_SCOPE("vertex_solve/factorize");
+            decomposition_succ = solver.factorize(AtWA);
+        }
+        factorize_time = timer.elapsed("factorize");
 
-            b(curr_row) = orig_E.x();
-            w(curr_row) = weight;
-            curr_row++;
+        if(!decomposition_succ) {
+            LOGGER.error("Error while performing the decomposition in the Vertex-Solver ({})",
+                         solver.name());
+            assert(false && "Error while performing the decomposition in the Vertex-solver");
         }
+        data.vertex_factor_iter = decomposition_succ ? data.iter : -1;
 
-        // y-component
-        {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Y, num_verts),  1.0);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Y, num_verts), -1.0);
+        // Computing solution
+        CA_PROFILE_SCOPE("vertex_solve/solve");
+        timer.start("solve");
+        solution_succ = solver.solve(AtWb, sol);
+        solve_time += timer.elapsed("solve");
+    }
 
-            b(curr_row) = orig_E.y();
-            w(curr_row) = weight;
-            curr_row++;
-        }
+    if(stats) {
+        stats->factorize_time = factorize_time;
+        stats->solve_time     = solve_time;
+        stats->nnz_factor     = solver.factor_nonzeros();
+    }
 
-        // z-component
-        {
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid1, VERTEX_COMP::Z, num_verts),  1.0);
-            triplets.emplace_back(curr_row, vertex_to_sys_idx(vid0, VERTEX_COMP::Z, num_verts), -1.0);
+    system_solution_to_vertices(sol, reduced_cols, fixed_values, outV);
 
-            b(curr_row) = orig_E.z();
-            w(curr_row) = weight;
-            curr_row++;
-        }
+    if(!solution_succ) {
+        LOGGER.error("Error while performing {}::solve in the vertex solve", solver.name());
+        assert(false); // TODO: use release-compatible assert
     }
+
+    return decomposition_succ && solution_succ;
 }
 
-void assemble_vertex_solve_system(const reshaping::VertexSolveParams& params,
-                                  const reshaping::ReshapingData& data,
-                                  Eigen::SparseMatrix<double>& A,
-                                  Eigen::VectorXd& b,
-                                  Eigen::VectorXd& w) {
-                                  
-    bool is_error_distrib_active = params.handle_error_distrib.is_active;
-    Eigen::Vector2i sys_size = system_size(data, is_error_distrib_active);
-
-    reshaping::TripletsVec all_triplets;
-    b.resize(sys_size.x());
-    w.resize(sys_size.x());
-    A.resize((Eigen::Index) sys_size.x(), (Eigen::Index) sys_size.y());
-
-    int curr_row = 0;
-    compute_edge_term_entries   (params, data, all_triplets, b, w, curr_row);
-    compute_normal_entries      (params, data, all_triplets, b, w, curr_row);
-    compute_straightness_entries(params, data, all_triplets, b, w, curr_row);
-#if SPHERICITY_ON
-    compute_sphericity_entries  (params, data, all_triplets, b, w, curr_row);
-#endif
-    compute_bc_entries          (params, data, all_triplets, b, w, curr_row);
-    compute_regularizer_entries (params, data, all_triplets, b, w, curr_row);
+bool solve_initial_vertices_for_edits(const VertexSolveParams& params,
+                                      ReshapingState& data,
+                                      const std::vector<std::unordered_map<int, Eigen::Vector3d>>& bcs,
+                                      std::vector<Eigen::MatrixXd>& outV) {
+    const int num_edits = (int) bcs.size();
+    const int num_verts = data.mesh.get_num_vertices();
 
-    A.setFromTriplets(all_triplets.begin(), all_triplets.end());
-}
+    if(num_edits == 0)
+        return true;
 
-}
+    // The stencil pattern is shared, so every edit must constrain the same vertices
+    for(int i = 1; i < num_edits; ++i) {
+        bool same_vertices = bcs.at(i).size() == bcs.front().size();
+        for(auto itr = bcs.at(i).begin(); same_vertices && itr != bcs.at(i).end(); ++itr)
+            same_vertices = bcs.front().count(itr->first) > 0;
 
-namespace reshaping {
+        if(!same_vertices) {
+            LOGGER.error("Edit operations constraining different vertices cannot share the vertex solve");
+            return false;
+        }
+    }
 
-bool solve_for_vertices(const VertexSolveParams& params,
-                        ReshapingData& data,
-                        Eigen::MatrixXd& outV) {
-    Eigen::SparseMatrix<double> A;
-    Eigen::VectorXd b;
-    Eigen::VectorXd w;
-    assemble_vertex_solve_system(params, data, A, b, w);
-
-    const Eigen::Transpose<Eigen::SparseMatrix<double>> At = A.transpose();
-    const Eigen::DiagonalWrapper<const Eigen::VectorXd> W  = w.asDiagonal();
-    Eigen::SparseMatrix<double> AtWA = At * W * A;
-    Eigen::VectorXd AtWb             = At * W * b;
-
-    bool needs_prefactorization = data.iter == 0;
-    if(needs_prefactorization)
-        data.vertex_solver.analyzePattern(AtWA);
+    // The system matrix is shared, so it is only assembled for the first edit
+    std::vector<Eigen::VectorXd> fixed_values(num_edits);
+    data.bc = bcs.front();
+
+    Eigen::VectorXd AtWb;
+    bool pattern_changed = false;
+    const int num_unknowns = assemble_vertex_solve_system(params, data, AtWb,
+                                                          fixed_values.front(),
+                                                          pattern_changed);
+    const std::vector<int>& reduced_cols = data.vertex_sys_cols;
+
+    // Only the constraint targets differ among the edits, so the right-hand sides
+    // of the others only change by those of the bc stencils and of the eliminated
+    // unknowns
+    const Eigen::VectorXd bc_rhs = assemble_bc_rhs(params, data, reduced_cols, num_unknowns);
+
+    Eigen::SparseMatrix<double> elimination_coupling;
+    if(!reduced_cols.empty() && num_edits > 1)
+        elimination_coupling = assemble_elimination_coupling(params, data, reduced_cols, num_unknowns);
+
+    Eigen::MatrixXd B(num_unknowns, num_edits);
+    B.col(0) = AtWb;
+    for(int i = 1; i < num_edits; ++i) {
+        // Updating the targets in place keeps the constraints (and thus the bc
+        // stencils) in the same order
+        for(auto& [vid, pos] : data.bc)
+            pos = bcs.at(i).at(vid);
+
+        B.col(i) = AtWb + assemble_bc_rhs(params, data, reduced_cols, num_unknowns) - bc_rhs;
+
+        if(!reduced_cols.empty()) {
+            std::vector<int> sys_cols;
+            compute_reduced_system_columns(params, data, sys_cols, fixed_values.at(i));
+            B.col(i) -= elimination_coupling * (fixed_values.at(i) - fixed_values.front());
+        }
+    }
 
-    data.vertex_solver.factorize(AtWA);
+    LinearSolverBackend& solver = *data.vertex_solver;
+    const Eigen::SparseMatrix<double>& AtWA = data.vertex_AtWA;
 
-    // Check whether the decomposition has failed
-    bool decomposition_succ = data.vertex_solver.info() == Eigen::Success;
+    bool decomposition_succ = false;
+    {
+        CA_PROFILE_SCOPE("vertex_solve/factorize");
+        decomposition_succ = solver.analyze_pattern(AtWA) &&
+                             solver.factorize(AtWA);
+    }
     if(!decomposition_succ) {
-        LOGGER.error("Error while performing Cholesky decomposition in the Vertex-Solver ({})",
-                                      data.vertex_solver.info());
-        assert(false && "Error while performing Cholesky decomposition in the Vertex-solver");
+        LOGGER.error("Error while performing the decomposition in the Vertex-Solver ({})",
+                     solver.name());
+        return false;
     }
 
-    // Computing solution
-    Eigen::VectorXd sol = data.vertex_solver.solve(AtWb);
+    CA_PROFILE_SCOPE("vertex_solve/solve");
+    Eigen::MatrixXd X;
+    if(!solver.solve_multiple(B, X)) {
+        LOGGER.error("Error while performing {}::solve_multiple in the vertex solve", solver.name());
+        return false;
+    }
 
-    const int num_verts = data.mesh.get_num_vertices();
-    for(int v = 0; v < num_verts; ++v) {
-        outV.row(v) << sol(num_verts * 0 + v),
-                       sol(num_verts * 1 + v),
-                       sol(num_verts * 2 + v);
+    outV.resize(num_edits);
+    for(int i = 0; i < num_edits; ++i) {
+        outV.at(i).resize(num_verts, 3);
+        system_solution_to_vertices(X.col(i), data.vertex_sys_cols, fixed_values.at(i), outV.at(i));
     }
 
-    bool solution_succ = data.vertex_solver.info() == Eigen::Success;
-    if(!solution_succ) {
-        LOGGER.error("Error while performing Cholesky::solve in the vertex solve");
-        assert(false); // TODO: use release-compatible assert
+    return true;
+}
+
+int assemble_vertex_solve_normal_equations(const VertexSolveParams& params,
+                                           ReshapingState& data,
+                                           Eigen::VectorXd& AtWb,
+                                           LinearSystemStats* stats) {
+    Eigen::VectorXd fixed_values;
+    bool pattern_changed = false;
+    return assemble_vertex_solve_system(params, data, AtWb, fixed_values, pattern_changed, stats);
+}
+
+double evaluate_vertex_solve_stencils(const VertexSolveParams& params,
+                                      const ReshapingState& data,
+                                      VertexSolveTerms terms) {
+    double sum = 0.0;
+    auto accumulate = [&](int, const auto& stencil) {
+        sum += stencil.K.trace() + stencil.f.sum();
+    };
+
+    int stencil_idx = 0;
+    const SerialForEach for_each;
+    switch(terms) {
+        case VertexSolveTerms::Edges:
+            visit_edge_stencils(params, data, stencil_idx, for_each, accumulate);
+            break;
+        case VertexSolveTerms::Straightness:
+            visit_straightness_stencils(params, data, stencil_idx, for_each, accumulate);
+            break;
+        case VertexSolveTerms::Sphericity:
+#if SPHERICITY_ON
+            visit_sphericity_stencils(params, data, stencil_idx, for_each, accumulate);
+#endif
+            break;
+        case VertexSolveTerms::Constraints:
+            visit_bc_stencils(params, data, stencil_idx, accumulate);
+            break;
+        case VertexSolveTerms::All:
+            visit_vertex_solve_stencils(params, data, for_each, accumulate);
+            break;
     }
 
-    return decomposition_succ && solution_succ;
+    return sum;
 }
 
 }
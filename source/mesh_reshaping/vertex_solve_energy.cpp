@@ -1,111 +1,103 @@
 #include <mesh_reshaping/vertex_solve_energy.h>
 
 #include <mesh_reshaping/reshaping_data.h>
+#include <mesh_reshaping/blocked_sum.h>
 #include <mesh_reshaping/types.h>
 
-namespace {
-
-double compute_edge_term_cost(const reshaping::ReshapingData& data,
-                              const Eigen::MatrixXd& V) {
-    const auto& mesh    = data.mesh;
-    const int num_edges = mesh.get_num_edges();
-    const auto& adj_e2f = mesh.get_edge_face_adjacency();
-
-    double cost = 0.0;
-    for(int e = 0; e < num_edges; ++e) {
-        const std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
-        const int vid0 = edge_vids.at(0);
-        const int vid1 = edge_vids.at(1);
-
-        const Eigen::Vector3d& curr_v0 = V.row(vid0);
-        const Eigen::Vector3d& curr_v1 = V.row(vid1);
-
-        const Eigen::Vector3d& orig_E = data.orig_edges.row(e);
-        const Eigen::Vector3d curr_E = curr_v1 - curr_v0;
+#include <igl/parallel_for.h>
 
-        const double orig_len = data.orig_edge_lens(e);
-        const double curr_len = data.curr_edge_lens(e);
-
-        const double w_ij = data.length_based_edge_w(e);
-        for(int f = 0; f < 2; ++f) {
-            int fid = adj_e2f.at(e).at(f);
-
-            const Eigen::Matrix3d& T = data.curr_tri_T.at(fid);
-            const Eigen::Matrix3d T_inv = T.inverse();
+namespace {
 
-            cost += w_ij * (((T_inv * curr_E) / orig_len) - (orig_E / orig_len)).squaredNorm();
-        }
+// Inverse of every per-triangle transformation, shared by the two edge terms of
+// its three edges
+std::vector<Eigen::Matrix3d> compute_inverse_transformations(const reshaping::ReshapingState& data,
+                                                             bool parallel) {
+    const int num_tris = (int) data.curr_tri_T.size();
+
+    std::vector<Eigen::Matrix3d> T_inv(num_tris);
+    auto invert = [&](int t) {
+        T_inv[t] = data.curr_tri_T[t].inverse();
+    };
+
+    if(parallel)
+        igl::parallel_for(num_tris, invert, 1000);
+    else {
+        for(int t = 0; t < num_tris; ++t)
+            invert(t);
     }
 
-    return cost;
+    return T_inv;
 }
 
-double compute_normal_term_cost(const reshaping::ReshapingData& data,
-                                const Eigen::MatrixXd& V) {
+// Edge, normal and scale (regularizer) term costs, evaluated in a single pass over
+// the edges. Returns (edge_cost, normal_cost, scale_cost).
+Eigen::Vector3d compute_edge_terms_costs(const reshaping::ReshapingState& data,
+                                         const Eigen::MatrixXd& V,
+                                         bool parallel) {
     const auto& mesh    = data.mesh;
     const int num_edges = mesh.get_num_edges();
     const auto& adj_e2f = mesh.get_edge_face_adjacency();
 
-    double cost = 0.0;
-    for(int e = 0; e < num_edges; ++e) {
+    const std::vector<Eigen::Matrix3d> T_inv = compute_inverse_transformations(data, parallel);
+    const double scale_w = 1.0 / data.context->avg_edge_len;
+
+    return reshaping::blocked_sum<3>(num_edges, [&](int e, Eigen::Vector3d& costs) {
         const std::array<int, 2> edge_vids = mesh.get_edge_vertices(e);
         const int vid0 = edge_vids.at(0);
         const int vid1 = edge_vids.at(1);
 
-        const Eigen::Vector3d& curr_v0 = V.row(vid0);
-        const Eigen::Vector3d& curr_v1 = V.row(vid1);
-
-        const Eigen::Vector3d curr_E = curr_v1 - curr_v0;
+        const Eigen::Vector3d& orig_E = data.orig_edges().row(e);
+        const Eigen::Vector3d curr_E  = V.row(vid1) - V.row(vid0);
 
-        const double orig_len = data.orig_edge_lens(e);
+        const double orig_len = data.orig_edge_lens()(e);
         const double curr_len = data.curr_edge_lens(e);
+        const double w_ij     = data.length_based_edge_w(e);
 
-        const double w_ij = data.length_based_edge_w(e) *
-                            (orig_len / data.avg_edge_len);
+        const double w_normal = w_ij * (orig_len / data.context->avg_edge_len);
 
         const auto& adj_faces = adj_e2f.at(e);
-        for(int adj_tid : adj_faces) {
-            const Eigen::Vector3d& n = data.orig_tri_N.row(adj_tid);
+        for(int f = 0; f < 2; ++f) {
+            const int fid = adj_faces.at(f);
 
-            cost += w_ij * pow(n.dot(curr_E / curr_len), 2.0);
+            // Edge term: T^-1_i e_ij/l^0_ij - e^0_ij/l^0_ij
+            costs(0) += w_ij * (((T_inv[fid] * curr_E) / orig_len) - (orig_E / orig_len)).squaredNorm();
+
+            // Normal term: n^i . e_ij / l_ij
+            const Eigen::Vector3d& n = data.orig_tri_N().row(fid);
+            costs(1) += w_normal * pow(n.dot(curr_E / curr_len), 2.0);
         }
-    }
 
-    return cost;
+        // Scale term: e_ij - e^0_ij
+        costs(2) += scale_w * (curr_E - orig_E).squaredNorm();
+    }, parallel);
 }
 
-double compute_sphericity_term_cost(const reshaping::ReshapingData& data,
-                                    const Eigen::MatrixXd& V) {
-    const auto& mesh = data.mesh;
+double compute_sphericity_term_cost(const reshaping::ReshapingState& data,
+                                    const Eigen::MatrixXd& V,
+                                    bool parallel) {
+    const auto& terms_info = data.context->sphericity_terms_info;
+    const auto& term_edges = data.context->sphericity_term_edges;
 
-    double cost = 0.0;
-    for(const auto& info : data.sphericity_terms_info) {
+    return reshaping::blocked_sum<1>((int) terms_info.size(), [&](int t, Eigen::Matrix<double, 1, 1>& cost) {
+        const auto& info = terms_info[t];
         const int vi = info.vid_i;
         const int vj = info.vid_j;
         const int vk = info.vid_k;
 
-        const double face_weight = info.w;
-        const Eigen::Matrix3d& R = info.R;
-
-        int eid_ij = mesh.get_edge_index(vi, vj);
-        int eid_ik = mesh.get_edge_index(vi, vk);
-
-        const double orig_len_ij = data.orig_edge_lens(eid_ij);
-        const double orig_len_ik = data.orig_edge_lens(eid_ik);
+        const double orig_len_ij = data.orig_edge_lens()(term_edges[t][0]);
+        const double orig_len_ik = data.orig_edge_lens()(term_edges[t][1]);
 
         Eigen::Vector3d Eij = (V.row(vj) - V.row(vi));
         Eigen::Vector3d Eik = (V.row(vk) - V.row(vi));
 
-        cost += face_weight * (Eij/orig_len_ij - R * (Eik/orig_len_ik)).squaredNorm();
-    }
-
-    return cost;
+        cost(0) += info.w * (Eij/orig_len_ij - info.R * (Eik/orig_len_ik)).squaredNorm();
+    }, parallel)(0);
 }
 
-double compute_straightness_cost(const reshaping::ReshapingData& data,
+double compute_straightness_cost(const reshaping::ReshapingState& data,
                                  const Eigen::MatrixXd& V) {
     const auto& mesh = data.mesh;
-    const auto& straight_chains = data.straight_chains;
+    const auto& straight_chains = data.context->straight_chains;
 
     double cost = 0.0;
     if(!straight_chains)
@@ -142,7 +134,7 @@ double compute_straightness_cost(const reshaping::ReshapingData& data,
     return cost;
 }
 
-double compute_constraints_cost(const reshaping::ReshapingData& data,
+double compute_constraints_cost(const reshaping::ReshapingState& data,
                                 const Eigen::MatrixXd& V) {
     double cost = 0.0;
 
@@ -154,44 +146,23 @@ double compute_constraints_cost(const reshaping::ReshapingData& data,
     return cost;
 }
 
-double compute_scale_term_cost(const reshaping::ReshapingData& data,
-                               const Eigen::MatrixXd& V) {
-    const auto& mesh = data.mesh;
-    const auto& num_edges = mesh.get_num_edges();
-
-    const double weight = (1.0 / data.avg_edge_len);
-
-    double cost = 0.0;
-    for(int eid = 0; eid < num_edges; ++eid) {
-        const auto edge_vids = mesh.get_edge_vertices(eid);
-
-        const int vid0 = edge_vids.at(0);
-        const int vid1 = edge_vids.at(1);
-
-        const Eigen::Vector3d& orig_E = data.orig_edges.row(eid);
-        const Eigen::Vector3d  curr_E = V.row(vid1) - V.row(vid0);
-
-        cost += weight *  (curr_E - orig_E).squaredNorm();
-    }
-
-    return cost;
-}
-
 }
 
 namespace reshaping {
 
 VertexSolveEnergy compute_vertex_solve_energy(const VertexSolveParams& params,
-                                              const ReshapingData& data,
-                                              const Eigen::MatrixXd& V) {
+                                              const ReshapingState& data,
+                                              const Eigen::MatrixXd& V,
+                                              bool parallel) {
     VertexSolveEnergy energy;
 
-    energy.edge_cost        = compute_edge_term_cost(data, V);
-    energy.normal_cost      = compute_normal_term_cost(data, V);
-    energy.sphericity_cost  = compute_sphericity_term_cost(data, V);
+    const Eigen::Vector3d edge_costs = compute_edge_terms_costs(data, V, parallel);
+    energy.edge_cost        = edge_costs(0);
+    energy.normal_cost      = edge_costs(1);
+    energy.scale_cost       = edge_costs(2);
+    energy.sphericity_cost  = compute_sphericity_term_cost(data, V, parallel);
     energy.straight_cost    = compute_straightness_cost(data, V);
     energy.constraints_cost = compute_constraints_cost(data, V);
-    energy.scale_cost       = compute_scale_term_cost(data, V);
 
     energy.total_cost = params.edge_weight         * energy.edge_cost       +
                         params.normal_weight       * energy.normal_cost     +
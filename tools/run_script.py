@@ -68,8 +68,6 @@ os.system(f"cp {fk_file} {output_folder}/{filename}_new.fk")
 os.system(f"cp {mesh_filename} {output_folder}/{filename}_new.obj")
 
 
-### launch demo
-for i in range(num0):
-    for j in range(num1):
-        cmd = f"/Users/mhg/Projects/SlippagePreservingReshaping/build/apps/reshaping_demo/reshaping_demo -i {output_folder}/{filename}_new.obj -o {output_folder} -e {filename}_{i}_{j}"
-        os.system(cmd)
+### launch batch reshaping (solves all the edit operations in the new .deform file)
+cmd = f"/Users/mhg/Projects/SlippagePreservingReshaping/build/apps/reshaping_batch/reshaping_batch -i {output_folder}/{filename}_new.obj -o {output_folder}"
+os.system(cmd)